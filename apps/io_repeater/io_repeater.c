@@ -18,6 +18,7 @@ http://www.pololu.com/docs/0J46
 #include <gpio.h>
 #include <radio_queue.h>
 #include <adc.h>
+#include <pin_change.h>
 
 #define PIN_COUNT 15
 static uint8 CODE pins[PIN_COUNT] = {0, 1, 2, 3, 4, 5, 10, 11, 12, 13, 14, 15, 16, 17, 21};
@@ -26,18 +27,27 @@ static uint8 CODE pins[PIN_COUNT] = {0, 1, 2, 3, 4, 5, 10, 11, 12, 13, 14, 15, 1
 #define IS_INPUT(pin)  (pinLink(pin) < 0)
 #define IS_OUTPUT(pin) (pinLink(pin) > 0)
 
-// list and count of input pins
+// list and count of input pins, with the link of each one
 static uint8 XDATA inPins[PIN_COUNT];
+static uint8 XDATA inLinks[PIN_COUNT];
+static GPIO_PIN_MAP XDATA inMap[PIN_COUNT];
 static uint8 inPinCount = 0;
 
-// list and count of output pins
+// list and count of output pins, with the link of each one
 static uint8 XDATA outPins[PIN_COUNT];
+static uint8 XDATA outLinks[PIN_COUNT];
+static GPIO_PIN_MAP XDATA outMap[PIN_COUNT];
 static uint8 outPinCount = 0;
 
 // only tx if we have at least one input; only rx if we have at least one output
 static BIT txEnabled = 0;
 static BIT rxEnabled = 0;
 
+// The input pins are sent soon after one of them changes, and also every
+// 7-10 milliseconds (KEEPALIVE_INTERVAL plus a random 0-3) so that a lost
+// packet is corrected quickly, as before pin change events were used.
+#define KEEPALIVE_INTERVAL 7
+
 // In each byte of a buffer:
 // bit 7 = pin value
 // bits 6:0 = pin link
@@ -112,6 +122,7 @@ void configurePins(void)
             // This pin is configured as an output, so add it to the list of output pins.
             // The default state of the output pins, as documented in the user's guide, is LOW.
             setDigitalOutput(tmp, LOW);
+            outLinks[outPinCount] = pinLink(tmp);
             outPins[outPinCount++] = tmp;
             rxEnabled = 1;
         }
@@ -119,10 +130,19 @@ void configurePins(void)
         {
             // This pin is configured as an input, so add it to the list of input pins.
             // The pin is already an input because all pins are inputs by default.
+            inLinks[inPinCount] = -pinLink(tmp);
             inPins[inPinCount++] = tmp;
             txEnabled = 1;
+
+            // Use the port interrupts to find out as soon as the pin changes.
+            pinChangeEnable(tmp, PIN_CHANGE_BOTH);
         }
     }
+
+    // Precompute the ports and masks of the pins so that readPins and setPins
+    // can read and write all of them at once.
+    pinMapInit(inMap, inPins, inPinCount);
+    pinMapInit(outMap, outPins, outPinCount);
 }
 
 // read the states of input pins on this Wixel into a buffer
@@ -130,10 +150,14 @@ void readPins(uint8 XDATA * buf)
 {
     uint8 pin;
 
+    // sample all the input pins at the same time
+    uint16 values = pinMapRead(inMap, inPinCount);
+
     for (pin = 0; pin < inPinCount; pin++)
     {
-        // put pin link in lower 7 bits, read pin state and put in highest bit
-        buf[pin] = (-pinLink(inPins[pin]) << PIN_LINK_OFFSET) | (isPinHigh(inPins[pin]) << PIN_VAL_OFFSET);
+        // put pin link in lower 7 bits, pin state in highest bit
+        buf[pin] = (inLinks[pin] << PIN_LINK_OFFSET) | ((uint8)(values & 1) << PIN_VAL_OFFSET);
+        values >>= 1;
     }
 }
 
@@ -141,20 +165,34 @@ void readPins(uint8 XDATA * buf)
 void setPins(uint8 XDATA * buf, uint8 byteCount)
 {
     uint8 byte, pin;
+    uint16 bit;
+    uint16 mask = 0;
+    uint16 values = 0;
 
     // loop over all bytes in packet
     for (byte = 0; byte < byteCount; byte++)
     {
-        for (pin = 0; pin < outPinCount; pin++)
+        for (pin = 0, bit = 1; pin < outPinCount; pin++, bit <<= 1)
         {
             // check if this output pin's link matches the link in this packet
-            if ((uint8)pinLink(outPins[pin]) == ((buf[byte] >> PIN_LINK_OFFSET) & PIN_LINK_MASK))
+            if (outLinks[pin] == ((buf[byte] >> PIN_LINK_OFFSET) & PIN_LINK_MASK))
             {
-                // if so, set the pin state based on the val bit
-                setDigitalOutput(outPins[pin], (buf[byte] >> PIN_VAL_OFFSET) & 1);
+                // if so, record the pin state based on the val bit
+                mask |= bit;
+                if ((buf[byte] >> PIN_VAL_OFFSET) & 1)
+                {
+                    values |= bit;
+                }
+                else
+                {
+                    values &= ~bit;
+                }
             }
         }
     }
+
+    // set all the output pins at the same time
+    pinMapWrite(outMap, outPinCount, mask, values);
 }
 
 void main(void)
@@ -165,6 +203,7 @@ void main(void)
 
     uint8 lastTx = 0;
     uint8 txInterval = 0;
+    BIT inputsChanged = 0;
 
     systemInit();
     usbInit();
@@ -186,19 +225,31 @@ void main(void)
             radioQueueRxDoneWithPacket();
         }
 
-        // read our input pins and transmit pin states to other Wixel(s) every MAX_TX_INTERVAL milliseconds
-        if (txEnabled && (uint8)(getMs() - lastTx) > txInterval && (txBuf = radioQueueTxCurrentPacket()))
+        // check whether any of our input pins changed since the last packet
+        while (pinChangeCurrentEvent())
+        {
+            pinChangeDoneWithEvent();
+            inputsChanged = 1;
+        }
+
+        // read our input pins and transmit pin states to other Wixel(s) when they changed, and
+        // otherwise every KEEPALIVE_INTERVAL milliseconds.  A change is only sent when no other
+        // packet is waiting in the TX queue, so the pins are read when the packet can actually go
+        // out and several changes in a row are coalesced into one packet with the newest state.
+        if (txEnabled && ((inputsChanged && radioQueueTxQueued() == 0) || (uint8)(getMs() - lastTx) > txInterval)
+            && (txBuf = radioQueueTxCurrentPacket()))
         {
             readPins(txBuf + 1);
             *txBuf = inPinCount; // set packet length byte
             radioQueueTxSendPacket();
 
             lastTx = getMs();
-            
+            inputsChanged = 0;
+
             // Decide when to send the next packet.  We take a noisy reading of the temperature sensor
             // to get two random bits, so that we can avoid accidentally getting synchronized with another
             // transmitting Wixel.
-            txInterval = 7 + (adcRead(14 | ADC_BITS_7) & 3);
+            txInterval = KEEPALIVE_INTERVAL + (adcRead(14 | ADC_BITS_7) & 3);
         }
     }
 }
@@ -1 +1 @@
-APP_LIBS := dma.lib radio_mac.lib radio_queue.lib radio_registers.lib random.lib usb.lib usb_cdc_acm.lib wixel.lib gpio.lib adc.lib
\ No newline at end of file
+APP_LIBS := dma.lib radio_mac.lib radio_queue.lib radio_registers.lib random.lib usb.lib usb_cdc_acm.lib wixel.lib gpio.lib adc.lib pin_change.lib
\ No newline at end of file
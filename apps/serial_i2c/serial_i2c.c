@@ -16,6 +16,29 @@ P1_0 = I2C SCL
 P1_1 = I2C SDA
 P0_3 = UART TX
 P0_2 = UART RX
+
+== Binary transfer commands ==
+
+Besides the S, P, and E commands, which do one step of an I2C transaction per
+byte, the bridge accepts commands that each do a whole transaction at once:
+
+  'T', address, write length, read length, write data...
+      Does a write of the given data to the 7-bit address, followed by a
+      repeated START and a read of the given length, with a STOP at the end
+      (either part is skipped if its length is 0).  The response is one status
+      byte followed by exactly "read length" bytes of data.  The status byte
+      is 0 on success, otherwise it has the same bits as the E command's
+      response (NACK on address, NACK on data, or I2C timeout).
+
+  'F'
+      Finds the slaves on the bus.  The response is 16 bytes: bit N of byte M
+      is 1 if address 8*M+N acknowledged.
+
+== Bus speed ==
+
+With the default pins, setting I2C_freq_kHz to 400 runs the bus at 400 kHz
+(fast mode) using the fast path of i2c.lib.  With other pins, the actual
+frequency is limited to roughly 100 kHz.
 */
 
 /** Dependencies **************************************************************/
@@ -57,6 +80,8 @@ uint16 lastCmd = 0;
 #define CMD_START      'S'
 #define CMD_STOP       'P'
 #define CMD_GET_ERRORS 'E'
+#define CMD_TRANSFER   'T'
+#define CMD_SCAN       'F'
 
 // error flags
 #define ERR_I2C_NACK_ADDRESS (1 << 0)
@@ -69,10 +94,21 @@ uint16 lastCmd = 0;
 
 static uint8 errors = 0;
 
-static uint8 response = 0;
-static BIT returnResponse = 0;
-
-enum i2cState {IDLE, GET_ADDR, GET_LEN, GET_DATA};
+// The bytes waiting to be returned on serial.  The status byte and the data
+// read by a transfer command are written here directly.
+static uint8 XDATA response[1 + 255];
+static uint16 responseLength = 0;
+static uint16 responseIndex = 0;
+
+// The transfer command that is being received.
+static uint8 transferAddress;
+static uint8 transferWriteLength;
+static uint8 transferReadLength;
+static uint8 transferIndex;
+static uint8 XDATA transferWriteData[255];
+
+enum i2cState {IDLE, GET_ADDR, GET_LEN, GET_DATA,
+    GET_TRANSFER_ADDR, GET_TRANSFER_WRITE_LEN, GET_TRANSFER_READ_LEN, GET_TRANSFER_DATA};
 enum i2cState state = IDLE;
 
 static BIT started = 0;
@@ -95,6 +131,39 @@ void updateLeds(void)
     LED_RED(errors);
 }
 
+void returnResponse(uint16 length)
+{
+    responseLength = length;
+    responseIndex = 0;
+}
+
+void doTransfer(void)
+{
+    uint8 result = i2cTransfer(transferAddress, transferWriteData, transferWriteLength,
+        response + 1, transferReadLength);
+
+    switch (result)
+    {
+    case I2C_TRANSACTION_DONE:         response[0] = 0; break;
+    case I2C_TRANSACTION_NACK_ADDRESS: response[0] = ERR_I2C_NACK_ADDRESS; break;
+    case I2C_TRANSACTION_NACK:         response[0] = ERR_I2C_NACK_DATA; break;
+    default:                           response[0] = ERR_I2C_TIMEOUT; break;
+    }
+
+    if (result != I2C_TRANSACTION_DONE)
+    {
+        uint8 i;
+        for (i = 0; i < transferReadLength; i++)
+        {
+            response[1 + i] = 0;
+        }
+    }
+
+    errors |= response[0];
+    i2cTimeoutOccurred = 0;
+    returnResponse(1 + transferReadLength);
+}
+
 void parseCmd(uint8 byte)
 {
     BIT nack;
@@ -105,11 +174,36 @@ void parseCmd(uint8 byte)
         switch ((char)byte)
         {
         case CMD_GET_ERRORS:
-            response = errors;
-            returnResponse = 1;
+            response[0] = errors;
+            returnResponse(1);
             errors = 0;
             break;
 
+        case CMD_TRANSFER:
+            if (started)
+            {
+                // A transaction started with CMD_START must be stopped first.
+                errors |= ERR_CMD_INVALID;
+                break;
+            }
+            state = GET_TRANSFER_ADDR;
+            break;
+
+        case CMD_SCAN:
+            if (started)
+            {
+                errors |= ERR_CMD_INVALID;
+                break;
+            }
+            i2cScan(response);
+            if (i2cTimeoutOccurred)
+            {
+                errors |= ERR_I2C_TIMEOUT;
+                i2cTimeoutOccurred = 0;
+            }
+            returnResponse(16);
+            break;
+
         case CMD_START:
             i2cStart();
             started = 1;
@@ -181,6 +275,39 @@ void parseCmd(uint8 byte)
             }
         }
         break;
+
+    case GET_TRANSFER_ADDR:
+        transferAddress = byte;
+        state = GET_TRANSFER_WRITE_LEN;
+        break;
+
+    case GET_TRANSFER_WRITE_LEN:
+        transferWriteLength = byte;
+        state = GET_TRANSFER_READ_LEN;
+        break;
+
+    case GET_TRANSFER_READ_LEN:
+        transferReadLength = byte;
+        transferIndex = 0;
+        if (transferWriteLength == 0)
+        {
+            doTransfer();
+            state = IDLE;
+        }
+        else
+        {
+            state = GET_TRANSFER_DATA;
+        }
+        break;
+
+    case GET_TRANSFER_DATA:
+        transferWriteData[transferIndex++] = byte;
+        if (transferIndex == transferWriteLength)
+        {
+            doTransfer();
+            state = IDLE;
+        }
+        break;
     }
 }
 
@@ -194,25 +321,25 @@ void i2cRead(void)
     {
         errors |= ERR_I2C_TIMEOUT;
         i2cTimeoutOccurred = 0;
-        response = 0;
+        response[0] = 0;
     }
     else
     {
-        response = byte;
+        response[0] = byte;
     }
 
     if (--dataLength == 0)
     {
         state = IDLE;
     }
-    returnResponse = 1;
+    returnResponse(1);
 }
 
 
 void i2cService(void)
 {
     // Only try to process I2C if there isn't a response still waiting to be returned on serial.
-    if (!returnResponse)
+    if (responseIndex == responseLength)
     {
         if (dataDirIsRead && state == GET_DATA)
         {
@@ -232,12 +359,17 @@ void i2cService(void)
             started = 0;
             errors |= ERR_CMD_TIMEOUT;
         }
+        else if (state >= GET_TRANSFER_ADDR && (param_cmd_timeout_ms > 0) && ((uint16)(getMs() - lastCmd) > param_cmd_timeout_ms))
+        {
+            // The transfer command was not completely received in time.
+            state = IDLE;
+            errors |= ERR_CMD_TIMEOUT;
+        }
     }
 
-    if (returnResponse && txAvailableFunction())
+    while (responseIndex != responseLength && txAvailableFunction())
     {
-        txSendByteFunction(response);
-        returnResponse = 0;
+        txSendByteFunction(response[responseIndex++]);
     }
 }
 
@@ -7,9 +7,6 @@
 /*
  * TODO: To avoid damage, don't enable nDTR and nRTS outputs by default.
  * TODO: use LEDs to give feedback about sending/receiving bytes.
- * TODO: UART flow control.
- * TODO: Obey CDC-ACM Set Line Coding commands:
- *       In USB-RADIO mode, bauds 0-255 would correspond to radio channels.
  * TODO: shut down radio when we are in a different serial mode
  * TODO: make the heartbeat blinks on the Wixels be synchronized (will require
  *       major changes to the radio_link library)
@@ -51,6 +48,32 @@ int32 CODE param_CD_pin = -1;
 
 int32 CODE param_arduino_DTR_pin = 0;
 
+// Set this to 1 to enable RTS/CTS flow control on the UART.
+// P1_5 is the RTS output and P1_4 is the CTS input (both active low).
+// The radio's TX debug signal is not available on P1_5 when this is enabled.
+int32 CODE param_flow_control = 0;
+
+// Set this to a non-zero value to split the data received on the UART into
+// frames separated by idle gaps, and send each frame in its own radio packets.
+// This is the minimum time from the end of one byte to the end of the next
+// that separates two frames, in bit times (e.g. 39 for Modbus RTU).
+// Valid values are 0-255.  A value of 0 disables the feature.
+int32 CODE param_frame_gap_bits = 0;
+
+// Set this to 1 to obey the baud rate, parity, and stop bits that the USB host
+// chooses for the virtual COM port (CDC ACM SET_LINE_CODING requests) instead
+// of using param_baud_rate.
+// In USB-UART mode, the settings are applied to the UART right away.
+// In USB-RADIO mode, they are sent to the other Wixel, which applies them to
+// its UART after sending the bytes it has already received (if the other
+// Wixel is in UART-RADIO mode and also has this parameter set to 1).
+int32 CODE param_obey_line_coding = 0;
+
+// Set this to 1 to let the USB host choose the radio channel in USB-RADIO
+// mode by setting the baud rate of the virtual COM port to a value from 0 to
+// 255.  Those baud rates are not sent to the other Wixel.
+int32 CODE param_baud_selects_channel = 0;
+
 // Approximate number of milliseconds to disable UART's receiver for after a
 // framing error is encountered.
 // Valid values are 0-250.
@@ -70,6 +93,14 @@ BIT uartRxDisabled = 0;
 
 uint8 DATA currentSerialMode;
 
+// This bit is 1 if the USB host has changed the line coding and we have not
+// processed the change yet.
+BIT lineCodingChanged = 0;
+
+// Line coding received from the other Wixel that will be applied to the UART
+// when its TX buffer is empty, or 0 if there is none.
+ACM_LINE_CODING XDATA * pendingLineCoding = 0;
+
 BIT framingErrorActive = 0;
 
 BIT errorOccurredRecently = 0;
@@ -256,6 +287,58 @@ void errorService()
     }
 }
 
+void usbLineCodingChangeHandler()
+{
+    // This is called from usbComService(), so just remember the change and
+    // process it in lineCodingService().
+    lineCodingChanged = 1;
+}
+
+void uartApplyLineCoding(ACM_LINE_CODING XDATA * lineCoding)
+{
+    uart1SetBaudRate(lineCoding->dwDTERate);
+    uart1SetParity(lineCoding->bParityType);
+    uart1SetStopBits(lineCoding->bCharFormat);
+}
+
+void lineCodingService()
+{
+    if (!lineCodingChanged)
+    {
+        return;
+    }
+    lineCodingChanged = 0;
+
+    if (usbComLineCoding.dwDTERate == 333)
+    {
+        // This is the special baud rate that starts the bootloader.
+        return;
+    }
+
+    switch(currentSerialMode)
+    {
+    case SERIAL_MODE_USB_RADIO:
+        if (param_baud_selects_channel && usbComLineCoding.dwDTERate <= 255)
+        {
+            // The new channel is used the next time the radio is calibrated,
+            // which happens every time it starts receiving or transmitting.
+            CHANNR = usbComLineCoding.dwDTERate;
+        }
+        else if (param_obey_line_coding)
+        {
+            radioComTxLineCoding(&usbComLineCoding);
+        }
+        break;
+
+    case SERIAL_MODE_USB_UART:
+        if (param_obey_line_coding)
+        {
+            uartApplyLineCoding(&usbComLineCoding);
+        }
+        break;
+    }
+}
+
 void updateSerialMode()
 {
     if ((uint8)param_serial_mode > 0 && (uint8)param_serial_mode <= 3)
@@ -296,6 +379,17 @@ void usbToRadioService()
         usbComTxSendByte(radioComRxReceiveByte());
     }
 
+    // Errors detected by the other Wixel's UART, in order with the data.
+    signals = radioComRxControlSignalEvents();
+    if (signals)
+    {
+        usbComTxControlSignalEvents(signals);
+    }
+
+    // The other Wixel does not have a UART to apply line coding to, so
+    // ignore it.
+    radioComRxLineCoding();
+
     // Control Signals
 
     radioComTxControlSignals(usbComRxControlSignals() & 3);
@@ -307,15 +401,75 @@ void usbToRadioService()
 
 void uartToRadioService()
 {
+    uint8 errors;
+
     // Data
-    while(uart1RxAvailable() && radioComTxAvailable())
+    if (param_frame_gap_bits)
+    {
+        // Only send complete frames, and start a new packet for each frame so
+        // frames that fit in one packet arrive all at once.
+        uint16 length;
+        while((length = uart1RxFrameLength()) && radioComTxAvailable())
+        {
+            while(length && radioComTxAvailable())
+            {
+                if (errors = uart1RxErrors())
+                {
+                    radioComTxControlSignalEvents(errors);
+                    continue;
+                }
+                radioComTxSendByte(uart1RxReceiveByte());
+                length--;
+            }
+
+            if (length == 0)
+            {
+                radioComTxFlush();
+            }
+        }
+    }
+    else
+    {
+        while(uart1RxAvailable() && radioComTxAvailable())
+        {
+            if (errors = uart1RxErrors())
+            {
+                // Send the errors to the other Wixel at the right place in
+                // the data stream.  radioComTxAvailable() returns 0 until
+                // they are sent.
+                radioComTxControlSignalEvents(errors);
+                continue;
+            }
+            radioComTxSendByte(uart1RxReceiveByte());
+        }
+    }
+
+    if (pendingLineCoding == 0)
     {
-        radioComTxSendByte(uart1RxReceiveByte());
+        while(radioComRxAvailable() && uart1TxAvailable())
+        {
+            uart1TxSendByte(radioComRxReceiveByte());
+        }
+
+        // We can not send errors on the UART, so discard the errors reported by
+        // the other Wixel.
+        radioComRxControlSignalEvents();
+
+        pendingLineCoding = radioComRxLineCoding();
+        if (!param_obey_line_coding)
+        {
+            pendingLineCoding = 0;
+        }
     }
 
-    while(radioComRxAvailable() && uart1TxAvailable())
+    // The bytes the other Wixel sent before changing the line coding must be
+    // sent with the old settings, so wait until the UART has finished sending
+    // them.  The pointer remains valid because we stop calling
+    // radioComRxLineCoding until then.
+    if (pendingLineCoding != 0 && uart1TxIdle())
     {
-        uart1TxSendByte(radioComRxReceiveByte());
+        uartApplyLineCoding(pendingLineCoding);
+        pendingLineCoding = 0;
     }
 
     // Control Signals.
@@ -335,6 +489,14 @@ void usbToUartService()
 
     while(uart1RxAvailable() && usbComTxAvailable())
     {
+        if (signals = uart1RxErrors())
+        {
+            // Report framing, parity, and overrun errors to the USB host at
+            // the right place in the data stream.  usbComTxAvailable()
+            // returns 0 until they are reported.
+            usbComTxControlSignalEvents(signals);
+            continue;
+        }
         usbComTxSendByte(uart1RxReceiveByte());
     }
 
@@ -343,8 +505,6 @@ void usbToUartService()
     // Need to switch bits 0 and 1 so that DTR pairs up with DSR.
     signals = ioRxSignals();
     usbComTxControlSignals( ((signals & 1) ? 2 : 0) | ((signals & 2) ? 1 : 0));
-
-    // TODO: report framing, parity, and overrun errors to the USB host here
 }
 
 void main()
@@ -355,9 +515,15 @@ void main()
     ioTxSignals(0);
 
     usbInit();
+    usbComLineCodingChangeHandler = &usbLineCodingChangeHandler;
 
     uart1Init();
     uart1SetBaudRate(param_baud_rate);
+    if (param_flow_control)
+    {
+        uart1SetFlowControl(1);
+    }
+    uart1SetRxFrameGap(param_frame_gap_bits);
 
     if (param_serial_mode != SERIAL_MODE_USB_UART)
     {
@@ -365,9 +531,12 @@ void main()
         radioComInit();
     }
 
-    // Set up P1_5 to be the radio's TX debug signal.
-    P1DIR |= (1<<5);
-    IOCFG0 = 0b011011; // P1_5 = PA_PD (TX mode)
+    if (!param_flow_control)
+    {
+        // Set up P1_5 to be the radio's TX debug signal.
+        P1DIR |= (1<<5);
+        IOCFG0 = 0b011011; // P1_5 = PA_PD (TX mode)
+    }
 
     while(1)
     {
@@ -382,6 +551,7 @@ void main()
         }
 
         usbComService();
+        lineCodingService();
 
         switch(currentSerialMode)
         {
@@ -110,4 +110,7 @@ typedef struct ACM_LINE_CODING
  * */
 #define STOP_BITS_2     2
 
+/*! Disables the RS-485 driver enable pin.  See uart0SetDriverEnable(). */
+#define DRIVER_ENABLE_NONE  255
+
 #endif
@@ -9,9 +9,10 @@
 #define _DMA_H_
 
 #include <cc2511_map.h>
+#include <cc2511_types.h>
 
-/*! Initializes the DMA1CFGL and DMA1CFGH registers to point
- * to ::dmaConfig.
+/*! Initializes the DMA0CFG and DMA1CFG registers to point
+ * to ::dmaConfig0 and ::dmaConfig.
  *
  * This function is called by systemInit(). */
 void dmaInit(void);
@@ -29,13 +30,13 @@ typedef struct DMA14_CONFIG
      * radio packets. */
     volatile DMA_CONFIG radio;
 
-    /*! Config struct for DMA channel 2 (unassigned) */
+    /*! Config struct for DMA channel 2 (see dmaAllocateChannel()) */
     volatile DMA_CONFIG _2;
 
-    /*! Config struct for DMA channel 3 (unassigned) */
+    /*! Config struct for DMA channel 3 (see dmaAllocateChannel()) */
     volatile DMA_CONFIG _3;
 
-    /*! Config struct for DMA channel 4 (unassigned) */
+    /*! Config struct for DMA channel 4 (see dmaAllocateChannel()) */
     volatile DMA_CONFIG _4;
 } DMA14_CONFIG;
 
@@ -47,4 +48,47 @@ typedef struct DMA14_CONFIG
  (or systemInit()) for this struct to work. */
 extern DMA14_CONFIG XDATA dmaConfig;
 
+/*! This struct in XDATA holds the configuration options for
+ * DMA channel 0.  You must call dmaInit() (or systemInit()) for
+ * this struct to work. */
+extern volatile DMA_CONFIG XDATA dmaConfig0;
+
+/*! The value returned by dmaAllocateChannel() when there are no
+ * free DMA channels left. */
+#define DMA_CHANNEL_NONE  0xFF
+
+/*! Reserves one of the DMA channels that are not used for the radio
+ * (channels 2, 3, 4, and 0, in that order) so that different libraries
+ * can use DMA at the same time without interfering with each other.
+ * The channel stays reserved until the Wixel is reset.
+ *
+ * This function should only be called from the main loop, typically
+ * from the initialization function of a library.
+ *
+ * \return The number of the reserved channel, or #DMA_CHANNEL_NONE if
+ * all of them have already been reserved. */
+uint8 dmaAllocateChannel(void);
+
+/*! \return A pointer to the configuration struct of the specified DMA
+ * channel (0-4).
+ * \param channel The channel number, for example a value returned by
+ * dmaAllocateChannel(). */
+volatile DMA_CONFIG XDATA * dmaChannelConfig(uint8 channel);
+
+/*! Sets a function to be called from the DMA interrupt when the specified
+ * DMA channel finishes a transfer.  The interrupt is only generated if the
+ * IRQMASK bit is set in the channel's configuration (bit 3 of DC7).
+ *
+ * \param channel The channel number, for example a value returned by
+ *   dmaAllocateChannel().
+ * \param callback The function to call, or 0 to stop calling a function.
+ *
+ * This also enables the DMA interrupt.  The callback runs in the interrupt,
+ * so it should be short and it must not call any non-reentrant functions that
+ * the main loop also calls. */
+void dmaSetCallback(uint8 channel, void (*callback)(void));
+
+/*! The DMA interrupt, which calls the functions set with dmaSetCallback(). */
+ISR(DMA, 0);
+
 #endif
@@ -86,6 +86,10 @@ P1DIR = (P1DIR & MASK) | VALUE;
  * SDCC 3.0.0 (#6037) and it was found that an I/O line could be toggled once
  * every 3.2 microseconds by calling setDigitalOutput() several times in a row.
  *
+ * If the pin number is known when your code is compiled, you can use the
+ * macros in the \ref gpiomacros section instead, which compile
+ * to one or two instructions and do not call any functions.
+ *
  * \section caveats Caveats
  *
  * To use your digital I/O pins correctly, there are several things you should be aware of:
@@ -116,6 +120,7 @@ P1DIR = (P1DIR & MASK) | VALUE;
 #define _GPIO_H
 
 #include <cc2511_types.h>
+#include <cc2511_map.h>
 
 /*! Represents a low voltage, also known as GND or 0 V. */
 #define LOW   0
@@ -218,4 +223,173 @@ void setPort1PullType(BIT pullType) __reentrant;
  * functions declared in board.h. */
 void setPort2PullType(BIT pullType) __reentrant;
 
+/*! Reads the values of all the pins on Port 0, Port 1, and Port 2.
+ *
+ * \param values  A 3-byte array.  The values of P0, P1, and P2 are stored in
+ *   values[0], values[1], and values[2].
+ *
+ * The three ports are read by consecutive instructions, so this gives a
+ * consistent snapshot of the pins.  Bit N of each byte corresponds to pin
+ * N of that port; for example, <code>values[1] & (1<<4)</code> is the value of
+ * P1_4. */
+void readPorts(uint8 XDATA * values) __reentrant;
+
+/*! Sets the output values of several pins on the same port at once.
+ *
+ * \param port    The port: 0, 1, or 2.
+ * \param mask    The pins to change: bit N corresponds to pin N of the port.
+ * \param values  The new values of the pins in \a mask.  The other bits are
+ *   ignored.
+ *
+ * This only sets the output values; the pins should already be configured as
+ * outputs (e.g. with setDigitalOutput()).  The port is changed with two
+ * single-instruction operations (one that sets the pins that should be high,
+ * then one that clears the pins that should be low), so each pin changes at
+ * most once, the other pins are not affected, and it is safe to use
+ * this together with the other functions in this library in an interrupt. */
+void setPortOutputs(uint8 port, uint8 mask, uint8 values) __reentrant;
+
+/*! The port and bit mask of one pin in a pin map, which is an array that
+ * assigns the bits of a 16-bit number to pins.  A pin map lets you read or
+ * write up to 16 pins on any of the ports with one call to pinMapRead()
+ * or pinMapWrite(), without going through the pin numbers each time.
+ * Use pinMapInit() to fill it in. */
+typedef struct GPIO_PIN_MAP
+{
+    uint8 port;
+    uint8 mask;
+} GPIO_PIN_MAP;
+
+/*! Fills in a pin map.
+ *
+ * \param map         An array of \a count entries to fill in.
+ * \param pinNumbers  The pin numbers (see the table above) of the entries.
+ *   This can point to any kind of memory (e.g. CODE or XDATA).
+ * \param count       The number of pins, between 0 and 16. */
+void pinMapInit(GPIO_PIN_MAP XDATA * map, const uint8 * pinNumbers, uint8 count) __reentrant;
+
+/*! Reads the pins in a pin map.
+ *
+ * \return A number whose bit N is the value of the pin in map[N].
+ *
+ * The ports are read once, at the beginning (see readPorts()), so the values
+ * of all the pins are from the same moment. */
+uint16 pinMapRead(const GPIO_PIN_MAP XDATA * map, uint8 count) __reentrant;
+
+/*! Sets the output values of the pins in a pin map.
+ *
+ * \param map     The pin map.
+ * \param count   The number of entries in the pin map.
+ * \param mask    The entries to change: bit N corresponds to map[N].
+ * \param values  The new values: bit N is the new value of the pin in map[N].
+ *
+ * The new values of all three ports are computed first, and then they are
+ * written with six ORL/ANL operations in a row (see setPortOutputs()), so the
+ * pins change within about a microsecond of each other.  The pins should already be configured
+ * as outputs. */
+void pinMapWrite(const GPIO_PIN_MAP XDATA * map, uint8 count, uint16 mask, uint16 values) __reentrant;
+
+/*! \page gpiomacros Compile-time pin macros
+ *
+ * The macros below do the same things as the functions in gpio.h, but the
+ * pin number must be a constant: an integer literal from the table in gpio.h
+ * (e.g. 12), or a macro that expands to one.  The pin is resolved by the
+ * preprocessor, so each macro compiles to single-bit SFR instructions (SETB,
+ * CLR, MOV C, JB/JNB, ORL, and ANL) without a function call or a switch
+ * statement.  Using a pin number that is not in the table gives a compiler
+ * error.  For pin numbers that are only known at run time, use the functions.
+ *
+ * Approximate costs, counted from the generated instructions at 24 MHz (one
+ * cycle is 41.7 ns):
+ *
+ * <table>
+ * <tr><th>Operation</th><th>Function</th><th>Macro</th></tr>
+ * <tr><td>Set an output</td><td>setDigitalOutput(): about 77 cycles (3.2 us, measured)</td>
+ *   <td>GPIO_SET_DIGITAL_OUTPUT(): 2 instructions, about 5 cycles<br/>
+ *   GPIO_SET_PIN(): 1 instruction, about 2 cycles</td></tr>
+ * <tr><td>Make an input</td><td>setDigitalInput(): similar to setDigitalOutput()</td>
+ *   <td>GPIO_SET_DIGITAL_INPUT(): 2 instructions, about 6 cycles<br/>
+ *   GPIO_MAKE_INPUT(): 1 instruction, about 3 cycles</td></tr>
+ * <tr><td>Read a pin</td><td>isPinHigh(): similar to setDigitalOutput()</td>
+ *   <td>GPIO_IS_PIN_HIGH(): 1 instruction (usually a JB or JNB), about 3 cycles</td></tr>
+ * </table>
+ *
+ * Like the functions, these macros only change single bits with single
+ * instructions, so they are safe to use in interrupts (see \ref interrupts).
+ *
+ * Example:
+\code
+#define LATCH_PIN 17
+GPIO_SET_DIGITAL_OUTPUT(LATCH_PIN, LOW);
+GPIO_SET_PIN(LATCH_PIN, 1);
+GPIO_SET_PIN(LATCH_PIN, 0);
+\endcode
+ */
+
+/*! Same as setDigitalOutput(), for a constant pin number.
+ * See \ref gpiomacros. */
+#define GPIO_SET_DIGITAL_OUTPUT(pinNumber, value) GPIO_APPLY1(GPIO_SET_DIGITAL_OUTPUT_PB, GPIO_PB(pinNumber), value)
+
+/*! Same as setDigitalInput(), for a constant pin number.  \a pulled must be
+ * #HIGH_IMPEDANCE, #PULLED, 0, or 1.  See \ref gpiomacros. */
+#define GPIO_SET_DIGITAL_INPUT(pinNumber, pulled) GPIO_APPLY1(GPIO_SET_DIGITAL_INPUT_PB, GPIO_PB(pinNumber), pulled)
+
+/*! Same as isPinHigh(), for a constant pin number.  See \ref gpiomacros. */
+#define GPIO_IS_PIN_HIGH(pinNumber) GPIO_APPLY0(GPIO_IS_PIN_HIGH_PB, GPIO_PB(pinNumber))
+
+/*! Sets the output value of a pin that is already an output, without
+ * changing its direction.  See \ref gpiomacros. */
+#define GPIO_SET_PIN(pinNumber, value) GPIO_APPLY1(GPIO_SET_PIN_PB, GPIO_PB(pinNumber), value)
+
+/*! Makes a pin an output, without changing its output value.  Together with
+ * GPIO_MAKE_INPUT() and an output value of 0, this can be used to drive an
+ * open-drain line such as I<sup>2</sup>C or 1-Wire.  See \ref gpiomacros. */
+#define GPIO_MAKE_OUTPUT(pinNumber) GPIO_APPLY0(GPIO_MAKE_OUTPUT_PB, GPIO_PB(pinNumber))
+
+/*! Makes a pin an input, without changing its pull-up/pull-down setting.
+ * See \ref gpiomacros. */
+#define GPIO_MAKE_INPUT(pinNumber) GPIO_APPLY0(GPIO_MAKE_INPUT_PB, GPIO_PB(pinNumber))
+
+/*! \cond */
+// GPIO_PB(12) expands to "1,2": the port and the bit of the pin.
+#define GPIO_PB(pinNumber) GPIO_PB_(pinNumber)
+#define GPIO_PB_(pinNumber) GPIO_PIN_##pinNumber
+#define GPIO_PIN_0 0,0
+#define GPIO_PIN_1 0,1
+#define GPIO_PIN_2 0,2
+#define GPIO_PIN_3 0,3
+#define GPIO_PIN_4 0,4
+#define GPIO_PIN_5 0,5
+#define GPIO_PIN_10 1,0
+#define GPIO_PIN_11 1,1
+#define GPIO_PIN_12 1,2
+#define GPIO_PIN_13 1,3
+#define GPIO_PIN_14 1,4
+#define GPIO_PIN_15 1,5
+#define GPIO_PIN_16 1,6
+#define GPIO_PIN_17 1,7
+#define GPIO_PIN_20 2,0
+#define GPIO_PIN_21 2,1
+#define GPIO_PIN_22 2,2
+#define GPIO_PIN_23 2,3
+#define GPIO_PIN_24 2,4
+
+// These expand the port/bit pair into two arguments.
+#define GPIO_APPLY0(macro, pb) macro(pb)
+#define GPIO_APPLY1(macro, pb, arg) macro(pb, arg)
+
+#define GPIO_SET_DIGITAL_OUTPUT_PB(port, bit, value) { P##port##_##bit = (value); P##port##DIR |= (1<<bit); }
+#define GPIO_SET_DIGITAL_INPUT_PB(port, bit, pulled) { P##port##INP GPIO_INP_OP(pulled) (1<<bit); P##port##DIR &= ~(1<<bit); }
+#define GPIO_IS_PIN_HIGH_PB(port, bit) (P##port##_##bit)
+#define GPIO_SET_PIN_PB(port, bit, value) { P##port##_##bit = (value); }
+#define GPIO_MAKE_OUTPUT_PB(port, bit) { P##port##DIR |= (1<<bit); }
+#define GPIO_MAKE_INPUT_PB(port, bit) { P##port##DIR &= ~(1<<bit); }
+
+// PxINP bit 1 means no pull-up or pull-down resistor.
+#define GPIO_INP_OP(pulled) GPIO_INP_OP_(pulled)
+#define GPIO_INP_OP_(pulled) GPIO_INP_OP_##pulled
+#define GPIO_INP_OP_0 |=
+#define GPIO_INP_OP_1 &= ~
+/*! \endcond */
+
 #endif
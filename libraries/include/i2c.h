@@ -6,13 +6,84 @@
  *
  * By default, the SCL pin is assigned to P1_0, the SDA pin is
  * assigned to P1_1, and the bus frequency is 100 kHz with a 10 ms timeout.
+ *
+ * The bus is driven by the Timer 3 interrupt, which performs one half-period
+ * of the SCL clock each time it runs, so transactions can be done in the
+ * background (see i2cQueueTransaction()) while the main loop keeps running.
+ * The blocking functions (i2cStart(), i2cWriteByte(), etc.) use the same
+ * interrupt and wait for it to finish.  Timer 3 is stopped whenever the bus is
+ * idle, but it can not be used for anything else while this library is in use.
+ *
+ * Each interrupt takes a few microseconds, so at 100 kHz the interrupt uses
+ * most of the CPU time during a transaction, and higher frequencies are limited
+ * by the speed of the interrupt rather than by i2cSetFrequency().  If the main
+ * loop needs to keep running quickly during long transactions (for example to
+ * service USB), use a lower frequency.
+ *
+ * The Timer 3 interrupt is in interrupt priority group 3, which it shares with
+ * the USART1 RX and TX interrupts, and this library does not change the
+ * priority of that group.  The group is at the lowest priority (0) by default,
+ * but uart1Init() and spi1MasterInit() raise it to priority 1, so when UART1 or
+ * SPI1 is in use the Timer 3 interrupt runs at priority 1 too: it can then
+ * interrupt the handlers at priority 0, and it can not interrupt the USART1
+ * handlers or be interrupted by them.  Either way, interrupts at a higher
+ * priority can delay it.  This only stretches the SCL clock, which
+ * I<sup>2</sup>C allows.
+ *
+ * Since this library uses an interrupt, you must include i2c.h in the source
+ * file that contains your main() function.
  */
 
 #ifndef _I2C_H
 #define _I2C_H
 
+#include <cc2511_map.h>
 #include <cc2511_types.h>
 
+/*! The transaction is waiting in the queue. */
+#define I2C_TRANSACTION_QUEUED  0
+/*! The transaction is on the bus. */
+#define I2C_TRANSACTION_ACTIVE  1
+/*! The transaction is done, and every byte was acknowledged by the slave. */
+#define I2C_TRANSACTION_DONE    2
+/*! The transaction is done, but the slave did not acknowledge its address,
+ * so the transaction was stopped early. */
+#define I2C_TRANSACTION_NACK_ADDRESS 3
+/*! The transaction is done, but the slave did not acknowledge one of the bytes
+ * written to it, so the transaction was stopped early. */
+#define I2C_TRANSACTION_NACK    4
+/*! The transaction is done, but it was aborted because SCL was held low for
+ * longer than the timeout (see i2cSetTimeout()). */
+#define I2C_TRANSACTION_TIMEOUT 5
+
+/*! Describes one transaction for the I<sup>2</sup>C transaction queue (see
+ * i2cQueueTransaction()).  The memory for each transaction belongs to the
+ * application and must stay valid until the transaction is done. */
+typedef struct I2C_TRANSACTION
+{
+    /*! Used by the library to link the transactions in the queue. */
+    struct I2C_TRANSACTION XDATA * next;
+
+    /*! The 7-bit address of the slave. */
+    uint8 address;
+
+    /*! The bytes to write to the slave. */
+    const uint8 XDATA * writeBuffer;
+
+    /*! The number of bytes to write. */
+    uint8 writeLength;
+
+    /*! Where to store the bytes read from the slave. */
+    uint8 XDATA * readBuffer;
+
+    /*! The number of bytes to read. */
+    uint8 readLength;
+
+    /*! One of the I2C_TRANSACTION_* values.  Set by the library.  The
+     * transaction is done when this is #I2C_TRANSACTION_DONE or higher. */
+    volatile uint8 status;
+} I2C_TRANSACTION;
+
 /*! Number of the pin to use as the SCL (clock) line of the I<sup>2</sup>C bus.
  * See the gpio.h documentation for pin number values.
  */
@@ -32,7 +103,18 @@ extern BIT i2cTimeoutOccurred;
 
 /*! Sets the I<sup>2</sup>C bus clock frequency. This implementation limits the
  * range of possible frequencies to 2-500 kHz; because of rounding inaccuracies and timing constraints, the actual frequency might be lower than
- * the selected frequency, but it is guaranteed never to be higher. The default
+ * the selected frequency, but it is guaranteed never to be higher.  In
+ * particular, the speed of the Timer 3 interrupt limits the actual frequency to
+ * roughly 100 kHz.
+ *
+ * If the frequency is 400 kHz or more, the blocking functions (i2cStart(),
+ * i2cStop(), i2cWriteByte(), and i2cReadByte()) use a fast path that does not
+ * use the interrupt and runs the bus at 400 kHz (fast mode), with the timing
+ * of each edge set by DELAY_CYCLES().  The fast path only works on the pins
+ * chosen when the library was compiled (P1_0 for SCL and P1_1 for SDA by
+ * default; see libraries/src/i2c/lib_options.mk); with other pins, or for
+ * transactions in the queue, the Timer 3 interrupt is used instead.
+ * Interrupts that occur during the fast path stretch the SCL clock. The default
  * frequency is 100 kHz. Common I<sup>2</sup>C speeds are 10 kHz (low speed),
  * 100 kHz (standard), and 400 kHz (high speed).
  *
@@ -48,7 +130,74 @@ void i2cSetFrequency(uint16 freqKHz);
  */
 void i2cSetTimeout(uint16 timeoutMs);
 
+/*! Adds a transaction to the end of the transaction queue.
+ *
+ * \param transaction The transaction.  Its I2C_TRANSACTION::next and
+ *   I2C_TRANSACTION::status fields are set by this function, and all the other
+ *   fields must be filled in before calling it.
+ *
+ * The transactions in the queue are done one after another, in the
+ * background.  For each transaction, the library generates a START condition
+ * and sends the address with the write bit.  Then it writes
+ * I2C_TRANSACTION::writeLength bytes.  If I2C_TRANSACTION::readLength is not 0,
+ * it generates a repeated START, sends the address with the read bit, and
+ * reads I2C_TRANSACTION::readLength bytes, sending a NACK after the last one.
+ * Finally it generates a STOP condition.  If writeLength is 0, the write part
+ * is skipped; if both lengths are 0, the library just checks whether the slave
+ * acknowledges its address.
+ *
+ * You can watch I2C_TRANSACTION::status to see when a transaction is done.
+ * i2cBusy() returns 1 until the queue is empty.  The blocking functions
+ * (i2cStart(), etc.) wait for the queue to be empty before they do anything.
+ * Do not add transactions to the queue between an i2cStart() and an i2cStop().
+ * This function must not be called from an interrupt. */
+void i2cQueueTransaction(I2C_TRANSACTION XDATA * transaction);
+
+/*! \return 1 if the library is doing something on the bus or there are
+ * transactions in the queue, 0 otherwise. */
+BIT i2cBusy(void);
+
+/*! Does a complete transaction on the bus and waits for it to finish.
+ * This does the same thing as a queued transaction (see i2cQueueTransaction()):
+ * a write of \a writeLength bytes, then a repeated START and a read of
+ * \a readLength bytes, with a STOP at the end.  Either part can be skipped by
+ * making its length 0.
+ *
+ * \param address      The 7-bit address of the slave.
+ * \param writeBuffer  The bytes to write.
+ * \param writeLength  The number of bytes to write.
+ * \param readBuffer   Where to store the bytes read.
+ * \param readLength   The number of bytes to read.
+ *
+ * \return #I2C_TRANSACTION_DONE if the transaction succeeded, or
+ *   #I2C_TRANSACTION_NACK_ADDRESS, #I2C_TRANSACTION_NACK, or
+ *   #I2C_TRANSACTION_TIMEOUT.
+ *
+ * At 400 kHz this uses the fast path described in i2cSetFrequency(), so the
+ * whole transaction is done without any per-byte function calls from your
+ * code.  Like the other blocking functions, this must not be called from an
+ * interrupt, or between an i2cStart() and an i2cStop(). */
+uint8 i2cTransfer(uint8 address, const uint8 XDATA * writeBuffer, uint8 writeLength,
+    uint8 XDATA * readBuffer, uint8 readLength);
+
+/*! Finds the slaves on the bus by checking whether each address from 0x08 to
+ * 0x77 is acknowledged (the other addresses are reserved).
+ *
+ * \param found  A 16-byte array.  For each address that was acknowledged,
+ *   bit <code>address % 8</code> of <code>found[address / 8]</code> is set to 1.
+ *   All the other bits are set to 0.
+ *
+ * \return The number of addresses that were acknowledged.
+ *
+ * Each address takes about 11 clock cycles on the bus (about 30 us at 400 kHz).
+ * If a timeout occurs, the scan stops early. */
+uint8 i2cScan(uint8 XDATA * found);
+
 /*! Generates an I<sup>2</sup>C START condition.
+ *
+ * This function and the other blocking functions below wait for the Timer 3
+ * interrupt, so they must not be called from an interrupt or while interrupts
+ * are disabled.
  */
 void i2cStart(void);
 
@@ -79,4 +228,7 @@ BIT i2cWriteByte(uint8 byte);
  */
 uint8 i2cReadByte(BIT nack);
 
+/*! The Timer 3 interrupt, which drives the bus. */
+ISR(T3, 0);
+
 #endif
@@ -0,0 +1,140 @@
+/*! \file pin_change.h
+ * The <code>pin_change.lib</code> library uses the Port 0, Port 1, and Port 2
+ * interrupts of the CC2511 to detect changes on GPIO pins as soon as they
+ * happen, instead of waiting for the main loop to read the pins.
+ * Every change is recorded in a queue, along with the time when it was
+ * detected, and your main loop can read the changes from the queue with
+ * pinChangeCurrentEvent() and pinChangeDoneWithEvent().
+ *
+ * To use this library, configure the pins as inputs (see gpio.h) and then call
+ * pinChangeEnable() for each pin you want to watch.  The pins are specified
+ * with the same pin numbers that gpio.lib uses (e.g. 13 for P1_3).
+ *
+ * \section edges Edges
+ *
+ * For each pin, you can choose whether to record rising edges, falling edges,
+ * or both.  However, the CC2511 can only detect one kind of edge at a time on
+ * each port, so the library has to choose which edge the hardware will detect
+ * on each port:
+ * - If all of the pins you are watching on a port record rising edges, or all
+ *   of them record falling edges, the hardware detects every change that you
+ *   care about.
+ * - A pin that records both edges can only be watched by the hardware if it is
+ *   the only pin on its port that needs a particular edge: the library
+ *   switches the port's edge after every change, so that the next edge will be
+ *   detected.
+ * - If the pins on one port need different edges at the same time, the
+ *   library alternates between them and some changes will not be detected by
+ *   the hardware.
+ *
+ * The pins are also compared to their last recorded values whenever a port
+ * interrupt runs and whenever pinChangeCurrentEvent() is called and the queue is
+ * empty, so a change that the hardware does not detect will still be recorded
+ * later, as long as your main loop calls pinChangeCurrentEvent() regularly.
+ *
+ * \section debouncing Debouncing
+ *
+ * Mechanical switches usually bounce, producing several edges every time they
+ * change.  If you set #pinChangeDebounceMs, then a change on a pin is recorded
+ * immediately, but the other changes on that pin for the next
+ * #pinChangeDebounceMs milliseconds are ignored.  When that time has passed,
+ * the pin is checked again so that its final state will be recorded.
+ *
+ * \section usb USB and interrupts
+ *
+ * This library defines the ISRs for the Port 0, Port 1, and Port 2
+ * interrupts, so you must include pin_change.h in the source file that
+ * contains your main() function, and you can not define those ISRs yourself.
+ *
+ * The Port 0 interrupt is also used to wake up from USB suspend mode (see
+ * usbSleep()), so the Port 0 ISR clears #usbSuspendMode when it sees the
+ * USB_RESUME flag, as described in usb.h.  The Port 2 ISR only handles the
+ * flags of pins P2_0 through P2_4.
+ *
+ * The ISRs run at the default interrupt priority, which is the same priority
+ * as the Timer 4 interrupt used by getMs().  If you raise the priority of
+ * the port interrupts, the timestamps of the events might be wrong.
+ */
+
+#ifndef _PIN_CHANGE_H
+#define _PIN_CHANGE_H
+
+#include <cc2511_map.h>
+#include <cc2511_types.h>
+
+/*! Record rising edges (the pin changing from low to high). */
+#define PIN_CHANGE_RISING  1
+
+/*! Record falling edges (the pin changing from high to low). */
+#define PIN_CHANGE_FALLING 2
+
+/*! Record both rising and falling edges. */
+#define PIN_CHANGE_BOTH    (PIN_CHANGE_RISING | PIN_CHANGE_FALLING)
+
+/*! The number of events that can be stored in the queue.  Events that happen
+ * while the queue is full are dropped and counted in #pinChangeDropCount.
+ * This must be a power of 2. */
+#define PIN_CHANGE_QUEUE_SIZE 16
+
+/*! Describes a change on one pin. */
+typedef struct PIN_CHANGE_EVENT
+{
+    /*! The number of the pin that changed (e.g. 13 for P1_3). */
+    uint8 pin;
+
+    /*! The value of the pin after the change: 1 for a rising edge, 0 for a
+     * falling edge. */
+    uint8 value;
+
+    /*! The lower 16 bits of getMs() when the change was detected. */
+    uint16 timeMs;
+
+    /*! The value of Timer 4's counter when the change was detected.  This
+     * counts from 0 to 187 during each millisecond, so each tick is 16/3
+     * microseconds, and it can be used to compare the times of events that
+     * happened during the same millisecond. */
+    uint8 ticks;
+} PIN_CHANGE_EVENT;
+
+/*! The number of milliseconds after a recorded change during which further
+ * changes on the same pin are ignored.  The default value is 0, which
+ * disables debouncing.  See the \ref debouncing section. */
+extern uint8 pinChangeDebounceMs;
+
+/*! The number of events that were dropped because the queue was full. */
+extern volatile uint16 pinChangeDropCount;
+
+/*! Starts watching a pin for changes.
+ *
+ * \param pinNumber The number of the pin (see the pinNumber parameter
+ *   section of gpio.h).  Pins P0_0 through P0_7, P1_0 through P1_7, and P2_0
+ *   through P2_4 are supported.
+ * \param edges Which changes to record: #PIN_CHANGE_RISING,
+ *   #PIN_CHANGE_FALLING, or #PIN_CHANGE_BOTH.
+ *
+ * The current value of the pin is taken as its starting value, so no event
+ * is recorded for it.  This function enables the port interrupts that it
+ * needs, but interrupts must also be globally enabled (see timeInit()). */
+void pinChangeEnable(uint8 pinNumber, uint8 edges);
+
+/*! Stops watching a pin.  Events for the pin that are already in the queue
+ * are not removed. */
+void pinChangeDisable(uint8 pinNumber);
+
+/*! \return A pointer to the oldest event in the queue, or 0 if the queue is
+ * empty.  When you are done reading the event, call pinChangeDoneWithEvent().
+ *
+ * If the queue is empty, this function checks the pins before returning, so
+ * that changes which the hardware could not detect are recorded (see the
+ * \ref edges section). */
+PIN_CHANGE_EVENT XDATA * pinChangeCurrentEvent(void);
+
+/*! Removes the oldest event from the queue so that you can advance to
+ * processing the next one. */
+void pinChangeDoneWithEvent(void);
+
+ISR(P0INT, 0);
+ISR(P1INT, 0);
+ISR(P2INT, 0);
+
+#endif
@@ -20,12 +20,18 @@
  *
  * This library also supports sending 8 control signals to the other Wixel
  * and receiving 8 control signals from the other Wixel.
+ * The control signals are sent in the urgent lane of <code>radio_link.lib</code>,
+ * so a change in the control signals does not have to wait for the data bytes
+ * that are already queued to be sent.  This means that the other Wixel might
+ * receive the new control signals before it receives some of the data bytes
+ * that were sent before them.
  */
 
 #ifndef _RADIO_COM_H_
 #define _RADIO_COM_H_
 
 #include <radio_link.h>
+#include <com.h>
 
 /*! Initializes the <code>radio_com.lib</code> library and the
  * lower-level libraries that it depends on.
@@ -87,6 +93,19 @@ uint8 radioComTxAvailable(void);
  * If you call this function, you must also call radioComTxService() regularly. */
 void radioComTxSendByte(uint8 byte);
 
+/*! Sends the bytes that have been added to the TX buffer but not sent yet,
+ * even if they do not fill a whole packet.  The next byte added will start a
+ * new packet.
+ *
+ * You do not normally need to call this, because radioComTxService() sends
+ * partially-filled packets when the radio is not busy.  It is useful if
+ * your data consists of messages that should not be split across packets:
+ * call this after adding each message.
+ *
+ * This requires radioComTxAvailable() to have returned a non-zero value
+ * since the last byte was added. */
+void radioComTxFlush(void);
+
 /*! \param controlSignals The state of the eight virtual TX control signals.
  *   Each bit represents a different control signal.
  *
@@ -100,6 +119,63 @@ void radioComTxSendByte(uint8 byte);
  * signals) is determined by higher-level code. */
 void radioComTxControlSignals(uint8 controlSignals);
 
+/*! Sends events to the other Wixel, in order with the data.
+ *
+ * \param signalEvents A non-zero byte where each bit represents a
+ *   different event.
+ *
+ * Unlike the control signals, which are sent as soon as possible, events are
+ * sent after all the bytes that were added to the TX buffer before this
+ * function was called, so the other Wixel will receive them at the same
+ * position in the data stream.  Until the events have been queued for
+ * transmission, radioComTxAvailable() returns 0.  If you call this function
+ * several times before the events are sent, the events are combined with a
+ * bitwise OR.
+ *
+ * The meaning of the events (e.g. the ACM_SERIAL_STATE_* bits from com.h)
+ * is determined by higher-level code.
+ *
+ * If you call this function, the code on the other Wixel must call
+ * radioComRxControlSignalEvents() regularly, or else it will stop receiving
+ * data when the events arrive. */
+void radioComTxControlSignalEvents(uint8 signalEvents);
+
+/*! \return The events received from the other Wixel (see
+ * radioComTxControlSignalEvents()) that happened before the next byte that
+ * radioComRxReceiveByte() would return, or 0 if there are none.
+ * Each event is only returned once.
+ *
+ * When events are received, radioComRxAvailable() returns 0 until this
+ * function is called, so that you can handle the events at the right
+ * position in the data stream. */
+uint8 radioComRxControlSignalEvents(void);
+
+/*! Sends serial port settings (baud rate, parity, and stop bits) to the other
+ * Wixel, in order with the data.
+ *
+ * \param lineCoding A pointer to the settings, for example #usbComLineCoding.
+ *   The settings are copied, so the pointer does not have to remain valid.
+ *
+ * Like events (see radioComTxControlSignalEvents()), the settings are sent
+ * after the bytes that were already added to the TX buffer, and
+ * radioComTxAvailable() returns 0 until they are queued.  If the other Wixel
+ * is reset, the last settings are sent to it again.
+ *
+ * If you call this function, the code on the other Wixel must call
+ * radioComRxLineCoding() regularly, or else it will stop receiving data when
+ * the settings arrive. */
+void radioComTxLineCoding(const ACM_LINE_CODING XDATA * lineCoding);
+
+/*! \return A pointer to the serial port settings sent by the other Wixel
+ * with radioComTxLineCoding(), or 0 if no new settings have arrived since the
+ * last call.
+ *
+ * When new settings are received, radioComRxAvailable() returns 0 until this
+ * function is called, so the settings apply to all the bytes returned by
+ * radioComRxReceiveByte() after that.  The pointer remains valid until the
+ * next call to this function. */
+ACM_LINE_CODING XDATA * radioComRxLineCoding(void);
+
 /*! \return The state of the eight virtual RX control signals.
  *   Each bit represents a different control signal.
  *
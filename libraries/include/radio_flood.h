@@ -0,0 +1,110 @@
+/*! \file radio_flood.h
+ * The <code>radio_flood.lib</code> library extends the range of
+ * <code>radio_queue.lib</code> by having every Wixel rebroadcast (relay) the
+ * packets it hears, so a packet can reach Wixels that are several hops away
+ * from its source.
+ *
+ * Each packet carries the ID of the Wixel that created it, a sequence number,
+ * and a time-to-live (TTL) count.  Every Wixel remembers the source ID and
+ * sequence number of the last #RADIO_FLOOD_CACHE_SIZE packets it has seen and
+ * ignores any copies of those packets that it hears later, so each Wixel
+ * delivers and relays each packet at most once.
+ * A packet is relayed only if its TTL is more than 1, and the TTL is
+ * decremented each time it is relayed.
+ * Relays happen after a random delay so that neighbors that heard the same
+ * packet do not all rebroadcast it at the same time.
+ *
+ * This library depends on <code>radio_queue.lib</code>, and it uses all of
+ * the packets sent and received by that library, so you should not call the
+ * radioQueue* functions directly, and #radioQueueAggregation and
+ * #radioQueueAddressing must be 0.
+ *
+ * This library does not use any interrupts of its own, but the lower-level
+ * libraries do, so you must include radio_flood.h in the source file that
+ * contains your main() function.
+ */
+
+#ifndef _RADIO_FLOOD_H
+#define _RADIO_FLOOD_H
+
+#include <cc2511_types.h>
+#include <radio_queue.h>
+
+/*! Each packet can contain at most 15 bytes of payload, because the library
+ * uses 4 bytes of each radio_queue packet for its header. */
+#define RADIO_FLOOD_PAYLOAD_SIZE (RADIO_QUEUE_PAYLOAD_SIZE - 4)
+
+/*! The number of recently-seen packets that each Wixel remembers in order
+ * to detect duplicates. */
+#define RADIO_FLOOD_CACHE_SIZE 16
+
+/*! The ID of this Wixel, which is put in every packet it creates.
+ * If this is 0 when radioFloodInit() is called, radioFloodInit() sets it to
+ * the first two bytes of the serial number (or 1 if they are both 0).
+ * Every Wixel in the network must have a different ID: packets from two
+ * Wixels with the same ID would be mistaken for duplicates and dropped. */
+extern uint16 radioFloodId;
+
+/*! The TTL given to the packets created by this Wixel.  A packet with a TTL of
+ * N can travel at most N hops from its source.
+ * The default value is 3. */
+extern uint8 radioFloodTtl;
+
+/*! If this bit is 0, this Wixel will deliver packets to the higher-level
+ * code but will not relay them.
+ * The default value is 1. */
+extern BIT radioFloodRelayEnabled;
+
+/*! Before relaying a packet, the library waits for 1 + R milliseconds, where
+ * R is a random number between 0 and #radioFloodRelayDelayMask.
+ * This should be one less than a power of two.  The default value is 15. */
+extern uint8 radioFloodRelayDelayMask;
+
+/*! The number of packets this Wixel has relayed. */
+extern uint16 radioFloodRelayedCount;
+
+/*! The number of duplicate packets received (packets that were already
+ * received or relayed by this Wixel, including copies of its own packets). */
+extern uint16 radioFloodDuplicateCount;
+
+/*! The number of packets that should have been relayed, but were not
+ * because there were too many relays waiting. */
+extern uint16 radioFloodRelayDropCount;
+
+/*! Initializes the library and the lower-level libraries that it depends on.
+ * This calls radioQueueInit(), so you do not have to. */
+void radioFloodInit(void);
+
+/*! This function must be called regularly.  It checks the packets received
+ * by radio_queue for duplicates and sends the relays that are due. */
+void radioFloodService(void);
+
+/*! \return A pointer to the current TX packet, or 0 if no packet is available.
+ *
+ * This works like radioQueueTxCurrentPacket(): write the length of the
+ * payload (which must not exceed #RADIO_FLOOD_PAYLOAD_SIZE) to offset 0, write
+ * the data starting at offset 1, and then call radioFloodTxSendPacket().
+ *
+ * The relays use the same TX buffers, so you must call radioFloodTxSendPacket()
+ * before calling radioFloodService() again. */
+uint8 XDATA * radioFloodTxCurrentPacket(void);
+
+/*! Sends the current TX packet to all the Wixels in the network. */
+void radioFloodTxSendPacket(void);
+
+/*! \return A pointer to the current RX packet, or 0 if no packet is available.
+ *
+ * The RX packet has the same format as the TX packet.  When you are done
+ * reading it, call radioFloodRxDoneWithPacket(). */
+uint8 XDATA * radioFloodRxCurrentPacket(void);
+
+/*! \return The ID of the Wixel that created the current RX packet.
+ * This should only be called if radioFloodRxCurrentPacket() recently returned a
+ * non-zero pointer. */
+uint16 radioFloodRxCurrentSource(void);
+
+/*! Frees the current RX packet so that you can advance to processing the
+ * next one. */
+void radioFloodRxDoneWithPacket(void);
+
+#endif
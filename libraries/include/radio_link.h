@@ -16,6 +16,15 @@
  * different times then the regular data, you would need to replace this library with
  * something more complicated that keeps track of different streams and schedules them.
  *
+ * The TX queue does have two priority lanes, though: the normal (bulk) lane and the
+ * urgent lane.  A few packet buffers are reserved for the urgent lane, and any packet
+ * queued in the urgent lane is sent before the packets waiting in the bulk lane,
+ * so it only has to wait for the packet that is currently being sent.
+ * Packets in the same lane are always delivered in the order they were queued,
+ * but an urgent packet can be delivered before bulk packets that were queued
+ * earlier.  The urgent lane is meant for small, latency-critical packets such
+ * as control signals; see radioLinkTxUrgentCurrentPacket().
+ *
  * This library depends on <code>radio_mac.lib</code>, which uses an interrupt.
  * For this library to work, you must write
  * <code>include <radio_link.h></code>
@@ -141,6 +150,36 @@ uint8 XDATA * radioLinkTxCurrentPacket(void);
  * */
 void radioLinkTxSendPacket(uint8 payloadType);
 
+/*! \return The number of urgent TX packet buffers that are currently free
+ * (available to hold data).
+ *
+ * These buffers are separate from the ones counted by radioLinkTxAvailable(),
+ * so filling up the bulk lane does not prevent urgent packets from being queued. */
+uint8 radioLinkTxUrgentAvailable(void);
+
+/*! \return The number of urgent TX packet buffers that are currently busy
+ * (holding a data packet that has not been successfully sent yet). */
+uint8 radioLinkTxUrgentQueued(void);
+
+/*! \return A pointer to the current urgent TX packet, or 0 if no urgent packet
+ * buffer is available.
+ *
+ * This works just like radioLinkTxCurrentPacket(), except that the packet
+ * will be put in the urgent lane when you call radioLinkTxUrgentSendPacket().
+ * Packets in the urgent lane are sent before any packets in the bulk lane,
+ * but the packet that is currently being sent is always allowed to finish first.
+ *
+ * This function has no side effects.
+ */
+uint8 XDATA * radioLinkTxUrgentCurrentPacket(void);
+
+/*! Sends the current urgent TX packet.  See the documentation of
+ * radioLinkTxUrgentCurrentPacket() for details.
+ *
+ * \param payloadType A number between 0 and RADIO_LINK_MAX_PACKET_TYPE that
+ * will be attached to the packet. */
+void radioLinkTxUrgentSendPacket(uint8 payloadType);
+
 /*! \return A pointer to the current RX packet.
  *   This is the earliest packet received from the other Wixel
  *   which has not yet been processed yet by higher-level code.
@@ -0,0 +1,136 @@
+/*! \file radio_link_msg.h
+ * The <code>radio_msg.lib</code> library lets you send and receive messages
+ * that are larger than a single radio packet.
+ * Each message is split into several fragments which are sent as separate
+ * packets, and the fragments are put back together on the receiving side.
+ *
+ * There are two versions of this library with the same API:
+ * - The radioLinkMsg* functions, documented here, send the fragments using
+ *   <code>radio_link.lib</code> (see radio_link.h).
+ * - The radioQueueMsg* functions, declared in radio_queue_msg.h, send the
+ *   fragments using <code>radio_queue.lib</code> (see radio_queue.h).
+ *   These functions and variables do exactly the same thing as the ones
+ *   documented here, except that their names begin with "radioQueueMsg".
+ *
+ * Since <code>radio_link.lib</code> is reliable, a message sent with
+ * radioLinkMsgTxSendMessage() will eventually arrive unless the other Wixel
+ * stops receiving.
+ * <code>radio_queue.lib</code> is not reliable, so if any fragment of a
+ * message is lost the whole message is discarded on the receiving side.
+ * Several Wixels can send messages to the same receiver on the same channel
+ * with the queue version; the receiver can reassemble up to
+ * #RADIO_MSG_RX_MESSAGE_COUNT messages at the same time.
+ *
+ * Received messages are reassembled directly in a pool of XDATA buffers and
+ * the higher-level code reads them from there, so the payload is not copied
+ * again after it is taken out of the radio packet.
+ *
+ * Every fragment carries a two-byte header, so each packet holds
+ * #RADIO_LINK_MSG_FRAGMENT_SIZE bytes of message data.
+ * With the queue version, the header also contains two bytes of the sender's
+ * serial number so that messages from different Wixels are never mixed up,
+ * and each packet holds #RADIO_QUEUE_MSG_FRAGMENT_SIZE bytes of message data.
+ *
+ * This library takes over the lower-level library's packets completely, so it
+ * can not be used at the same time as <code>radio_com.lib</code>, and any
+ * packet not sent by this library will be discarded.
+ *
+ * This library does not use any interrupts of its own, but the lower-level
+ * libraries do, so you must include radio_link_msg.h (or radio_queue_msg.h)
+ * in the source file that contains your main() function.
+ */
+
+#ifndef _RADIO_LINK_MSG_H
+#define _RADIO_LINK_MSG_H
+
+#include <cc2511_types.h>
+#include <radio_link.h>
+
+/*! The maximum length of a message, in bytes. */
+#define RADIO_MSG_MAX_SIZE 300
+
+/*! The number of messages that can be reassembled at the same time.
+ * This includes the messages that have been completely received but not yet
+ * processed by the higher-level code. */
+#define RADIO_MSG_RX_MESSAGE_COUNT 2
+
+/*! The number of message data bytes that fit in one radio_link packet. */
+#define RADIO_LINK_MSG_FRAGMENT_SIZE (RADIO_LINK_PAYLOAD_SIZE - 2)
+
+/*! Initializes the library and the lower-level libraries that it depends on.
+ * This calls radioLinkInit(), so you do not have to. */
+void radioLinkMsgInit(void);
+
+/*! This function must be called regularly.
+ * It sends the fragments of the current TX message when there is room in the
+ * lower-level TX queue, reassembles the fragments that have been received,
+ * and discards incomplete messages that have timed out. */
+void radioLinkMsgService(void);
+
+/*! \return A pointer to the buffer of the current TX message, or 0 if the
+ * previous message is still being sent.
+ *
+ * To send a message, write up to #RADIO_MSG_MAX_SIZE bytes to this buffer
+ * and then call radioLinkMsgTxSendMessage().
+ * Example usage:
+\code
+uint8 XDATA * message = radioLinkMsgTxCurrentMessage();
+if (message != 0)
+{
+    uint16 i;
+    for (i = 0; i < 100; i++)
+    {
+        message[i] = i;
+    }
+    radioLinkMsgTxSendMessage(100);
+}
+\endcode
+ *
+ * This function has no side effects. */
+uint8 XDATA * radioLinkMsgTxCurrentMessage(void);
+
+/*! Sends the current TX message.  See radioLinkMsgTxCurrentMessage().
+ *
+ * \param length The length of the message in bytes.  Must not exceed
+ *   #RADIO_MSG_MAX_SIZE.
+ *
+ * The message is sent in the background by radioLinkMsgService(). */
+void radioLinkMsgTxSendMessage(uint16 length);
+
+/*! \return A pointer to the current RX message, or 0 if no complete message
+ * has been received.
+ *
+ * The data starts at offset 0 of the returned buffer and its length is given
+ * by radioLinkMsgRxCurrentLength().  Messages are returned in the order in
+ * which they were completed.
+ * When you are done reading the message, call radioLinkMsgRxDoneWithMessage()
+ * so the buffer can be used to reassemble another message.
+ *
+ * This function has no side effects. */
+uint8 XDATA * radioLinkMsgRxCurrentMessage(void);
+
+/*! \return The length of the current RX message in bytes.
+ *
+ * This should only be called if radioLinkMsgRxCurrentMessage() recently
+ * returned a non-zero pointer; otherwise it returns 0. */
+uint16 radioLinkMsgRxCurrentLength(void);
+
+/*! Frees the current RX message.  See radioLinkMsgRxCurrentMessage().
+ * This does nothing if there is no complete RX message. */
+void radioLinkMsgRxDoneWithMessage(void);
+
+/*! The number of milliseconds the library waits for the next fragment of a
+ * message before discarding the incomplete message.
+ * The default value is 100. */
+extern uint16 radioLinkMsgRxTimeout;
+
+/*! The number of incomplete messages that have been discarded.
+ * A message is discarded if one of its fragments was lost, if it took
+ * too long to arrive (see #radioLinkMsgRxTimeout), if it was too long, or if
+ * all the RX message buffers were busy when its first fragment arrived.
+ * Fragments that belong to a message whose first fragment was never received
+ * are discarded without being counted.
+ * Higher-level code may read and clear this variable. */
+extern uint16 radioLinkMsgRxDropCount;
+
+#endif
@@ -31,6 +31,119 @@ extern int32 CODE param_radio_channel;
  */
 extern BIT radioQueueAllowCrcErrors;
 
+/*! The maximum number of packets that will be transmitted back-to-back
+ * before the library stops to listen for incoming packets.
+ * The default value is 1, which means the library listens after every packet.
+ *
+ * Setting this to a higher value lets a single transmitter send queued packets
+ * much faster, because the radio goes straight from one transmission to the next.
+ * This is useful for one-way telemetry where no other Wixel transmits on the
+ * channel; if other Wixels need to transmit, long bursts will increase the
+ * chance that their packets collide with ours. */
+extern uint8 radioQueueTxBurstSize;
+
+/*! After transmitting a packet (or a burst of packets, see
+ * #radioQueueTxBurstSize), the library listens for incoming packets for
+ * (#radioQueueTxListenTime + R) units of 0.922 ms before transmitting again,
+ * where R is a random number between 0 and #radioQueueTxBackoffMask.
+ * The default value is 1.
+ *
+ * If the resulting time is 0, the library listens for one unit instead. */
+extern uint8 radioQueueTxListenTime;
+
+/*! A bit mask applied to a random number to compute the random part of the
+ * listening time (see #radioQueueTxListenTime).
+ * Random delays help avoid repeated collisions between Wixels that transmit
+ * at the same time.
+ * This should be one less than a power of two.  The default value is 3. */
+extern uint8 radioQueueTxBackoffMask;
+
+/*! If this variable is set to 1, several small messages can be sent in a
+ * single RF packet (aggregate frame), which reduces the time spent on the air
+ * sending preambles and sync words when messages are sent at a high rate.
+ * This variable has a value of 0 by default.
+ *
+ * When aggregation is enabled, you use radioQueueTxCurrentPacket(),
+ * radioQueueTxSendPacket(), radioQueueRxCurrentPacket(), and
+ * radioQueueRxDoneWithPacket() the same way as before, but each "packet" is
+ * a message in an aggregate frame:
+ * - The payload of each message must not exceed
+ *   RADIO_QUEUE_PAYLOAD_SIZE - 1 bytes.  Longer messages are truncated by
+ *   radioQueueTxSendPacket().
+ * - Messages are held for up to #radioQueueTxAggregationWindow milliseconds
+ *   so that other messages can be added to the same frame, and
+ *   radioQueueTxService() must be called regularly to send the frames whose
+ *   window has expired.
+ * - The receiver splits each frame back into the original messages.
+ *   The bytes after the end of a received message are the next message in
+ *   the frame, not the RSSI and LQI bytes that the radio appends to each RF
+ *   packet, so you should call radioRssi() and radioLqi() (which describe the
+ *   last RF packet received) if you need to know the signal strength.
+ *
+ * All of the Wixels on the channel must use the same setting for this
+ * variable, because the format of the RF packets is different. */
+extern BIT radioQueueAggregation;
+
+/*! When #radioQueueAggregation is 1, this is the maximum number of milliseconds
+ * that a message will be held before being sent, waiting for other messages to
+ * be added to the same RF packet.
+ * The default value is 2. */
+extern uint8 radioQueueTxAggregationWindow;
+
+/*! The address used for broadcast packets when #radioQueueAddressing is 1.
+ * It can not be used as the address of a Wixel. */
+#define RADIO_QUEUE_BROADCAST_ADDRESS 0
+
+/*! When #radioQueueAddressing is 1, each packet can contain at most 16 bytes
+ * of payload because of the 3-byte address header. */
+#define RADIO_QUEUE_ADDRESSED_PAYLOAD_SIZE (RADIO_QUEUE_PAYLOAD_SIZE - 3)
+
+/*! If this variable is set to 1, every packet carries a destination and a
+ * source address, and you can send acknowledged unicast packets with
+ * radioQueueTxSendPacketTo().
+ * This variable has a value of 0 by default.
+ *
+ * When addressing is enabled:
+ * - The payload of each packet must not exceed
+ *   #RADIO_QUEUE_ADDRESSED_PAYLOAD_SIZE bytes.
+ * - radioQueueTxSendPacket() sends the packet to all Wixels on the channel
+ *   (#RADIO_QUEUE_BROADCAST_ADDRESS), without an acknowledgment.
+ * - radioQueueTxSendPacketTo() sends the packet to one Wixel.  The packet stays
+ *   at the head of the TX queue until the destination acknowledges it, or until
+ *   it has been retransmitted #radioQueueTxRetries times.
+ * - Packets addressed to other Wixels are discarded, and
+ *   radioQueueRxCurrentSource() tells you who sent each packet you receive.
+ *
+ * All of the Wixels on the channel must use the same setting for this variable,
+ * because the format of the RF packets is different.
+ * This cannot be used together with #radioQueueAggregation: if both are 1,
+ * radioQueueInit() sets #radioQueueAggregation to 0.
+ * This variable should be set before calling radioQueueInit(). */
+extern BIT radioQueueAddressing;
+
+/*! The address of this Wixel, used when #radioQueueAddressing is 1.
+ * Valid addresses are 1 to 255.
+ * If this is still #RADIO_QUEUE_BROADCAST_ADDRESS when radioQueueInit() is
+ * called, radioQueueInit() sets it to the first byte of the serial number
+ * (or 1 if that byte is 0).  To choose the address yourself, set this
+ * variable before calling radioQueueInit(). */
+extern uint8 radioQueueAddress;
+
+/*! The number of times a unicast packet will be retransmitted if it is not
+ * acknowledged.  The default value is 3. */
+extern uint8 radioQueueTxRetries;
+
+/*! The time to wait for an acknowledgment after sending a unicast packet,
+ * in units of 0.922 ms.  The default value is 2.
+ * If another packet arrives during that time, the wait starts over, and only a
+ * wait that ends without receiving any packet counts as a failed attempt. */
+extern uint8 radioQueueAckTimeout;
+
+/*! The number of unicast packets that were dropped because they were not
+ * acknowledged after all the retries.  This is incremented in an interrupt and
+ * wraps around from 255 to 0.  Higher-level code may read and clear it. */
+extern volatile uint8 radioQueueTxNoAckCount;
+
 /*! Initializes the radio_queue library and the lower-level
  *  libraries that radio_queue depends on.  This must be called before
  *  any other functions in the library. */
@@ -75,6 +188,22 @@ uint8 XDATA * radioQueueTxCurrentPacket(void);
  */
 void radioQueueTxSendPacket(void);
 
+/*! Sends the current TX packet to a single Wixel and requests an
+ * acknowledgment.  This can only be used if #radioQueueAddressing is 1.
+ * See the documentation of radioQueueTxCurrentPacket() for details.
+ *
+ * \param address The address of the destination Wixel.  If this is
+ *   #RADIO_QUEUE_BROADCAST_ADDRESS, the packet is broadcast without an
+ *   acknowledgment, just like with radioQueueTxSendPacket().
+ */
+void radioQueueTxSendPacketTo(uint8 address);
+
+/*! Sends the aggregate frame that is being built if its aggregation window
+ * has expired.
+ * This function must be called regularly if #radioQueueAggregation is 1,
+ * and it does nothing otherwise. */
+void radioQueueTxService(void);
+
 /*! Returns a pointer to the current RX packet (the earliest packet received
  * by radio_queue which has not been processed yet by higher-level code).
  * Returns 0 if there is no RX packet available.
@@ -85,6 +214,12 @@ void radioQueueTxSendPacket(void);
  */
 uint8 XDATA * radioQueueRxCurrentPacket(void);  // returns 0 if no packet is available.
 
+/*! \return The address of the Wixel that sent the current RX packet.
+ *
+ * This can only be used if #radioQueueAddressing is 1, and should only be
+ * called if radioQueueRxCurrentPacket() recently returned a non-zero pointer. */
+uint8 radioQueueRxCurrentSource(void);
+
 /*! Frees the current RX packet so that you can advance to processing
  * the next one.  See the radioQueueRxCurrentPacket() documentation for details. */
 void radioQueueRxDoneWithPacket(void);
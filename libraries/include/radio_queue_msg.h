@@ -0,0 +1,28 @@
+/** \file radio_queue_msg.h
+ * For information about these functions, see radio_link_msg.h.
+ * These functions/variables do exactly the same thing as the functions
+ * in radio_link_msg.h, except they use radio_queue.lib instead of
+ * radio_link.lib to send the fragments.
+ */
+
+#ifndef _RADIO_QUEUE_MSG_H
+#define _RADIO_QUEUE_MSG_H
+
+#include <cc2511_types.h>
+#include <radio_queue.h>
+
+#define RADIO_MSG_MAX_SIZE 300
+#define RADIO_MSG_RX_MESSAGE_COUNT 2
+#define RADIO_QUEUE_MSG_FRAGMENT_SIZE (RADIO_QUEUE_PAYLOAD_SIZE - 4)
+
+void radioQueueMsgInit(void);
+void radioQueueMsgService(void);
+uint8 XDATA * radioQueueMsgTxCurrentMessage(void);
+void radioQueueMsgTxSendMessage(uint16 length);
+uint8 XDATA * radioQueueMsgRxCurrentMessage(void);
+uint16 radioQueueMsgRxCurrentLength(void);
+void radioQueueMsgRxDoneWithMessage(void);
+extern uint16 radioQueueMsgRxTimeout;
+extern uint16 radioQueueMsgRxDropCount;
+
+#endif
@@ -0,0 +1,131 @@
+/*! \file radio_tree.h
+ * The <code>radio_tree.lib</code> library collects data from many Wixels at
+ * a single Wixel called the sink (typically the one connected to a computer
+ * over USB), using a routing tree so that Wixels that are out of range of the
+ * sink can send their data through other Wixels.
+ *
+ * Every Wixel periodically broadcasts a beacon containing its cost: an
+ * estimate of how expensive it is to send a packet from that Wixel to the
+ * sink.  The sink's cost is 0.  Every other Wixel chooses as its parent the
+ * neighbor that minimizes the neighbor's cost plus the cost of the link to
+ * that neighbor.  The link cost is 1, plus a penalty if the neighbor's beacons
+ * arrive with a low signal strength (radioRssi()) or link quality (radioLqi()),
+ * plus the number of recent packets that the neighbor failed to acknowledge.
+ * To avoid switching back and forth between two similar parents, a Wixel only
+ * changes parents if the new route is cheaper by at least 2, or if the current
+ * parent stops working.
+ *
+ * Data packets are sent to the parent as acknowledged unicast packets (see
+ * radioQueueTxSendPacketTo()), and each Wixel forwards the data packets it
+ * receives to its own parent, until they reach the sink.
+ * A Wixel never chooses a neighbor whose parent is itself, and each data packet
+ * carries the cost of the Wixel that sent it: since costs decrease along the
+ * route, a data packet that arrives from a Wixel whose cost is not higher than
+ * ours indicates a routing loop, so we send a beacon right away to let the
+ * other Wixels fix their routes.  Data packets that travel more than
+ * #RADIO_TREE_MAX_HOPS hops are dropped.
+ *
+ * This library depends on <code>radio_queue.lib</code> with
+ * #radioQueueAddressing enabled, and it uses all of the packets sent and
+ * received by that library, so you should not call the radioQueue* functions
+ * directly (except to configure radio_queue before calling radioTreeInit()).
+ *
+ * This library does not use any interrupts of its own, but the lower-level
+ * libraries do, so you must include radio_tree.h in the source file that
+ * contains your main() function.
+ */
+
+#ifndef _RADIO_TREE_H
+#define _RADIO_TREE_H
+
+#include <cc2511_types.h>
+#include <radio_queue.h>
+
+/*! Each data packet can contain at most 13 bytes of payload, because the
+ * library uses 3 bytes of each radio_queue packet for its header. */
+#define RADIO_TREE_PAYLOAD_SIZE (RADIO_QUEUE_ADDRESSED_PAYLOAD_SIZE - 3)
+
+/*! Data packets that have been forwarded this many times are dropped. */
+#define RADIO_TREE_MAX_HOPS 15
+
+/*! The cost of a Wixel that has no route to the sink. */
+#define RADIO_TREE_NO_ROUTE 255
+
+/*! Set this bit to 1 before calling radioTreeInit() on the Wixel that
+ * should receive all the data (the root of the tree).
+ * The default value is 0. */
+extern BIT radioTreeSink;
+
+/*! The number of milliseconds between beacons.  The default value is 1000.
+ * A neighbor is forgotten if none of its beacons are received for four times
+ * this period, so all the Wixels in the network should use the same value. */
+extern uint16 radioTreeBeaconInterval;
+
+/*! The number of data packets forwarded by this Wixel. */
+extern uint16 radioTreeForwardedCount;
+
+/*! The number of data packets that this Wixel dropped because it had no
+ * route to the sink or because they travelled too many hops. */
+extern uint16 radioTreeDropCount;
+
+/*! The number of times this Wixel detected a possible routing loop. */
+extern uint16 radioTreeLoopCount;
+
+/*! The number of times this Wixel has changed its parent. */
+extern uint16 radioTreeParentChangeCount;
+
+/*! Initializes the library and the lower-level libraries that it depends on.
+ * This enables #radioQueueAddressing and calls radioQueueInit(), so you
+ * do not have to. */
+void radioTreeInit(void);
+
+/*! This function must be called regularly.  It sends beacons, processes
+ * the beacons received from neighbors, chooses the parent, and forwards data
+ * packets toward the sink. */
+void radioTreeService(void);
+
+/*! \return 1 if this Wixel is the sink or has a parent. */
+BIT radioTreeConnected(void);
+
+/*! \return The address (see #radioQueueAddress) of the parent, or 0 if this
+ * Wixel has no parent. */
+uint8 radioTreeParent(void);
+
+/*! \return The current cost of the route from this Wixel to the sink, or
+ * #RADIO_TREE_NO_ROUTE if there is no route. */
+uint8 radioTreeCost(void);
+
+/*! \return A pointer to the current TX data packet, or 0 if no packet is
+ * available (for example, because this Wixel does not have a route to the sink).
+ *
+ * This works like radioQueueTxCurrentPacket(): write the length of the
+ * payload (which must not exceed #RADIO_TREE_PAYLOAD_SIZE) to offset 0, write
+ * the data starting at offset 1, and then call radioTreeTxSendPacket().
+ *
+ * The beacons and forwarded packets use the same TX buffers, so you must call
+ * radioTreeTxSendPacket() before calling radioTreeService() again.
+ *
+ * This should not be used on the sink. */
+uint8 XDATA * radioTreeTxCurrentPacket(void);
+
+/*! Sends the current TX data packet to the sink, through the parent. */
+void radioTreeTxSendPacket(void);
+
+/*! \return A pointer to the current data packet received by the sink, or 0
+ * if no packet is available.  The packet has the same format as the TX packet.
+ *
+ * This only returns packets on the sink: other Wixels forward the data packets
+ * they receive.  When you are done reading the packet, call
+ * radioTreeRxDoneWithPacket(). */
+uint8 XDATA * radioTreeRxCurrentPacket(void);
+
+/*! \return The address of the Wixel that created the current RX data packet.
+ * This should only be called if radioTreeRxCurrentPacket() recently returned a
+ * non-zero pointer. */
+uint8 radioTreeRxCurrentOrigin(void);
+
+/*! Frees the current RX data packet so that you can advance to processing the
+ * next one. */
+void radioTreeRxDoneWithPacket(void);
+
+#endif
@@ -1,10 +1,13 @@
 /*! \file spi.h
- * This file defines constants used in spi0_master.h and spi1_master.h.
+ * This file defines constants and types used in spi0_master.h, spi1_master.h,
+ * spi0_slave.h, and spi1_slave.h.
  */
 
 #ifndef _SPI_H
 #define _SPI_H
 
+#include <cc2511_types.h>
+
 /*! The SCK line will be low when no data is being transferred. */
 #define SPI_POLARITY_IDLE_LOW   0
 /*! The SCK line will be high when no data is being transferred. */
@@ -21,5 +24,58 @@
 /*! The least-significant bit is transmitted first. */
 #define SPI_BIT_ORDER_LSB_FIRST 1
 
+/*! Use this in spi0SlaveSetSignalPins() for a signal that is not used. */
+#define SPI_SLAVE_PIN_NONE 255
+
+/*! The value of SPI_TRANSACTION::csPin for a transaction that does not use a
+ * chip select pin. */
+#define SPI_CS_NONE 255
+
+/*! The transaction is waiting in the queue. */
+#define SPI_TRANSACTION_QUEUED  0
+/*! The transaction is being transferred. */
+#define SPI_TRANSACTION_ACTIVE  1
+/*! The transaction is done. */
+#define SPI_TRANSACTION_DONE    2
+
+/*! Describes one transfer for the SPI master transaction queue (see
+ * spi0MasterQueueTransaction()).  The memory for each transaction belongs to
+ * the application and must stay valid until the transaction is done. */
+typedef struct SPI_TRANSACTION
+{
+    /*! Used by the library to link the transactions in the queue. */
+    struct SPI_TRANSACTION XDATA * next;
+
+    /*! The bytes to send. */
+    const uint8 XDATA * txBuffer;
+
+    /*! Where to store the bytes received.  This may be equal to txBuffer. */
+    uint8 XDATA * rxBuffer;
+
+    /*! The number of bytes to transfer.  Must not be 0. */
+    uint16 size;
+
+    /*! The chip select pin of the slave, numbered as in gpio.h (e.g. 12 for
+     * P1_2), or #SPI_CS_NONE.  It must be on Port 0 or Port 1.  The library
+     * drives it low during the transaction. */
+    uint8 csPin;
+
+    /*! The clock polarity, clock phase, bit order, and clock exponent, as they
+     * will be written to UxGCR.  Set this with spi0MasterTransactionFormat(). */
+    uint8 gcr;
+
+    /*! The clock mantissa, as it will be written to UxBAUD.  Set this with
+     * spi0MasterTransactionFormat(). */
+    uint8 baud;
+
+    /*! A function to call when the transaction is done, or 0.  It is called
+     * from an interrupt, so it should be short, and it must not call any of the
+     * functions in this library. */
+    void (*callback)(struct SPI_TRANSACTION XDATA * transaction);
+
+    /*! #SPI_TRANSACTION_QUEUED, #SPI_TRANSACTION_ACTIVE, or
+     * #SPI_TRANSACTION_DONE.  Set by the library. */
+    volatile uint8 status;
+} SPI_TRANSACTION;
 
 #endif /* SPI_H_ */
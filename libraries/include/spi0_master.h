@@ -30,6 +30,9 @@
  *
  * Please note that this library only supports SPI <em>master</em>
  * communication; MOSI and SCK are outputs and MISO is an input.
+ *
+ * If you set #spi0MasterDmaEnabled to 1 before calling spi0MasterInit(),
+ * large transfers are done with DMA instead of an interrupt per byte.
  */
 
 #ifndef _SPI0_MASTER_H
@@ -39,6 +42,23 @@
 #include <cc2511_types.h>
 #include <spi.h>
 
+/*! Set this to 1 before calling spi0MasterInit() to do transfers of 8 bytes
+ * or more with DMA instead of using an interrupt for each byte.
+ * The default value is 0.
+ *
+ * In DMA mode, spi0MasterInit() reserves two DMA channels with
+ * dmaAllocateChannel().  If not enough channels are free, all the transfers
+ * use the interrupt.
+ *
+ * With the interrupt, the library only starts sending each byte after the
+ * previous one has been received and the interrupt has run, so there is a gap
+ * of a few microseconds between bytes.  With DMA, the next byte is always
+ * waiting in the USART's buffer, so the bytes are sent back to back and the
+ * CPU is free during the transfer.  At 3 MHz, that is 375,000 bytes per second,
+ * or about 1.4 ms for a 512-byte SD card block.  Shorter transfers use the
+ * interrupt because setting up the DMA takes longer than they do. */
+extern BIT spi0MasterDmaEnabled;
+
 /*! Initializes the library.
  *
  * This must be called before any other functions with names that
@@ -95,16 +115,21 @@ void spi0MasterSetClockPhase(BIT phase);
  * - #SPI_BIT_ORDER_LSB_FIRST: The least-significant bit is transmitted first. */
 void spi0MasterSetBitOrder(BIT bitOrder);
 
-/*! \return 1 if the library is busy transferring of data, 0 if it
+/*! \return 1 if the library is busy transferring of data or there are
+    transactions in the queue (see spi0MasterQueueTransaction()), 0 if it
     is not busy.
 
-    This is equivalent to <code>spi0MasterBytesLeft() != 0</code>
+    Apart from the queue, this is equivalent to <code>spi0MasterBytesLeft() != 0</code>
     but it is faster and doesn't affect the speed of the transfer. */
 BIT spi0MasterBusy(void);
 
 /*! \return The number of bytes left to transfer in the current transfer.
  *     If 0, it means there is no current transfer.
  *
+ *  For transfers done with DMA (see #spi0MasterDmaEnabled), the library can
+ *  not tell how far the transfer has gotten, so this returns the size of the
+ *  transfer until it is done, and then 0.
+ *
  *  This function temporarily disables the interrupt used by this library
  *  to transfer data, so calling this function frequently could reduce the
  *  speed that data is transferred.
@@ -112,8 +137,8 @@ BIT spi0MasterBusy(void);
 uint16 spi0MasterBytesLeft(void);
 
 /*! Starts a new transfer of data.
- * The transfer will be carried out in the background by interrupts, allowing
- * other tasks to be performed simultaneously.
+ * The transfer will be carried out in the background by interrupts or DMA,
+ * allowing other tasks to be performed simultaneously.
  * This is a non-blocking function.
  *
  * \param txBuffer A pointer to a buffer holding the bytes to be sent to the SPI slave.
@@ -153,6 +178,43 @@ spi0MasterSendByte(0xFF)
 */
 uint8 spi0MasterReceiveByte(void);
 
+/*! Fills in the SPI_TRANSACTION::gcr and SPI_TRANSACTION::baud fields of a
+ * transaction, which set the format of the SPI communication while that
+ * transaction is transferred.
+ *
+ * \param transaction The transaction.
+ * \param freq The frequency of SCK, as in spi0MasterSetFrequency().
+ * \param polarity The clock polarity, as in spi0MasterSetClockPolarity().
+ * \param phase The clock phase, as in spi0MasterSetClockPhase().
+ * \param bitOrder The bit order, as in spi0MasterSetBitOrder().
+ *
+ * If several transactions use the same slave, you can call this once and
+ * copy the two fields. */
+void spi0MasterTransactionFormat(SPI_TRANSACTION XDATA * transaction, uint32 freq, BIT polarity, BIT phase, BIT bitOrder);
+
+/*! Adds a transaction to the end of the transaction queue.
+ *
+ * \param transaction The transaction.  Its SPI_TRANSACTION::next and
+ *   SPI_TRANSACTION::status fields are set by this function, and all the other
+ *   fields must be filled in before calling it (see SPI_TRANSACTION and
+ *   spi0MasterTransactionFormat()).
+ *
+ * The transactions in the queue are done one after another, in the
+ * background.  For each transaction, the library sets the SPI format, drives
+ * the chip select pin low, transfers the bytes (with DMA if possible, see
+ * #spi0MasterDmaEnabled), drives the chip select pin high, and then calls the
+ * callback.  The next transaction is started by the interrupt that finished
+ * the previous one, so the main loop does not have to wait for each
+ * transfer, and slaves on different chip select pins can share the bus.
+ *
+ * The first time a chip select pin is used, this function makes it an output
+ * that is high.  You can watch SPI_TRANSACTION::status to see when a
+ * transaction is done, or use the callback.  spi0MasterBusy() returns 1 until
+ * the queue is empty.  Do not call spi0MasterTransfer() or
+ * spi0MasterSendByte() while the queue is busy.  This function must not be
+ * called from an interrupt, including the callbacks. */
+void spi0MasterQueueTransaction(SPI_TRANSACTION XDATA * transaction);
+
 /*! A prototype for the USART0 interrupt. */
 ISR(URX0, 0);
 
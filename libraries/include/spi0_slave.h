@@ -0,0 +1,139 @@
+/*! \file spi0_slave.h
+ *
+ * The <code>spi_slave.lib</code> library allows the Wixel to be an SPI
+ * <em>slave</em> on USART0 and/or USART1, for example so that another
+ * microcontroller (the master) can use the Wixel as a radio coprocessor.
+ *
+ * To use this library, you must include spi0_slave.h or spi1_slave.h
+ * in your app:
+\code
+#include <spi0_slave.h>
+#include <spi1_slave.h>
+\endcode
+ *
+ * The API for using USART1 is the same as the API for using USART0 that is
+ * documented here, except all the function and variable names begin with
+ * "spi1Slave" instead of "spi0Slave".
+ *
+ * For USART0, this library uses Alternative Location 1: P0_4 is SSN (slave
+ * select, active low), P0_5 is SCK, P0_3 is MOSI, and P0_2 is MISO.
+ *
+ * For USART1, this library uses Alternative Location 2: P1_4 is SSN, P1_5 is
+ * SCK, P1_6 is MOSI, and P1_7 is MISO.
+ *
+ * \section frames Frames
+ *
+ * The data is exchanged in frames.  Every SPI transaction (the time while SSN
+ * is low) must transfer exactly one frame, which is 33 bytes long by default.
+ * You can change the size when building the library by setting
+ * SPI0_SLAVE_FRAME_SIZE or SPI1_SLAVE_FRAME_SIZE in
+ * libraries/src/spi_slave/lib_options.mk.  The first byte of a frame is the
+ * number of payload bytes (at most spi0SlaveMaxPayloadSize()), and the
+ * payload follows it; the rest of the frame is ignored.  During each
+ * transaction, the master sends a frame to the Wixel and the Wixel sends a
+ * frame to the master at the same time.  Either frame can have a length of 0
+ * if its sender has nothing to say.
+ *
+ * The bytes are transferred by two DMA channels, so the master can use any
+ * clock frequency the USART supports (up to 3 MHz) and the CPU does not do
+ * any work until a whole frame has been received.  The RX side has two frame
+ * buffers, so the master can send a frame while the app is reading the
+ * previous one.
+ *
+ * \section signals Signals
+ *
+ * Two optional output pins tell the master when to start a transaction
+ * (see spi0SlaveSetSignalPins()):
+ * - The ready pin is high while the Wixel is ready for a frame.  It goes low
+ *   at the end of each frame while the library prepares for the next one
+ *   (a few microseconds), and stays low while both RX frame buffers are full.
+ *   The master should check that it is high before each transaction, waiting
+ *   at least 20 us after the end of the previous transaction.
+ * - The IRQ pin is low while the Wixel has a frame with a payload waiting for
+ *   the master, so the master knows it should start a transaction even if it
+ *   has nothing to send.
+ *
+ * If the master ends a transaction early, the frame is discarded the next time
+ * spi0SlaveService() is called.
+ *
+ * This library uses two DMA channels (reserved by spi0SlaveInit()) and the DMA
+ * interrupt, but no interrupts of its own.
+ */
+
+#ifndef _SPI0_SLAVE_H
+#define _SPI0_SLAVE_H
+
+#include <cc2511_map.h>
+#include <cc2511_types.h>
+#include <dma.h>
+#include <spi.h>
+
+/*! The number of frames that were discarded because they were cut short or
+ * had an invalid length byte. */
+extern uint16 spi0SlaveRxDropCount;
+
+/*! Initializes the library and starts waiting for a frame from the master.
+ *
+ * This must be called before any other functions with names that
+ * begin with "spi0Slave".  It reserves two DMA channels with
+ * dmaAllocateChannel(); if there are not enough free channels, it does
+ * nothing.
+ *
+ * After calling this, you should call spi0SlaveSetClockPolarity(),
+ * spi0SlaveSetClockPhase(), and spi0SlaveSetBitOrder() to match the master.
+ */
+void spi0SlaveInit(void);
+
+/*! Sets the clock polarity.  See spi0MasterSetClockPolarity(). */
+void spi0SlaveSetClockPolarity(BIT polarity);
+
+/*! Sets the clock phase.  See spi0MasterSetClockPhase(). */
+void spi0SlaveSetClockPhase(BIT phase);
+
+/*! Sets the bit order.  See spi0MasterSetBitOrder(). */
+void spi0SlaveSetBitOrder(BIT bitOrder);
+
+/*! Sets up the ready and IRQ pins described above.
+ *
+ * \param readyPin The ready pin, numbered as in gpio.h (e.g. 12 for P1_2),
+ *   or #SPI_SLAVE_PIN_NONE.
+ * \param irqPin The IRQ pin, or #SPI_SLAVE_PIN_NONE.
+ *
+ * The pins must be on Port 0 or Port 1 and must not be used by the USART.
+ * This function makes them outputs. */
+void spi0SlaveSetSignalPins(uint8 readyPin, uint8 irqPin);
+
+/*! Checks whether the master ended a transaction before the end of the
+ * frame, and if so, discards the partial frame so that the next transaction
+ * starts a new frame.  You should call this regularly; it is also called
+ * by spi0SlaveRxCurrentFrame(). */
+void spi0SlaveService(void);
+
+/*! \return The maximum number of payload bytes in a frame, which is one less
+ * than the frame size. */
+uint8 spi0SlaveMaxPayloadSize(void);
+
+/*! \return A pointer to the TX frame buffer, or 0 if the previous frame has
+ * not been given to the DMA yet.
+ *
+ * Write the payload length (at most spi0SlaveMaxPayloadSize()) to offset 0
+ * and the payload starting at offset 1, and then call spi0SlaveTxSendFrame().
+ */
+uint8 XDATA * spi0SlaveTxCurrentFrame(void);
+
+/*! Sends the TX frame to the master in the next transaction.
+ * If no transaction is going on, the frame is loaded right away and the IRQ
+ * pin goes low. */
+void spi0SlaveTxSendFrame(void);
+
+/*! \return A pointer to the oldest frame received from the master, or 0 if
+ * there is none.  The payload length is at offset 0 and the payload starts at
+ * offset 1.  When you are done with the frame, call spi0SlaveRxDoneWithFrame().
+ */
+uint8 XDATA * spi0SlaveRxCurrentFrame(void);
+
+/*! Frees the current RX frame so that the library can use its buffer for a
+ * new frame. */
+void spi0SlaveRxDoneWithFrame(void);
+
+#endif /* SPI0_SLAVE_H_ */
@@ -11,6 +11,7 @@
 #include <cc2511_types.h>
 #include <spi.h>
 
+extern BIT spi1MasterDmaEnabled;
 void spi1MasterInit(void);
 void spi1MasterSetFrequency(uint32 freq);
 void spi1MasterSetClockPolarity(BIT polarity);
@@ -21,6 +22,8 @@ uint16 spi1MasterBytesLeft(void);
 void spi1MasterTransfer(const uint8 XDATA * txBuffer, uint8 XDATA * rxBuffer, uint16 size);
 uint8 spi1MasterSendByte(uint8 XDATA byte);
 uint8 spi1MasterReceiveByte(void);
+void spi1MasterTransactionFormat(SPI_TRANSACTION XDATA * transaction, uint32 freq, BIT polarity, BIT phase, BIT bitOrder);
+void spi1MasterQueueTransaction(SPI_TRANSACTION XDATA * transaction);
 
 ISR(URX1, 0);
 
@@ -0,0 +1,28 @@
+/*! \file spi1_slave.h
+ * For information about these functions, see spi0_slave.h.
+ * These functions do exactly the same thing as the functions
+ * in spi0_slave.h, except they apply to USART1 instead of USART0.
+ */
+
+#ifndef _SPI1_SLAVE_H
+#define _SPI1_SLAVE_H
+
+#include <cc2511_map.h>
+#include <cc2511_types.h>
+#include <dma.h>
+#include <spi.h>
+
+extern uint16 spi1SlaveRxDropCount;
+void spi1SlaveInit(void);
+void spi1SlaveSetClockPolarity(BIT polarity);
+void spi1SlaveSetClockPhase(BIT phase);
+void spi1SlaveSetBitOrder(BIT bitOrder);
+void spi1SlaveSetSignalPins(uint8 readyPin, uint8 irqPin);
+void spi1SlaveService(void);
+uint8 spi1SlaveMaxPayloadSize(void);
+uint8 XDATA * spi1SlaveTxCurrentFrame(void);
+void spi1SlaveTxSendFrame(void);
+uint8 XDATA * spi1SlaveRxCurrentFrame(void);
+void spi1SlaveRxDoneWithFrame(void);
+
+#endif /* SPI1_SLAVE_H_ */
@@ -33,8 +33,72 @@ void timeInit();
  * was called. */
 uint32 getMs();
 
+/*! Returns the number of milliseconds that have elapsed since timeInit()
+ * was called, like getMs(), but for use in interrupt service routines.
+ *
+ * Do not call getMs() from an ISR: it disables the Timer 4 interrupt and then
+ * restores it, so an ISR that calls it while the main loop is in the middle of
+ * getMs() could leave the Timer 4 interrupt disabled.  This function does not
+ * change T4IE.  It relies on the fact that the Timer 4 interrupt can not run
+ * while the calling ISR is running, which is true unless you have given the
+ * Timer 4 interrupt a higher priority than that ISR.  It can also be called
+ * from the main loop while T4IE is 0.
+ *
+ * \param ticks  The value of T4CNT, which you should read just before calling
+ *   this function.  If Timer 4 overflowed after your ISR started, its interrupt
+ *   has not counted the new millisecond yet; this function counts it if
+ *   <b>ticks</b> was read after the overflow, so that the millisecond count
+ *   and <b>ticks</b> agree with each other.
+ *
+ * Example:
+ * <pre>uint8 ticks = T4CNT;
+uint32 ms = getMsFromIsr(ticks);</pre> */
+uint32 getMsFromIsr(uint8 ticks);
+
+/*! The value returned by timeAllocateAlarm() when all of the alarms have
+ * already been reserved. */
+#define TIME_ALARM_NONE  0xFF
+
+/*! The number of alarms that timeAllocateAlarm() can give out. */
+#define TIME_ALARM_COUNT 2
+
+/*! Reserves one of the alarms, which let a library run a function from the
+ * Timer 4 interrupt at a precise time (to within one tick of Timer 4, or
+ * 1/188 ms), without needing a timer of its own.  For example, uart.lib uses
+ * one to release the RS-485 driver enable pin right after the last stop bit.
+ * The alarm stays reserved until the Wixel is reset.
+ *
+ * The alarms use channel 1 of Timer 4, so you can not use that channel for
+ * anything else once an alarm has been reserved.
+ *
+ * This function should only be called from the main loop, typically from
+ * the initialization function of a library.
+ *
+ * \return The number of the reserved alarm, or #TIME_ALARM_NONE if all of
+ * them have already been reserved. */
+uint8 timeAllocateAlarm(void);
+
+/*! Makes the Timer 4 interrupt call a function at the specified time.
+ *
+ * \param alarm  An alarm number returned by timeAllocateAlarm().
+ * \param ms  The millisecond count (see getMs()) when the function should be
+ *   called.
+ * \param ticks  The value of the Timer 4 counter (T4CNT, 0 to 187) during that
+ *   millisecond when the function should be called.
+ * \param callback  The function to call, or 0 to cancel the alarm.
+ *
+ * If the time has already passed, the function is called as soon as the
+ * Timer 4 interrupt can run.  Setting an alarm that has not gone off yet
+ * replaces it, and the function is only called once.
+ *
+ * This function can be called from the main loop or from an ISR.  The
+ * callback runs in the Timer 4 interrupt, so it should be short and it must
+ * not call any non-reentrant functions that the main loop also calls. */
+void timeSetAlarm(uint8 alarm, uint32 ms, uint8 ticks, void (*callback)(void)) __reentrant;
+
 /*! This interrupt fires once per millisecond (approximately) and
- * increments timeMs. */
+ * increments the millisecond count returned by getMs().  It also calls the
+ * functions set with timeSetAlarm(). */
 ISR(T4, 0);
 
 /*! \param microseconds  The number of microseconds delay; any value between 0 and 255.
@@ -44,6 +108,58 @@ ISR(T4, 0);
  *  will be longer than specified. */
 void delayMicroseconds(uint8 microseconds);
 
+/*! Delays for exactly the specified number of CPU cycles by inserting that
+ * many NOP instructions into your code.  At 24 MHz, one cycle is 41.7 ns, so
+ * this has 24 times the resolution of delayMicroseconds().
+ *
+ * \param cycles  The number of cycles: an integer literal (or a macro that
+ *   expands to one) between 0 and 31.
+ *
+ * Unlike delayMicroseconds(), this has no call overhead and no loop, so the
+ * delay does not depend on the alignment of the code, and it is suitable for
+ * timing the edges of bit-banged signals.  The time taken by the surrounding
+ * code still has to be accounted for separately.  For longer delays, use
+ * delayMicroseconds().
+ *
+ * Example: <code>P1_0 = 1; DELAY_CYCLES(12); P1_0 = 0;</code> */
+#define DELAY_CYCLES(cycles) DELAY_CYCLES_EXPAND(cycles)
+
+/*! \cond */
+#define DELAY_CYCLES_EXPAND(cycles) { DELAY_CYCLES_ ## cycles }
+#define DELAY_CYCLES_0
+#define DELAY_CYCLES_1 DELAY_CYCLES_0 __asm nop __endasm;
+#define DELAY_CYCLES_2 DELAY_CYCLES_1 __asm nop __endasm;
+#define DELAY_CYCLES_3 DELAY_CYCLES_2 __asm nop __endasm;
+#define DELAY_CYCLES_4 DELAY_CYCLES_3 __asm nop __endasm;
+#define DELAY_CYCLES_5 DELAY_CYCLES_4 __asm nop __endasm;
+#define DELAY_CYCLES_6 DELAY_CYCLES_5 __asm nop __endasm;
+#define DELAY_CYCLES_7 DELAY_CYCLES_6 __asm nop __endasm;
+#define DELAY_CYCLES_8 DELAY_CYCLES_7 __asm nop __endasm;
+#define DELAY_CYCLES_9 DELAY_CYCLES_8 __asm nop __endasm;
+#define DELAY_CYCLES_10 DELAY_CYCLES_9 __asm nop __endasm;
+#define DELAY_CYCLES_11 DELAY_CYCLES_10 __asm nop __endasm;
+#define DELAY_CYCLES_12 DELAY_CYCLES_11 __asm nop __endasm;
+#define DELAY_CYCLES_13 DELAY_CYCLES_12 __asm nop __endasm;
+#define DELAY_CYCLES_14 DELAY_CYCLES_13 __asm nop __endasm;
+#define DELAY_CYCLES_15 DELAY_CYCLES_14 __asm nop __endasm;
+#define DELAY_CYCLES_16 DELAY_CYCLES_15 __asm nop __endasm;
+#define DELAY_CYCLES_17 DELAY_CYCLES_16 __asm nop __endasm;
+#define DELAY_CYCLES_18 DELAY_CYCLES_17 __asm nop __endasm;
+#define DELAY_CYCLES_19 DELAY_CYCLES_18 __asm nop __endasm;
+#define DELAY_CYCLES_20 DELAY_CYCLES_19 __asm nop __endasm;
+#define DELAY_CYCLES_21 DELAY_CYCLES_20 __asm nop __endasm;
+#define DELAY_CYCLES_22 DELAY_CYCLES_21 __asm nop __endasm;
+#define DELAY_CYCLES_23 DELAY_CYCLES_22 __asm nop __endasm;
+#define DELAY_CYCLES_24 DELAY_CYCLES_23 __asm nop __endasm;
+#define DELAY_CYCLES_25 DELAY_CYCLES_24 __asm nop __endasm;
+#define DELAY_CYCLES_26 DELAY_CYCLES_25 __asm nop __endasm;
+#define DELAY_CYCLES_27 DELAY_CYCLES_26 __asm nop __endasm;
+#define DELAY_CYCLES_28 DELAY_CYCLES_27 __asm nop __endasm;
+#define DELAY_CYCLES_29 DELAY_CYCLES_28 __asm nop __endasm;
+#define DELAY_CYCLES_30 DELAY_CYCLES_29 __asm nop __endasm;
+#define DELAY_CYCLES_31 DELAY_CYCLES_30 __asm nop __endasm;
+/*! \endcond */
+
 /*! \param milliseconds  The number of milliseconds delay; any value between 0 and 65535.
  *
  *  This function delays for the specified number of milliseconds using
@@ -18,6 +18,19 @@
  * documented here, except all the function and variable names begin with
  * "uart1" instead of "uart0".
  *
+ * If you set #uart0DmaEnabled to 1 before calling uart0Init(), the library
+ * uses DMA instead of an interrupt per byte, which reduces the CPU load at high
+ * baud rates.  The functions for sending and receiving bytes work the same way
+ * in both modes.
+ *
+ * By default, each UART has a 256-byte TX buffer and a 256-byte RX buffer in
+ * XDATA.  You can change these sizes when building the library by setting
+ * UART0_TX_BUFFER_SIZE, UART0_RX_BUFFER_SIZE, UART1_TX_BUFFER_SIZE, and
+ * UART1_RX_BUFFER_SIZE in libraries/src/uart/lib_options.mk or on the
+ * make command line.  Each size must be a power of two no larger than 2048.
+ * Run <code>make uart_memory</code> to see how much XDATA each UART uses with
+ * the current options.
+ *
  * For UART0, this library uses Alternative Location 1: P0_3 is TX, P0_2 is RX.
  * For UART1, this library uses Alternative Location 2: P1_6 is TX, P1_7 is RX.
  * This library does not yet allow you to choose which UART location to use.
@@ -30,6 +43,38 @@
 #include <cc2511_types.h>
 #include <com.h>
 
+/*! Set this to 1 before calling uart0Init() to use DMA to transfer bytes
+ * between the UART and the buffers instead of using an interrupt for each byte.
+ * The default value is 0.
+ *
+ * In DMA mode, uart0Init() reserves two DMA channels with dmaAllocateChannel().
+ * If not enough channels are free, the direction(s) that did not get a channel
+ * use interrupts instead.
+ *
+ * The RX DMA channel uses two bytes of the RX buffer to store each received
+ * byte and its status, so the RX buffer only holds half as many bytes (minus
+ * one).  The received
+ * bytes become available as soon as they arrive, but the library only checks
+ * for parity and framing errors when you call uart0RxAvailable(), and bytes with
+ * errors are not discarded.  If the RX buffer fills up, the bytes received
+ * before you read some of the old ones are discarded, just like in interrupt
+ * mode (see #uart0RxBufferFullOccurred), and the RX DMA channel starts again the
+ * next time you call uart0RxAvailable().  The RX DMA channel also relies on the
+ * DMA interrupt (see dma.h) once per pass through the RX buffer: if that
+ * interrupt does not run within one character time, a byte can be lost.
+ *
+ * The TX DMA channel is only used after uart0SetBaudRate() has been called,
+ * and only at baud rates of 9000 and above.  It sends the bytes in the TX
+ * buffer in as few transfers as possible, and the DMA interrupt (see dma.h)
+ * starts each transfer as soon as the previous one finishes, so the bytes are
+ * sent back to back without the main loop having to do anything.  The
+ * interrupt has to run within one character time after a transfer finishes;
+ * if it does not (for example because another interrupt took too long), the
+ * next transfer is started the next time you call uart0TxAvailable(),
+ * uart0TxSend(), or uart0TxSendByte().  This mode requires Timer 4 to be
+ * running, which it is if you called systemInit(). */
+extern BIT uart0DmaEnabled;
+
 /*! Initializes the library.
  *
  * This must be called before any of other functions with names that
@@ -67,10 +112,262 @@ void uart0SetParity(uint8 parity);
  */
 void uart0SetStopBits(uint8 stopBits);
 
-/*! \return The number of bytes available in the TX buffer.
+/*! Enables or disables RTS/CTS hardware flow control.
+ *
+ * \param enable 1 to enable flow control, 0 to disable it.
+ *
+ * For UART0, P0_5 is RTS (an output) and P0_4 is CTS (an input).
+ * For UART1, P1_5 is RTS (an output) and P1_4 is CTS (an input).
+ * Both signals are active low.
+ *
+ * When flow control is enabled, the UART only starts sending a byte while
+ * CTS is low, and the library drives RTS high when the RX buffer is nearly
+ * full (less than one eighth of it free; 32 bytes with the default buffer size)
+ * so that the other device stops sending before any bytes are lost.  RTS goes
+ * low again once at least a quarter of the buffer is free.  In DMA mode (see #uart0DmaEnabled), the library only checks the
+ * RX buffer when you call uart0RxAvailable(), so you should call it regularly,
+ * and TX uses interrupts instead of DMA.
+ *
+ * Flow control is disabled by uart0Init(), so call this function after it.
+ * The default is disabled.
+ */
+void uart0SetFlowControl(BIT enable);
+
+/*! Sets up a pin to control the driver enable (DE) input of an RS-485
+ * transceiver, for half-duplex communication on a shared bus.
+ *
+ * \param pinNumber The pin to use, numbered as in gpio.h (e.g. 12 for P1_2).
+ *   It must be on Port 0 or Port 1 and must not be used by the UART.
+ *   Use #DRIVER_ENABLE_NONE to stop using a DE pin.
+ * \param suppressEcho 1 to discard the bytes received while the driver is
+ *   enabled, 0 to keep them.
+ *
+ * The library drives the pin high just before it starts sending a byte, and
+ * drives it low again after the stop bit of the last byte in the TX buffer
+ * has been sent.  Because the CC2511 does not have an interrupt for the end of
+ * a transmission, the pin is driven low by an alarm in the Timer 4 interrupt
+ * (see timeAllocateAlarm()), one character time (plus about 10 microseconds)
+ * after the last byte started.  Timer 4 must be running, which it is if you
+ * called systemInit().  The first call to this function reserves the alarm.
+ * If none is left, the pin is driven low by uart0Service() instead, which is
+ * also called by uart0TxAvailable(), uart0TxSend(), and uart0TxSendByte(), so
+ * the bus is not released until your main loop calls one of them.
+ *
+ * If the transceiver's receiver is enabled while it is transmitting, the RX
+ * line receives a copy of every byte sent.  Set \p suppressEcho to 1 to
+ * discard those bytes.  Echo suppression does not work in DMA mode
+ * (see #uart0DmaEnabled), and TX does not use DMA while a DE pin is set.
+ *
+ * The DE pin is disabled by uart0Init(), so call this function after it.
+ * If bytes are being sent when you call this function, it waits until they
+ * have been sent.  If the bytes stop going out (for example because CTS is
+ * deasserted and flow control is enabled), it waits for two character times
+ * after the last one that was sent, and then discards the rest.
+ */
+void uart0SetDriverEnable(uint8 pinNumber, BIT suppressEcho);
+
+/*! Enables or disables 9-bit mode, which is used for multiprocessor
+ * (multi-drop) communication: each byte has a ninth data bit, which is usually
+ * 1 for a byte that holds the address of the device that the following bytes
+ * are for, and 0 for the other bytes.
+ *
+ * \param enable 1 to enable 9-bit mode, 0 to go back to 8 data bits with no
+ *   parity.
+ *
+ * In 9-bit mode, use uart0TxSendNineBits() and uart0RxReceiveNineBits() to
+ * send and receive bytes with their ninth bit.  The other functions still
+ * work: uart0TxSendByte() and uart0TxSend() send bytes whose ninth bit is 0,
+ * and uart0RxReceiveByte() ignores the ninth bit.  There is no parity bit in
+ * this mode.  Calling uart0SetParity() disables 9-bit mode.
+ *
+ * The CC2511 can not change the ninth bit while a byte is being sent, so
+ * whenever the ninth bit of the next byte is different from the one before
+ * it, the library stops sending until the byte before it has finished.  The
+ * ninth bit is then changed and sending resumes the next time uart0Service(),
+ * uart0TxAvailable(), uart0TxSend(), uart0TxSendByte(), or
+ * uart0TxSendNineBits() is called, so your main loop should call one of them
+ * regularly.  Since the CC2511 has no register that holds the ninth bit of a
+ * received byte, the library compares it to the ninth bit being sent, so
+ * 9-bit mode only works reliably on half-duplex links (for example, an RS-485
+ * bus; see uart0SetDriverEnable()) where the Wixel does not send and receive
+ * at the same time.  TX does not use DMA in this mode, and 9-bit mode is not
+ * available with RX DMA (see #uart0DmaEnabled), so this function does nothing
+ * in that case.
+ *
+ * The library stores the ninth bit of each byte in the TX and RX buffers,
+ * which takes an eighth of the size of the buffers in XDATA, so 9-bit mode is
+ * only available if the library was built with UART0_NINE_BIT=1 (or
+ * UART1_NINE_BIT=1) set in libraries/src/uart/lib_options.mk or on the make
+ * command line.  Otherwise, this function does nothing.
+ *
+ * 9-bit mode is disabled by uart0Init(), so call this function after it.
+ * The default is disabled.
+ */
+void uart0SetNineBit(BIT enable);
+
+/*! Enables or disables the address filter in 9-bit mode (see
+ * uart0SetNineBit()).
+ *
+ * \param enable 1 to enable the filter, 0 to disable it.
+ * \param address The address of this device.
+ *
+ * When the filter is enabled, the RX interrupt checks every byte whose ninth
+ * bit is 1: if the byte is equal to \p address, that byte and the bytes after
+ * it are put in the RX buffer; otherwise, they are discarded, up to the next
+ * byte whose ninth bit is 1.  This way, the main loop does not see (or spend
+ * any time on) the messages meant for other devices on the bus.
+ *
+ * The bytes received before the first address byte after this function is
+ * called are discarded.  This function does nothing if 9-bit mode is disabled,
+ * and the filter is disabled when 9-bit mode is enabled or disabled.
+ */
+void uart0SetRxAddressFilter(BIT enable, uint8 address);
+
+/*! Enables or disables idle-gap framing of the received bytes.
+ *
+ * \param bitTimes The minimum length of a frame gap, in bit times at the current
+ *   baud rate, or 0 to disable framing.
+ *
+ * Many serial protocols separate their messages (frames) with gaps where the
+ * RX line is idle.  When framing is enabled, the RX interrupt measures the time
+ * between the end of each byte and the end of the byte before it (using
+ * Timer 4, so the resolution is about 5.3 us) and records the start of a new
+ * frame whenever that time is at least \p bitTimes bit times.  Note that this
+ * time includes the new byte itself: bytes sent back-to-back with 8 data bits,
+ * no parity, and 1 stop bit are 10 bit times apart.  For example, Modbus RTU
+ * frames are separated by at least 3.5 characters of silence while the bytes
+ * in a frame are separated by at most 1.5 characters, so with 11-bit
+ * characters any value between 28 and 49 will work, and 39 is a good choice.
+ *
+ * Use uart0RxFrameLength() and uart0RxFrameTime() to read the frames.
+ * Up to 8 frames can be waiting in the RX buffer; if more arrive, the extra
+ * frames are merged with the last one.
+ *
+ * The gap is recomputed when you call uart0SetBaudRate().  This requires
+ * timeInit() to have been called.  Framing is not available in DMA mode
+ * (see #uart0DmaEnabled), so this function does nothing in that mode.
+ *
+ * Framing is disabled by uart0Init(), so call this function after it.
+ * The default is disabled.
+ */
+void uart0SetRxFrameGap(uint8 bitTimes);
+
+/*! \return The number of unread bytes in the oldest complete frame
+ * in the RX buffer, or 0 if there is no complete frame.
+ *
+ * A frame is complete once another frame has started after it or the RX line
+ * has been idle for longer than the frame gap (see uart0SetRxFrameGap()).
+ * Always returns 0 if framing is disabled.
+ *
+ * To read the frame, call uart0RxReceiveByte() at most this many times.
+ * You do not have to read the whole frame at once: the next call to this
+ * function returns the number of bytes that are left.
+ */
+uint16 uart0RxFrameLength(void);
+
+/*! \return The time (see getMs()) when the first byte of the frame was
+ * received.  This should only be called if uart0RxFrameLength() recently
+ * returned a non-zero value.
+ */
+uint32 uart0RxFrameTime(void);
+
+/*! The auto-baud detection has not been started.  See uart0AutoBaudService(). */
+#define AUTO_BAUD_IDLE      0
+
+/*! The auto-baud detection is waiting for the sync character. */
+#define AUTO_BAUD_RUNNING   1
+
+/*! The auto-baud detection finished and the baud rate has been set. */
+#define AUTO_BAUD_DONE      2
+
+/*! The sync character was not received before the timeout.  The baud rate
+ * was not changed. */
+#define AUTO_BAUD_FAILED    3
+
+/*! Starts detecting the baud rate of the device connected to the RX line.
+ *
+ * \param syncChar The character that the other device will send, e.g. 0x55
+ *   ('U'), which gives the most accurate measurement.  The character must have
+ *   at least two falling edges: a start bit and a 1 followed by a 0
+ *   (so 0xFF and 0xFE do not work).
+ * \param timeout The maximum time to wait for the sync character, in
+ *   milliseconds.
+ * \return 1 if the detection started, or 0 if the sync character can not be
+ *   used, there is no free DMA channel, or Timer 1 is in use.
+ *
+ * The receiver is disabled until the detection is done, so no bytes are
+ * added to the RX buffer during that time.  The detection uses Timer 1
+ * (Alt. 1 location, channel 0 on P0_2) to time the falling edges of the sync
+ * character and a DMA channel (reserved with dmaAllocateChannel() the first
+ * time this is called) to record them, so it does not use any CPU time until
+ * you call uart0AutoBaudService().
+ *
+ * Timer 1 can not be shared, so this function returns 0 without doing
+ * anything if Timer 1 is running or its interrupt is enabled, which is the
+ * case while the servo library (servo.h) is running.  Stop the servos with
+ * servosStop() before starting the detection, and do not start them (or
+ * anything else that uses Timer 1) until uart0AutoBaudService() returns
+ * something other than #AUTO_BAUD_RUNNING.  When the detection stops, it
+ * suspends Timer 1 and restores T1CTL, T1CCTL0 and PERCFG.T1CFG to the values
+ * they had when it started, so a Timer 1 user that was stopped can be started
+ * again afterwards.  Calling this function while a detection is running
+ * starts it over.
+ *
+ * Baud rates from about 400 to 1,500,000 can be detected; the measurement
+ * resolution is 1/3 us.  This function is only available for UART0,
+ * because UART1's RX pin is not connected to Timer 1.
+ */
+BIT uart0AutoBaudStart(uint8 syncChar, uint16 timeout);
+
+/*! Checks the progress of the auto-baud detection started by
+ * uart0AutoBaudStart().  You should call this regularly until it returns
+ * something other than #AUTO_BAUD_RUNNING.
+ *
+ * When the sync character has been received, this function computes the baud
+ * rate, snaps it to the nearest standard baud rate (such as 9600 or 115200) if
+ * it is within 5% of one, and calls uart0SetBaudRate() with that rate.  Edges
+ * that do not match the sync character are ignored.
+ *
+ * \return #AUTO_BAUD_IDLE, #AUTO_BAUD_RUNNING, #AUTO_BAUD_DONE, or
+ *   #AUTO_BAUD_FAILED.
+ */
+uint8 uart0AutoBaudService(void);
+
+/*! \return The difference between the measured baud rate and the rate that
+ * was set by the last successful auto-baud detection, in parts per million
+ * (ppm) of the rate that was set.  A positive number means the other device
+ * is faster.  The precision depends on the baud rate: with 0x55 as the sync
+ * character, one Timer 1 tick is 50 ppm at 1200 baud and 4800 ppm at
+ * 115200 baud.
+ */
+int32 uart0AutoBaudErrorPpm(void);
+
+/*! Does the work that the library can not do from an interrupt: releasing
+ * the RS-485 driver enable pin at the end of a transmission (see
+ * uart0SetDriverEnable()), changing the ninth bit between bytes in 9-bit mode
+ * (see uart0SetNineBit()), and starting a TX DMA transfer that the DMA
+ * interrupt could not start (see #uart0DmaEnabled).
+ *
+ * uart0TxAvailable(), uart0TxSend(), and uart0TxSendByte() call this function,
+ * so you only need to call it if your main loop does not call any of them
+ * regularly. */
+void uart0Service(void);
+
+/*! \return The number of bytes available in the TX buffer, or 255 if
+ * there are more than 255.
  */
 uint8 uart0TxAvailable(void);
 
+/*! \return 1 if everything written to the TX buffer has been sent, including
+ * the stop bits of the last byte, and the RS-485 driver enable pin (if any)
+ * has been released.  Otherwise 0.
+ *
+ * Use this before changing the baud rate or frame format if the bytes already
+ * queued must be sent with the old settings.  It measures the end of the last
+ * byte with Timer 4 (see time.h), so it can keep returning 0 for a few
+ * Timer 4 ticks (about 16 microseconds) after the stop bit ends. */
+BIT uart0TxIdle(void);
+
 /*! Adds a byte to the TX buffer, which means it will be sent on UART0's TX line later.
  * \param byte  The byte to send.
  *
@@ -90,7 +387,16 @@ void uart0TxSendByte(uint8 byte);
  */
 void uart0TxSend(const uint8 XDATA * buffer, uint8 size);
 
-/*! \return The number of bytes in the RX buffer.
+/*! Adds a byte and its ninth bit to the TX buffer (see uart0SetNineBit()).
+ * \param word  The byte to send in bits 0-7, and the ninth bit in bit 8.
+ *
+ * Like uart0TxSendByte(), this is a non-blocking function: you must call
+ * uart0TxAvailable() first.  The ninth bit is only sent in 9-bit mode.
+ */
+void uart0TxSendNineBits(uint16 word);
+
+/*! \return The number of bytes in the RX buffer, or 255 if there are
+ * more than 255.
  *
  * You can use this function to see if any bytes have been received, and
  * then use uart0RxReceiveByte() to actually get the byte and process it.
@@ -109,6 +415,39 @@ uint8 uart0RxAvailable(void);
  */
 uint8 uart0RxReceiveByte(void);
 
+/*! \return A byte from the RX buffer in bits 0-7, and its ninth bit in
+ * bit 8 (see uart0SetNineBit()).  Bit 8 is always 0 if 9-bit mode is
+ * disabled.
+ *
+ * Like uart0RxReceiveByte(), this is a non-blocking function: you must call
+ * uart0RxAvailable() first.
+ */
+uint16 uart0RxReceiveNineBits(void);
+
+/*! \return The errors that occurred right before the next byte in the RX
+ *   buffer (the byte that uart0RxReceiveByte() would return next), or 0 if
+ *   there were none.  The errors are reported as a combination of
+ *   #ACM_SERIAL_STATE_FRAMING, #ACM_SERIAL_STATE_PARITY, and
+ *   #ACM_SERIAL_STATE_OVERRUN (from com.h), so they can be passed directly to
+ *   usbComTxControlSignalEvents().
+ *
+ * Bytes with framing or parity errors and bytes received while the RX buffer
+ * is full are discarded, but the library remembers where they would have been
+ * in the stream of received bytes.  If you call this function before each
+ * call to uart0RxReceiveByte(), you can tell exactly where the stream was
+ * corrupted.  Each error is only returned once.  Errors that happen after the
+ * last byte in the RX buffer are returned after the next byte arrives.
+ *
+ * The library remembers the positions of up to 8 errors; more errors are
+ * combined with the last one.  In DMA mode (see #uart0DmaEnabled), the errors are
+ * only detected when uart0RxAvailable() is called, so their positions are
+ * not exact.
+ *
+ * This function does not affect #uart0RxParityErrorOccurred,
+ * #uart0RxFramingErrorOccurred, or #uart0RxBufferFullOccurred.
+ */
+uint8 uart0RxErrors(void);
+
 /*! Transmit interrupt. */
 ISR(UTX0, 0);
 
@@ -123,7 +462,9 @@ extern volatile BIT uart0RxFramingErrorOccurred;
 
 /*! The library sets this to 1 whenever a new byte arrives and
  * the RX buffer is full.
- * In that case, the byte will be discarded.*/
+ * In that case, the byte will be discarded.
+ * With flow control enabled (see uart0SetFlowControl()), this should only
+ * happen if the other device does not obey RTS.*/
 extern volatile BIT uart0RxBufferFullOccurred;
 
 #endif /* UART_H_ */
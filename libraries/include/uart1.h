@@ -11,15 +11,28 @@
 #include <cc2511_types.h>
 #include <com.h>
 
+extern BIT uart1DmaEnabled;
 void uart1Init();
 void uart1SetBaudRate(uint32 baudrate);
 void uart1SetParity(uint8 parity);
 void uart1SetStopBits(uint8 stopBits);
+void uart1SetFlowControl(BIT enable);
+void uart1SetDriverEnable(uint8 pinNumber, BIT suppressEcho);
+void uart1SetNineBit(BIT enable);
+void uart1SetRxAddressFilter(BIT enable, uint8 address);
+void uart1SetRxFrameGap(uint8 bitTimes);
+uint16 uart1RxFrameLength(void);
+uint32 uart1RxFrameTime(void);
+void uart1Service(void);
 uint8 uart1TxAvailable(void);
+BIT uart1TxIdle(void);
 void uart1TxSendByte(uint8 byte);
 void uart1TxSend(const uint8 XDATA * buffer, uint8 size);
+void uart1TxSendNineBits(uint16 word);
 uint8 uart1RxAvailable(void);
 uint8 uart1RxReceiveByte(void);
+uint16 uart1RxReceiveNineBits(void);
+uint8 uart1RxErrors(void);
 ISR(UTX1, 0);
 ISR(URX1, 0);
 extern volatile BIT uart1RxParityErrorOccurred;
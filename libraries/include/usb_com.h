@@ -73,6 +73,15 @@ void usbComTxControlSignals(uint8 signals);
  *
  * You can report multiple events with one call to this function.
  *
+ * To let the USB host find where the events happened in the data stream,
+ * this function sends any data that has already been added to the TX buffer,
+ * and usbComTxAvailable() returns 0 until the events have been reported by
+ * usbComService().  After that, you can keep adding data.  If the events can
+ * not be reported for 20 ms (because the host is not reading the notification
+ * endpoint, or is still reading the last notification), usbComTxAvailable()
+ * lets the data through anyway, and the events are reported later, so their
+ * position in the stream is only approximate in that case.
+ *
  * Example use:
 \code
 if (uart0RxParityErrorOccurred)
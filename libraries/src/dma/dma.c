@@ -3,8 +3,71 @@
 #include <dma.h>
 
 DMA14_CONFIG XDATA dmaConfig;
+volatile DMA_CONFIG XDATA dmaConfig0;
+
+// Bit N is 1 iff channel N has been reserved by dmaAllocateChannel().
+// Channel 1 is always used for the radio.
+static uint8 dmaChannelsUsed = (1<<DMA_CHANNEL_RADIO);
+
+// The order in which dmaAllocateChannel() gives out channels.  Channel 0 is
+// last because its configuration is not next to the others in memory.
+static uint8 CODE dmaChannelOrder[] = {2, 3, 4, 0};
+
+// The function to call when each channel finishes a transfer, or 0.
+typedef void (*DMA_CALLBACK)(void);
+static DMA_CALLBACK XDATA dmaCallback[5];
 
 void dmaInit()
 {
     DMA1CFG = (uint16)&dmaConfig;
+    DMA0CFG = (uint16)&dmaConfig0;
+}
+
+uint8 dmaAllocateChannel()
+{
+    uint8 i;
+
+    for (i = 0; i < sizeof(dmaChannelOrder); i++)
+    {
+        uint8 channel = dmaChannelOrder[i];
+        if (!(dmaChannelsUsed & (1<<channel)))
+        {
+            dmaChannelsUsed |= (1<<channel);
+            return channel;
+        }
+    }
+    return DMA_CHANNEL_NONE;
+}
+
+volatile DMA_CONFIG XDATA * dmaChannelConfig(uint8 channel)
+{
+    if (channel == 0)
+    {
+        return &dmaConfig0;
+    }
+    return &dmaConfig.radio + (channel - 1);
+}
+
+void dmaSetCallback(uint8 channel, void (*callback)(void))
+{
+    DMAIE = 0;
+    dmaCallback[channel] = callback;
+    DMAIE = 1;
+}
+
+ISR(DMA, 0)
+{
+    uint8 i;
+
+    DMAIF = 0;
+    for (i = 0; i < 5; i++)
+    {
+        if ((DMAIRQ & (1<<i)) && dmaCallback[i])
+        {
+            // Writing 0 to a bit of DMAIRQ clears it and writing 1 does
+            // nothing, so this does not disturb the other channels' flags.
+            DMAIRQ = ~(1<<i);
+            dmaCallback[i]();
+        }
+    }
 }
@@ -66,3 +66,94 @@ void setPort2PullType(BIT pullType) __reentrant
     if (pullType){ P2INP &= ~(1<<7); }
     else { P2INP |= (1<<7); }
 }
+
+void readPorts(uint8 XDATA * values) __reentrant
+{
+    // Read all the ports before storing any of them so the reads are as close
+    // together as possible.
+    uint8 p0 = P0;
+    uint8 p1 = P1;
+    uint8 p2 = P2;
+    values[0] = p0;
+    values[1] = p1;
+    values[2] = p2;
+}
+
+void setPortOutputs(uint8 port, uint8 mask, uint8 values) __reentrant
+{
+    uint8 set = values & mask;
+    uint8 clear = values | ~mask;
+
+    // Each of these is a single ORL or ANL instruction on the port.
+    switch(port)
+    {
+    case 0: P0 |= set; P0 &= clear; break;
+    case 1: P1 |= set; P1 &= clear; break;
+    case 2: P2 |= set; P2 &= clear; break;
+    }
+}
+
+void pinMapInit(GPIO_PIN_MAP XDATA * map, const uint8 * pinNumbers, uint8 count) __reentrant
+{
+    while (count--)
+    {
+        map->port = *pinNumbers / 10;
+        map->mask = 1 << (*pinNumbers % 10);
+        map++;
+        pinNumbers++;
+    }
+}
+
+uint16 pinMapRead(const GPIO_PIN_MAP XDATA * map, uint8 count) __reentrant
+{
+    uint8 ports[3];
+    uint16 result = 0;
+    uint16 bit = 1;
+
+    ports[0] = P0;
+    ports[1] = P1;
+    ports[2] = P2;
+
+    while (count--)
+    {
+        if (ports[map->port] & map->mask)
+        {
+            result |= bit;
+        }
+        bit <<= 1;
+        map++;
+    }
+    return result;
+}
+
+void pinMapWrite(const GPIO_PIN_MAP XDATA * map, uint8 count, uint16 mask, uint16 values) __reentrant
+{
+    uint8 set[3];
+    uint8 clear[3];
+
+    set[0] = set[1] = set[2] = 0;
+    clear[0] = clear[1] = clear[2] = 0xFF;
+
+    while (count--)
+    {
+        if (mask & 1)
+        {
+            if (values & 1)
+            {
+                set[map->port] |= map->mask;
+            }
+            else
+            {
+                clear[map->port] &= ~map->mask;
+            }
+        }
+        mask >>= 1;
+        values >>= 1;
+        map++;
+    }
+
+    // Each of these is a single ORL or ANL instruction on the port.
+    P0 |= set[0]; P0 &= clear[0];
+    P1 |= set[1]; P1 &= clear[1];
+    P2 |= set[2]; P2 &= clear[2];
+}
@@ -1,6 +1,16 @@
 /* i2c.c: A basic software implementation of a master node for I2C communication
  * (the CC2511 does not have a hardware I2C module). This library does not
  * support multi-master I2C buses.
+ *
+ * The bus is driven by an interrupt-driven engine that is stepped by Timer 3:
+ * each Timer 3 interrupt performs one half-period of the SCL clock (see the
+ * PHASE_* definitions below).  The engine performs one operation at a time
+ * (a START, a STOP, or the nine bits of a byte transfer).  The operations come
+ * either from the transaction queue (i2cQueueTransaction), which is run
+ * entirely in the background, or from the blocking functions (i2cStart,
+ * i2cWriteByte, ...), which start one operation and wait for it to finish.
+ * At 400 kHz, the blocking functions bit-bang the bus directly instead (see
+ * the "Fast path" section below).
  */
 
 /* Dependencies ***************************************************************/
@@ -11,177 +21,626 @@
 #include <gpio.h>
 #include <i2c.h>
 
+// The pins used by the 400 kHz fast path.  Set in lib_options.mk.
+#ifndef I2C_FAST_SCL_PIN
+#define I2C_FAST_SCL_PIN 10
+#endif
+#ifndef I2C_FAST_SDA_PIN
+#define I2C_FAST_SDA_PIN 11
+#endif
+
 /* Global Constants & Variables ***********************************************/
 
 uint8 DATA i2cPinScl = 10; // P1_0
 uint8 DATA i2cPinSda = 11; // P1_1
 
-static uint16 XDATA halfPeriodUs = 5; // freq = 100 kHz
+// The Timer 3 configuration that gives one interrupt per half period.
+// Default: 24 MHz / 1 / 120 = 200 kHz interrupts, freq = 100 kHz.
+static uint8 XDATA timerDiv = 0;
+static uint8 XDATA timerPeriod = 119;
 static uint16 XDATA timeout = 10;
+
+// The number of interrupts that SCL can be held low by a slave before a
+// timeout occurs.  Computed from timeout and the frequency.
+static uint16 XDATA timeoutTicks = 2000;
+static uint16 XDATA stretchTicksLeft;
+
 static BIT started = 0;
 
+// 1 if the frequency is 400 kHz or more (see the fast path below).
+static BIT fastMode = 0;
+
 /* i2cTimeoutOccurred is the publicly readable error flag. It must be manually
  * cleared.
  * We have an internal timeout flag too so that e.g. i2cReadByte can abort if
- * i2cReadBit times out, but we can clear the internal flag at the beginning of
- * i2cReadByte so an earlier timeout doesn't affect a later call.
+ * the engine times out, but we can clear the internal flag at the beginning of
+ * each operation so an earlier timeout doesn't affect a later call.
  */
 BIT i2cTimeoutOccurred = 0;
 static BIT internalTimeoutOccurred = 0;
 
+/* Pins ***********************************************************************/
 
-/* Functions ******************************************************************/
+// The ports (0-2) and bit masks of the pins, loaded from i2cPinScl and
+// i2cPinSda whenever we start using the bus while it is idle.  SFRs can not be accessed through
+// pointers, so the macros below select the port registers at run time.
+// The output latches of both pins are 0, so a pin is driven low by making it
+// an output, and released by making it an input.
+static uint8 DATA sclPort, sclMask;
+static uint8 DATA sdaPort, sdaMask;
 
-void i2cSetFrequency(uint16 freqKHz)
+#define PIN_CLEAR(port, mask)   { if (port == 0) { P0DIR |= mask; } else if (port == 1) { P1DIR |= mask; } else { P2DIR |= mask; } }
+#define PIN_RELEASE(port, mask) { if (port == 0) { P0DIR &= ~mask; } else if (port == 1) { P1DIR &= ~mask; } else { P2DIR &= ~mask; } }
+#define PIN_IS_HIGH(port, mask) (((port == 0) ? P0 : ((port == 1) ? P1 : P2)) & mask)
+
+#define SCL_CLEAR()     PIN_CLEAR(sclPort, sclMask)
+#define SCL_RELEASE()   PIN_RELEASE(sclPort, sclMask)
+#define SCL_IS_HIGH()   PIN_IS_HIGH(sclPort, sclMask)
+#define SDA_CLEAR()     PIN_CLEAR(sdaPort, sdaMask)
+#define SDA_RELEASE()   PIN_RELEASE(sdaPort, sdaMask)
+#define SDA_IS_HIGH()   PIN_IS_HIGH(sdaPort, sdaMask)
+
+static void loadPin(uint8 pin, uint8 DATA * port, uint8 DATA * mask)
 {
-    // delayMicroseconds takes a uint8, so halfPeriodUs cannot be more than 255
-    if (freqKHz < 2)
+    *port = pin / 10;
+    *mask = 1 << (pin % 10);
+
+    // Release the line and disable the pull-up/pull-down resistor, then clear
+    // the output latch without changing the direction.
+    setDigitalInput(pin, HIGH_IMPEDANCE);
+    switch(*port)
     {
-        freqKHz = 2;
+    case 0: P0 &= ~*mask; break;
+    case 1: P1 &= ~*mask; break;
+    default: P2 &= ~*mask; break;
     }
+}
 
-    // force halfPeriodUs to round up so we don't use a higher frequency than what was chosen
-    // TODO: implement a timing function with better resolution than delayMicroseconds to allow finer-grained frequency control?
-    halfPeriodUs = (500 + freqKHz - 1) / freqKHz;
+// Loads both pins.  This releases SCL and SDA, so it must only be called while
+// the bus is idle (started == 0): in the middle of a transaction, we might be
+// holding either line low.
+static void loadPins(void)
+{
+    loadPin(i2cPinScl, &sclPort, &sclMask);
+    loadPin(i2cPinSda, &sdaPort, &sdaMask);
 }
 
-void i2cSetTimeout(uint16 timeoutMs)
+/* Engine *********************************************************************/
+
+// Each phase takes one Timer 3 interrupt (half of an SCL period), except that
+// the phases that expect SCL to be high wait while a slave holds it low
+// (clock stretching).
+#define PHASE_IDLE                  0
+#define PHASE_START_RELEASE_SDA     1   // Repeated START only.
+#define PHASE_START_RELEASE_SCL     2   // Repeated START only.
+#define PHASE_START_CLEAR_SDA       3   // SDA goes low while SCL is high.
+#define PHASE_START_CLEAR_SCL       4
+#define PHASE_BIT_SET_SDA           5   // The first bit of a byte.
+#define PHASE_BIT_RELEASE_SCL       6
+#define PHASE_BIT_HIGH              7   // Sample SDA, drive SCL low, and set SDA for the next bit.
+#define PHASE_STOP_CLEAR_SDA        8
+#define PHASE_STOP_RELEASE_SCL      9
+#define PHASE_STOP_RELEASE_SDA      10  // SDA goes high while SCL is high.
+#define PHASE_STOP_DONE             11  // Bus free time.
+
+static volatile uint8 DATA phase = PHASE_IDLE;
+
+// During a byte transfer, shiftByte holds the bits left to send in its upper
+// bits (MSB first) and the bits received from SDA in its lower bits, so after
+// eight bits it holds the byte that was on the bus.  To receive a byte we send
+// 0xFF, which leaves SDA released.
+static uint8 DATA shiftByte;
+static uint8 DATA bitsLeft;     // Including the acknowledge bit.
+static BIT ninthBit;            // What we put on SDA for the acknowledge bit.
+static BIT ackBit;              // What was on SDA for the acknowledge bit (1 = NACK).
+
+static void opDone(void);
+
+static void beginStart(void)
 {
-    timeout = timeoutMs;
+    phase = started ? PHASE_START_RELEASE_SDA : PHASE_START_CLEAR_SDA;
+    stretchTicksLeft = timeoutTicks;
 }
 
-BIT i2cReadScl(void)
+static void beginByte(uint8 byte, BIT ninth)
 {
-    setDigitalInput(i2cPinScl, HIGH_IMPEDANCE);
-    return isPinHigh(i2cPinScl);
+    shiftByte = byte;
+    ninthBit = ninth;
+    bitsLeft = 9;
+    phase = PHASE_BIT_SET_SDA;
 }
 
-BIT i2cReadSda(void)
+static void beginStop(void)
 {
-    setDigitalInput(i2cPinSda, HIGH_IMPEDANCE);
-    return isPinHigh(i2cPinSda);
+    phase = PHASE_STOP_CLEAR_SDA;
 }
 
-void i2cClearScl(void)
+// Starts Timer 3 so that the engine runs the operation that was just set up.
+// This is called from the main loop when the engine is idle.  The pins are
+// only loaded if the bus is idle too; otherwise they are left as they are,
+// because the last operation (e.g. a START) left the lines in the state that
+// the next one expects.
+static void engineRun(void)
 {
-    setDigitalOutput(i2cPinScl, LOW);
+    if (!started)
+    {
+        loadPins();
+    }
+
+    T3CC0 = timerPeriod;
+    T3IE = 1;
+
+    // DIV: from i2cSetFrequency
+    // START=1: Start the timer
+    // OVFIM=1: Enable the overflow interrupt.
+    // CLR=1: Clear the counter.
+    // MODE=10: Modulo
+    T3CTL = (timerDiv << 5) | 0b00011110;
 }
 
-void i2cClearSda(void)
+// Called when a slave holds SCL low in a phase that needs it to be high.
+static void sclStretched(void)
 {
-    setDigitalOutput(i2cPinSda, LOW);
+    if (--stretchTicksLeft == 0)
+    {
+        SCL_RELEASE();
+        SDA_RELEASE();
+        internalTimeoutOccurred = 1;
+        i2cTimeoutOccurred = 1;
+        started = 0;
+        opDone();
+    }
 }
 
-void i2cWaitForHighScl(uint16 timeoutMs)
+ISR(T3, 0)
 {
-    uint32 time = getMs();
-    while (i2cReadScl() == 0)
+    BIT b;
+
+    switch(phase)
     {
-        if (getMs() - time > timeoutMs)
+    case PHASE_START_RELEASE_SDA:
+        SDA_RELEASE();
+        phase = PHASE_START_RELEASE_SCL;
+        break;
+
+    case PHASE_START_RELEASE_SCL:
+        SCL_RELEASE();
+        phase = PHASE_START_CLEAR_SDA;
+        break;
+
+    case PHASE_START_CLEAR_SDA:
+        if (!SCL_IS_HIGH()) { sclStretched(); break; }
+        SDA_CLEAR();
+        phase = PHASE_START_CLEAR_SCL;
+        break;
+
+    case PHASE_START_CLEAR_SCL:
+        SCL_CLEAR();
+        started = 1;
+        opDone();
+        break;
+
+    case PHASE_BIT_SET_SDA:
+        if (shiftByte & 0x80) { SDA_RELEASE(); } else { SDA_CLEAR(); }
+        phase = PHASE_BIT_RELEASE_SCL;
+        break;
+
+    case PHASE_BIT_RELEASE_SCL:
+        SCL_RELEASE();
+        stretchTicksLeft = timeoutTicks;
+        phase = PHASE_BIT_HIGH;
+        break;
+
+    case PHASE_BIT_HIGH:
+        if (!SCL_IS_HIGH()) { sclStretched(); break; }
+        b = SDA_IS_HIGH() ? 1 : 0;
+        SCL_CLEAR();
+
+        if (--bitsLeft == 0)
         {
-            internalTimeoutOccurred = 1;
-            i2cTimeoutOccurred = 1;
-            started = 0;
+            ackBit = b;
+            opDone();
+            break;
+        }
+
+        shiftByte = (shiftByte << 1) | b;
+        if (bitsLeft == 1 ? ninthBit : (shiftByte & 0x80)) { SDA_RELEASE(); } else { SDA_CLEAR(); }
+        phase = PHASE_BIT_RELEASE_SCL;
+        break;
+
+    case PHASE_STOP_CLEAR_SDA:
+        SDA_CLEAR();
+        phase = PHASE_STOP_RELEASE_SCL;
+        break;
+
+    case PHASE_STOP_RELEASE_SCL:
+        SCL_RELEASE();
+        stretchTicksLeft = timeoutTicks;
+        phase = PHASE_STOP_RELEASE_SDA;
+        break;
+
+    case PHASE_STOP_RELEASE_SDA:
+        if (!SCL_IS_HIGH()) { sclStretched(); break; }
+        SDA_RELEASE();
+        started = 0;
+        phase = PHASE_STOP_DONE;
+        break;
+
+    case PHASE_STOP_DONE:
+        opDone();
+        break;
+
+    default:
+        // The engine is idle.
+        T3CTL = 0;
+        break;
+    }
+}
+
+/* Transaction queue **********************************************************/
+
+/* The queued transactions form a linked list from queueHead to queueTail.
+ * The transaction at the head is the one on the bus.  Every time the engine
+ * finishes an operation for it, queueOpDone (called from the Timer 3
+ * interrupt) starts the next operation, and when the STOP is done, it sets the
+ * status of the transaction and starts the next transaction right away.  The
+ * main loop only adds transactions, with the interrupt disabled. */
+static I2C_TRANSACTION XDATA * volatile DATA queueHead = 0;
+static I2C_TRANSACTION XDATA * DATA queueTail;
+
+#define SEQ_START           0
+#define SEQ_WRITE_ADDRESS   1
+#define SEQ_WRITE           2
+#define SEQ_RESTART         3
+#define SEQ_READ_ADDRESS    4
+#define SEQ_READ            5
+#define SEQ_STOP            6
+
+static uint8 XDATA seq;
+static uint8 XDATA seqIndex;    // The index of the next byte in the buffer.
+static uint8 XDATA seqResult;   // The status the transaction will have when it is done.
+
+static void queueStart(void)
+{
+    queueHead->status = I2C_TRANSACTION_ACTIVE;
+    seq = SEQ_START;
+    seqResult = I2C_TRANSACTION_DONE;
+    internalTimeoutOccurred = 0;
+    beginStart();
+}
+
+static void queueOpDone(void)
+{
+    I2C_TRANSACTION XDATA * t = queueHead;
+
+    if (internalTimeoutOccurred)
+    {
+        // The bus is released, so skip the STOP.
+        seqResult = I2C_TRANSACTION_TIMEOUT;
+        seq = SEQ_STOP;
+    }
+
+    switch(seq)
+    {
+    case SEQ_START:
+        seqIndex = 0;
+        if (t->writeLength == 0 && t->readLength != 0)
+        {
+            seq = SEQ_READ_ADDRESS;
+            beginByte((t->address << 1) | 1, 1);
+        }
+        else
+        {
+            seq = SEQ_WRITE_ADDRESS;
+            beginByte(t->address << 1, 1);
+        }
+        return;
+
+    case SEQ_WRITE_ADDRESS:
+    case SEQ_WRITE:
+        if (ackBit)
+        {
+            seqResult = (seq == SEQ_WRITE) ? I2C_TRANSACTION_NACK : I2C_TRANSACTION_NACK_ADDRESS;
+            break;
+        }
+        if (seqIndex < t->writeLength)
+        {
+            seq = SEQ_WRITE;
+            beginByte(t->writeBuffer[seqIndex++], 1);
             return;
         }
+        if (t->readLength != 0)
+        {
+            seq = SEQ_RESTART;
+            beginStart();
+            return;
+        }
+        break;
+
+    case SEQ_RESTART:
+        seq = SEQ_READ_ADDRESS;
+        beginByte((t->address << 1) | 1, 1);
+        return;
+
+    case SEQ_READ_ADDRESS:
+        if (ackBit)
+        {
+            seqResult = I2C_TRANSACTION_NACK_ADDRESS;
+            break;
+        }
+        seq = SEQ_READ;
+        seqIndex = 0;
+        beginByte(0xFF, t->readLength == 1);
+        return;
+
+    case SEQ_READ:
+        t->readBuffer[seqIndex++] = shiftByte;
+        if (seqIndex < t->readLength)
+        {
+            beginByte(0xFF, seqIndex == t->readLength - 1);
+            return;
+        }
+        break;
+
+    default: // SEQ_STOP
+        t->status = seqResult;
+        queueHead = t->next;
+        if (queueHead)
+        {
+            queueStart();
+        }
+        else
+        {
+            phase = PHASE_IDLE;
+            T3CTL = 0;
+        }
+        return;
     }
+
+    seq = SEQ_STOP;
+    beginStop();
 }
 
-/* Generate an I2C STOP condition (P):
- *  SDA goes high while SCL is high
- */
-void i2cStop(void)
+// Called from the interrupt when the engine finishes an operation.
+static void opDone(void)
+{
+    if (queueHead)
+    {
+        queueOpDone();
+    }
+    else
+    {
+        phase = PHASE_IDLE;
+        T3CTL = 0;
+    }
+}
+
+void i2cQueueTransaction(I2C_TRANSACTION XDATA * transaction)
 {
-    i2cClearSda(); // drive SDA low while SCL is low
-    delayMicroseconds(halfPeriodUs);
+    BIT idle;
 
-    // handle clock stretching
-    i2cWaitForHighScl(timeout);
-    if (internalTimeoutOccurred) return;
+    transaction->next = 0;
+    transaction->status = I2C_TRANSACTION_QUEUED;
 
-    // SCL is now high
-    i2cReadSda(); // let SDA line go high while SCL is high
-    delayMicroseconds(halfPeriodUs);
-    started = 0;
+    T3IE = 0;
+    idle = (queueHead == 0);
+    if (idle)
+    {
+        queueHead = transaction;
+    }
+    else
+    {
+        queueTail->next = transaction;
+    }
+    queueTail = transaction;
+    T3IE = 1;
+
+    if (idle)
+    {
+        // The engine is stopped, so we have to start it.
+        queueStart();
+        engineRun();
+    }
 }
 
-/* Generate an I2C START or repeated START condition (S):
- *  SDA goes low while SCL is high
- */
-void i2cStart(void)
+BIT i2cBusy(void)
 {
-    // if started == 1, do a repeated start
-    if (started)
+    return phase != PHASE_IDLE;
+}
+
+/* Functions ******************************************************************/
+
+void i2cSetFrequency(uint16 freqKHz)
+{
+    uint16 clocks;
+
+    if (freqKHz < 2)
     {
-        i2cReadSda(); // let SDA line go high while SCL is low
-        delayMicroseconds(halfPeriodUs);
+        freqKHz = 2;
     }
 
-    // handle clock stretching
-    i2cWaitForHighScl(timeout);
-    if (internalTimeoutOccurred) return;
+    // Timer 3 ticks at 24 MHz, so a half period is 12000/freqKHz ticks.
+    // Round up so we don't use a higher frequency than what was chosen, then
+    // use the smallest prescaler that makes it fit in the 8-bit timer.
+    // (For freqKHz >= 2 the largest prescaler needed is 1:32.)
+    clocks = (12000 + freqKHz - 1) / freqKHz;
+    timerDiv = 0;
+    while (clocks > 256)
+    {
+        clocks = (clocks + 1) >> 1;
+        timerDiv++;
+    }
+    timerPeriod = clocks - 1;
 
-    // SCL is now high
-    i2cClearSda(); // drive SDA low while SCL is high
-    delayMicroseconds(halfPeriodUs);
-    i2cClearScl(); // drive SCL low
-    started = 1;
+    fastMode = (freqKHz >= 400);
+
+    i2cSetTimeout(timeout);
 }
 
-/* Write a bit to the I2C bus
- * It is assumed that SCL is low when this function starts.
- * SDA is set to the appropriate bit value while SCL is low, there is a
- * delay for half of the clock period while SDA stablizes, then SCL
- * is allowed to go high for the second half of the clock period, which
- * indicates the on SDA is valid.  This function drives SCL low again
- * before it returns.
- */
-void i2cWriteBit(BIT b)
+void i2cSetTimeout(uint16 timeoutMs)
+{
+    // Timer 3 counts 24000 times per millisecond.
+    uint32 ticks = (uint32)24000 * timeoutMs / ((uint16)(timerPeriod + 1) << timerDiv);
+
+    timeout = timeoutMs;
+
+    if (ticks > 0xFFFF) { ticks = 0xFFFF; }
+    if (ticks == 0) { ticks = 1; }
+    timeoutTicks = ticks;
+}
+
+// Runs the operation that was just set up and waits for it to finish.
+static void runOp(void)
 {
-    if (b)
+    engineRun();
+    while (phase != PHASE_IDLE);
+}
+
+/* Fast path ******************************************************************/
+
+/* The Timer 3 interrupt can not keep up with 400 kHz, so when the frequency is
+ * 400 kHz or more and the pins are the ones chosen when the library was
+ * compiled (see lib_options.mk), the blocking functions bit-bang the bus
+ * directly.  The pins are accessed with the compile-time macros from gpio.h,
+ * which compile to single instructions, and the delays are made with
+ * DELAY_CYCLES.
+ *
+ * Fast-mode I2C needs SCL to be low for at least 1.3 us (32 cycles) and high
+ * for at least 0.6 us (15 cycles), with a 2.5 us (60 cycle) period.  The code
+ * between the edges takes about 20 cycles in the low part of each bit and 8
+ * cycles in the high part, so the delays below give about 34 cycles low and 26
+ * cycles high: 60 cycles per bit, or 400 kHz.  Slow SCL rise times add to
+ * the high part, which only lowers the frequency. */
+
+#define FAST_SCL_CLEAR()    GPIO_MAKE_OUTPUT(I2C_FAST_SCL_PIN)
+#define FAST_SCL_RELEASE()  GPIO_MAKE_INPUT(I2C_FAST_SCL_PIN)
+#define FAST_SCL_IS_HIGH()  GPIO_IS_PIN_HIGH(I2C_FAST_SCL_PIN)
+#define FAST_SDA_CLEAR()    GPIO_MAKE_OUTPUT(I2C_FAST_SDA_PIN)
+#define FAST_SDA_RELEASE()  GPIO_MAKE_INPUT(I2C_FAST_SDA_PIN)
+#define FAST_SDA_IS_HIGH()  GPIO_IS_PIN_HIGH(I2C_FAST_SDA_PIN)
+
+#define FAST_LOW_DELAY  14
+#define FAST_HIGH_DELAY 18
+
+#define USE_FAST_PATH() (fastMode && i2cPinScl == I2C_FAST_SCL_PIN && i2cPinSda == I2C_FAST_SDA_PIN)
+
+// Waits for a slave to release SCL.  Returns 0 if a timeout occurs.
+static BIT fastWaitForHighScl(void)
+{
+    uint32 time = getMs();
+    while (!FAST_SCL_IS_HIGH())
     {
-        i2cReadSda(); // let SDA go high
+        if (getMs() - time > timeout)
+        {
+            internalTimeoutOccurred = 1;
+            i2cTimeoutOccurred = 1;
+            started = 0;
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// The slow function is only called if a slave is stretching the clock.
+#define FAST_WAIT_FOR_HIGH_SCL()  (FAST_SCL_IS_HIGH() || fastWaitForHighScl())
+
+static void fastStart(void)
+{
+    if (started)
+    {
+        FAST_SDA_RELEASE();
+        DELAY_CYCLES(FAST_LOW_DELAY);
+        FAST_SCL_RELEASE();
+        DELAY_CYCLES(FAST_HIGH_DELAY);
     }
     else
     {
-        i2cClearSda(); // drive SDA low
+        // Make sure the output latches are 0.
+        loadPins();
     }
-    delayMicroseconds(halfPeriodUs);
 
-    // handle clock stretching
-    i2cWaitForHighScl(timeout);
-    if (internalTimeoutOccurred) return;
+    if (!FAST_WAIT_FOR_HIGH_SCL()) return;
 
-    // SCL is now high, data is valid
-    delayMicroseconds(halfPeriodUs);
-    i2cClearScl();                    // drive SCL low
+    FAST_SDA_CLEAR();
+    DELAY_CYCLES(FAST_HIGH_DELAY);
+    FAST_SCL_CLEAR();
+    started = 1;
 }
 
-/* Read a bit to the I2C bus
- * It is assumed that SCL is low when this function starts.
- * The master tristates SDA so the slave transmitter can control the state
- * and delays for half of the clock period (or longer if the slave is holding
- * SCL low).  It then lets SCL go high, records the state of the SDA line,
- * and delays for the second half of the clock period. This function drives SCL
- * low again before it returns. Return value is not meaningful if timeout
- * occurs.
- */
-BIT i2cReadBit(void)
+static void fastStop(void)
 {
-    BIT b;
+    FAST_SDA_CLEAR();
+    DELAY_CYCLES(FAST_LOW_DELAY);
+    FAST_SCL_RELEASE();
+    DELAY_CYCLES(FAST_HIGH_DELAY);
+    if (!FAST_WAIT_FOR_HIGH_SCL()) return;
+
+    FAST_SDA_RELEASE();
+    DELAY_CYCLES(FAST_LOW_DELAY);
+    started = 0;
+}
+
+// Transfers one byte: the return value is the byte that was on the bus, and
+// ackBit is set to the acknowledge bit.  SCL must be low.
+static uint8 fastTransferByte(uint8 byte, BIT ninth)
+{
+    uint8 i;
 
-    i2cReadSda(); // let slave transmitter control state of SDA line
-    delayMicroseconds(halfPeriodUs);
+    for (i = 0; i < 8; i++)
+    {
+        if (byte & 0x80) { FAST_SDA_RELEASE(); } else { FAST_SDA_CLEAR(); }
+        byte <<= 1;
+        DELAY_CYCLES(FAST_LOW_DELAY);
+        FAST_SCL_RELEASE();
+        DELAY_CYCLES(FAST_HIGH_DELAY);
+        if (!FAST_WAIT_FOR_HIGH_SCL()) return 0;
+        if (FAST_SDA_IS_HIGH()) { byte |= 1; }
+        FAST_SCL_CLEAR();
+    }
 
-    // handle clock stretching
-    i2cWaitForHighScl(timeout);
-    if (internalTimeoutOccurred) return 0;
+    if (ninth) { FAST_SDA_RELEASE(); } else { FAST_SDA_CLEAR(); }
+    DELAY_CYCLES(FAST_LOW_DELAY);
+    FAST_SCL_RELEASE();
+    DELAY_CYCLES(FAST_HIGH_DELAY);
+    if (!FAST_WAIT_FOR_HIGH_SCL()) return 0;
+    ackBit = FAST_SDA_IS_HIGH() ? 1 : 0;
+    FAST_SCL_CLEAR();
 
-    // SCL is now high, data is valid
-    b = i2cReadSda(); // store state of SDA line now that SCL is high
-    delayMicroseconds(halfPeriodUs);
-    i2cClearScl(); // drive SCL low
-    return b;
+    return byte;
+}
+
+/* Blocking functions *********************************************************/
+
+/* Generate an I2C STOP condition (P):
+ *  SDA goes high while SCL is high
+ */
+void i2cStop(void)
+{
+    while (queueHead);
+    internalTimeoutOccurred = 0;
+    if (USE_FAST_PATH())
+    {
+        fastStop();
+        return;
+    }
+    beginStop();
+    runOp();
+}
+
+/* Generate an I2C START or repeated START condition (S):
+ *  SDA goes low while SCL is high
+ */
+void i2cStart(void)
+{
+    while (queueHead);
+    internalTimeoutOccurred = 0;
+    if (USE_FAST_PATH())
+    {
+        fastStart();
+        return;
+    }
+    beginStart();
+    runOp();
 }
 
 /* Write a byte to I2C bus. Return 0 if ack by the slave, 1 if nack.
@@ -189,26 +648,26 @@ BIT i2cReadBit(void)
  */
 BIT i2cWriteByte(uint8 byte)
 {
-    uint8 i;
-    BIT nack;
-
+    while (queueHead);
     internalTimeoutOccurred = 0;
-
-    for (i = 0; i < 8; i++)
+    if (USE_FAST_PATH())
     {
-        i2cWriteBit(byte & 0x80);
-        if (internalTimeoutOccurred) return 0;
-        byte <<= 1;
+        fastTransferByte(byte, 1);
+    }
+    else
+    {
+        beginByte(byte, 1);
+        runOp();
     }
-    nack = i2cReadBit();
     if (internalTimeoutOccurred) return 0;
 
-    if (nack)
+    if (ackBit)
     {
         i2cStop();
         if (internalTimeoutOccurred) return 0;
+        return 1;
     }
-    return nack;
+    return 0;
 }
 
 /* Read a byte from I2C bus.
@@ -216,21 +675,130 @@ BIT i2cWriteByte(uint8 byte)
  */
 uint8 i2cReadByte(BIT nack)
 {
-    uint16 byte = 0;
-    uint8 i;
-    BIT b;
+    uint8 byte;
 
+    while (queueHead);
     internalTimeoutOccurred = 0;
-
-    for (i = 0; i < 8; i++)
+    if (USE_FAST_PATH())
     {
-        b = i2cReadBit();
-        if (internalTimeoutOccurred) return 0;
-        byte = (byte << 1) | b;
+        byte = fastTransferByte(0xFF, nack);
+    }
+    else
+    {
+        beginByte(0xFF, nack);
+        runOp();
+        byte = shiftByte;
     }
-
-    i2cWriteBit(nack);
     if (internalTimeoutOccurred) return 0;
 
     return byte;
 }
+
+/* Transfers ******************************************************************/
+
+// The transaction used by i2cTransfer when the fast path can not be used.
+static I2C_TRANSACTION XDATA transferTransaction;
+
+// 1 if the last byte written was acknowledged and there was no timeout.
+#define FAST_OK() (!internalTimeoutOccurred && !ackBit)
+
+// Does the same thing as a queued transaction, using the fast path.
+static uint8 fastTransfer(uint8 address, const uint8 XDATA * writeBuffer, uint8 writeLength,
+    uint8 XDATA * readBuffer, uint8 readLength)
+{
+    uint8 result = I2C_TRANSACTION_DONE;
+
+    ackBit = 0;
+    fastStart();
+
+    if (writeLength != 0 || readLength == 0)
+    {
+        fastTransferByte(address << 1, 1);
+        if (ackBit) { result = I2C_TRANSACTION_NACK_ADDRESS; }
+
+        while (FAST_OK() && writeLength != 0)
+        {
+            fastTransferByte(*writeBuffer++, 1);
+            writeLength--;
+            if (ackBit) { result = I2C_TRANSACTION_NACK; }
+        }
+
+        if (FAST_OK() && readLength != 0)
+        {
+            fastStart(); // repeated START
+        }
+    }
+
+    if (FAST_OK() && readLength != 0)
+    {
+        fastTransferByte((address << 1) | 1, 1);
+        if (ackBit) { result = I2C_TRANSACTION_NACK_ADDRESS; }
+
+        // ackBit is now the bit we send after each byte, which is only 1 after
+        // the last one.
+        while (FAST_OK() && readLength != 0)
+        {
+            readLength--;
+            *readBuffer++ = fastTransferByte(0xFF, readLength == 0);
+        }
+    }
+
+    if (!internalTimeoutOccurred)
+    {
+        fastStop();
+    }
+    if (internalTimeoutOccurred)
+    {
+        return I2C_TRANSACTION_TIMEOUT;
+    }
+    return result;
+}
+
+uint8 i2cTransfer(uint8 address, const uint8 XDATA * writeBuffer, uint8 writeLength,
+    uint8 XDATA * readBuffer, uint8 readLength)
+{
+    if (USE_FAST_PATH())
+    {
+        while (queueHead);
+        internalTimeoutOccurred = 0;
+        return fastTransfer(address, writeBuffer, writeLength, readBuffer, readLength);
+    }
+
+    transferTransaction.address = address;
+    transferTransaction.writeBuffer = writeBuffer;
+    transferTransaction.writeLength = writeLength;
+    transferTransaction.readBuffer = readBuffer;
+    transferTransaction.readLength = readLength;
+    i2cQueueTransaction(&transferTransaction);
+    while (transferTransaction.status < I2C_TRANSACTION_DONE);
+    return transferTransaction.status;
+}
+
+uint8 i2cScan(uint8 XDATA * found)
+{
+    uint8 address;
+    uint8 count = 0;
+
+    for (address = 0; address < 16; address++)
+    {
+        found[address] = 0;
+    }
+
+    // Addresses 0x00-0x07 and 0x78-0x7F are reserved.
+    for (address = 0x08; address <= 0x77; address++)
+    {
+        switch(i2cTransfer(address, 0, 0, 0, 0))
+        {
+        case I2C_TRANSACTION_DONE:
+            found[address >> 3] |= 1 << (address & 7);
+            count++;
+            break;
+
+        case I2C_TRANSACTION_TIMEOUT:
+            // Something is holding SCL low, so there is no point in trying
+            // the other addresses.
+            return count;
+        }
+    }
+    return count;
+}
@@ -0,0 +1,15 @@
+# The pins used by the 400 kHz fast path of the blocking functions, numbered
+# as in gpio.h.  The fast path accesses these pins with single instructions,
+# so they have to be chosen when the library is compiled.  At 400 kHz, if
+# i2cPinScl and i2cPinSda are different from these, the library uses the
+# slower Timer 3 engine instead.  You can change these here or on the command
+# line, for example:
+#   make clean libs I2C_FAST_SCL_PIN=14 I2C_FAST_SDA_PIN=15
+I2C_FAST_SCL_PIN ?= 10
+I2C_FAST_SDA_PIN ?= 11
+
+libraries/src/i2c/i2c.rel : C_FLAGS += \
+  -DI2C_FAST_SCL_PIN=$(I2C_FAST_SCL_PIN) -DI2C_FAST_SDA_PIN=$(I2C_FAST_SDA_PIN)
+
+# Recompile the library if the pins above are edited.
+libraries/src/i2c/i2c.rel : libraries/src/i2c/lib_options.mk
@@ -0,0 +1,320 @@
+/* pin_change.c:
+ *  Records changes on GPIO pins using the port interrupts.  See pin_change.h
+ *  for an overview.
+ *
+ *  The same code handles a port whether it is called from the port's ISR or
+ *  from pinChangeCurrentEvent(): it reads and clears the port's interrupt
+ *  flags, and then compares the pins with the values we last recorded for
+ *  them.  Comparing the values (instead of trusting the flags) is what lets
+ *  us record the changes that the hardware could not detect because the port
+ *  was set to the wrong edge.
+ */
+
+#include <pin_change.h>
+#include <usb.h>
+#include <time.h>
+
+// Bits in PICTL.
+#define PICTL_P0IENL (1<<3)   // Enables the interrupts for P0_0 through P0_3.
+#define PICTL_P0IENH (1<<4)   // Enables the interrupts for P0_4 through P0_7.
+#define PICTL_P2IEN  (1<<5)   // Enables the interrupts for P2_0 through P2_4.
+// Bit N of PICTL is PICTL.PxICON for port N: 0 = rising edge, 1 = falling edge.
+
+// Bits in IEN2.
+#define IEN2_P2IE (1<<1)
+#define IEN2_P1IE (1<<4)
+
+uint8 pinChangeDebounceMs = 0;
+volatile uint16 pinChangeDropCount = 0;
+
+// The settings and state of each port.  Bit N of each byte refers to pin N of
+// the port.
+static uint8 XDATA enabledPins[3];      // The pins we are watching.
+static uint8 XDATA risingPins[3];       // The pins that record rising edges.
+static uint8 XDATA fallingPins[3];      // The pins that record falling edges.
+static uint8 XDATA recordedValues[3];   // The values of the pins as of their last recorded change.
+
+// The lower 16 bits of the time of the last recorded change on each pin, for
+// debouncing.
+static uint16 XDATA lastChangeMs[3][8];
+
+// The time of the change being processed.
+static uint16 nowMs;
+static uint8 nowTicks;
+
+/* QUEUE **********************************************************************/
+
+static PIN_CHANGE_EVENT XDATA events[PIN_CHANGE_QUEUE_SIZE];
+
+// The number of events ever added to the queue (written by the ISRs) and
+// removed from it (written by the main loop).  The difference is the number of
+// events in the queue.
+static volatile uint8 eventsAdded = 0;
+static volatile uint8 eventsRemoved = 0;
+
+static void addEvent(uint8 pinNumber, uint8 value)
+{
+    PIN_CHANGE_EVENT XDATA * event;
+
+    if ((uint8)(eventsAdded - eventsRemoved) >= PIN_CHANGE_QUEUE_SIZE)
+    {
+        pinChangeDropCount++;
+        return;
+    }
+
+    // Assumption: PIN_CHANGE_QUEUE_SIZE is a power of 2
+    event = &events[eventsAdded & (PIN_CHANGE_QUEUE_SIZE - 1)];
+    event->pin = pinNumber;
+    event->value = value;
+    event->timeMs = nowMs;
+    event->ticks = nowTicks;
+    eventsAdded++;
+}
+
+/* PORT HANDLING **************************************************************/
+
+// Reads the current time into nowMs and nowTicks.  This must be called while
+// the Timer 4 ISR can not run: from a port ISR, or with T4IE cleared.
+static void readTime(void)
+{
+    nowTicks = T4CNT;
+    nowMs = getMsFromIsr(nowTicks);
+}
+
+// Records the edge on one pin if the user asked for that kind of edge.
+static void recordEdge(uint8 port, uint8 pin, uint8 value)
+{
+    uint8 bit = 1 << pin;
+    if (value ? (risingPins[port] & bit) : (fallingPins[port] & bit))
+    {
+        addEvent(port * 10 + pin, value);
+    }
+}
+
+// Chooses the edge that the hardware will detect on a port, based on the
+// changes that the pins we are watching can make next.
+static void updateEdge(uint8 port)
+{
+    uint8 both = risingPins[port] & fallingPins[port];
+    uint8 needRising = enabledPins[port] & ((risingPins[port] & ~both) | (both & ~recordedValues[port]));
+    uint8 needFalling = enabledPins[port] & ((fallingPins[port] & ~both) | (both & recordedValues[port]));
+    uint8 iconBit = 1 << port;
+
+    if (!needFalling)
+    {
+        PICTL &= ~iconBit;
+    }
+    else if (!needRising)
+    {
+        PICTL |= iconBit;
+    }
+    else
+    {
+        // The pins need different edges, so alternate between them.
+        PICTL ^= iconBit;
+    }
+}
+
+// Reads and clears the interrupt flags of a port and records the changes on
+// the pins we are watching.  This must be called while the port ISRs can not
+// run (from one of them, or with them disabled by LOCK()).
+static void servicePort(uint8 port)
+{
+    uint8 flags, values, changed, pulsed, pin, bit;
+
+    switch (port)
+    {
+    case 0:
+        flags = P0IFG;
+        if (flags & 0x80)  // Check USB_RESUME bit.
+        {
+            usbSuspendMode = 0;   // Causes usbSleep to exit sleep mode.
+        }
+        P0IFG = ~flags;   // Clear the flags we read (writing 1 has no effect).
+        P0IF = 0;
+        values = P0;
+        break;
+    case 1:
+        flags = P1IFG;
+        P1IFG = ~flags;
+        P1IF = 0;
+        values = P1;
+        break;
+    default:
+        flags = P2IFG & 0x1F;
+        P2IFG = ~flags;
+        P2IF = 0;
+        values = P2;
+        break;
+    }
+
+    changed = (values ^ recordedValues[port]) & enabledPins[port];
+
+    // A flagged pin whose value has not changed went through two edges before
+    // we could read it.
+    pulsed = flags & enabledPins[port] & ~changed;
+
+    if (!(changed | pulsed))
+    {
+        return;
+    }
+
+    readTime();
+
+    for (pin = 0, bit = 1; bit; pin++, bit <<= 1)
+    {
+        if (!((changed | pulsed) & bit))
+        {
+            continue;
+        }
+
+        if ((uint16)(nowMs - lastChangeMs[port][pin]) < pinChangeDebounceMs)
+        {
+            // This pin is still bouncing from its last change.  If it settles
+            // at a different value, we will see that when it is checked again.
+            continue;
+        }
+        lastChangeMs[port][pin] = nowMs;
+
+        if (pulsed & bit)
+        {
+            recordEdge(port, pin, (values & bit) ? 0 : 1);
+        }
+        else
+        {
+            recordedValues[port] ^= bit;
+        }
+        recordEdge(port, pin, (values & bit) ? 1 : 0);
+    }
+
+    updateEdge(port);
+}
+
+ISR(P0INT, 0)
+{
+    servicePort(0);
+}
+
+ISR(P1INT, 0)
+{
+    servicePort(1);
+}
+
+ISR(P2INT, 0)
+{
+    servicePort(2);
+}
+
+/* GENERAL FUNCTIONS **********************************************************/
+
+// The main loop uses these to keep the port ISRs from running while it changes
+// the state they use.
+static BIT savedP0IE;
+static uint8 savedIEN2;
+#define LOCK()   { savedP0IE = P0IE; savedIEN2 = IEN2 & (IEN2_P1IE | IEN2_P2IE); P0IE = 0; IEN2 &= ~(IEN2_P1IE | IEN2_P2IE); }
+#define UNLOCK() { P0IE = savedP0IE; IEN2 |= savedIEN2; }
+
+// Enables the pin interrupts needed for the pins we are watching on a port.
+// This must be called between LOCK() and UNLOCK(), and it sets the interrupt
+// enable bits that UNLOCK() will restore.
+static void configurePort(uint8 port)
+{
+    uint8 enabled = enabledPins[port];
+
+    switch (port)
+    {
+    case 0:
+        PICTL = (PICTL & ~(PICTL_P0IENL | PICTL_P0IENH))
+            | ((enabled & 0x0F) ? PICTL_P0IENL : 0)
+            | ((enabled & 0xF0) ? PICTL_P0IENH : 0);
+        savedP0IE = enabled ? 1 : 0;
+        break;
+    case 1:
+        P1IEN = enabled;
+        savedIEN2 = enabled ? (savedIEN2 | IEN2_P1IE) : (savedIEN2 & ~IEN2_P1IE);
+        break;
+    default:
+        PICTL = enabled ? (PICTL | PICTL_P2IEN) : (PICTL & ~PICTL_P2IEN);
+        savedIEN2 = enabled ? (savedIEN2 | IEN2_P2IE) : (savedIEN2 & ~IEN2_P2IE);
+        break;
+    }
+
+    updateEdge(port);
+}
+
+void pinChangeEnable(uint8 pinNumber, uint8 edges)
+{
+    uint8 port = pinNumber / 10;
+    uint8 pin = pinNumber % 10;
+    uint8 bit = 1 << pin;
+    uint8 values;
+
+    LOCK();
+
+    // Clear the pin's interrupt flag, which might have been set by an old edge.
+    switch (port)
+    {
+    case 0:  P0IFG = ~bit; values = P0; break;
+    case 1:  P1IFG = ~bit; values = P1; break;
+    default: P2IFG = ~bit; values = P2; break;
+    }
+    recordedValues[port] = (recordedValues[port] & ~bit) | (values & bit);
+
+    // Make sure the first change on this pin is not debounced.
+    lastChangeMs[port][pin] = (uint16)getMs() - 256;
+
+    risingPins[port] = (edges & PIN_CHANGE_RISING) ? (risingPins[port] | bit) : (risingPins[port] & ~bit);
+    fallingPins[port] = (edges & PIN_CHANGE_FALLING) ? (fallingPins[port] | bit) : (fallingPins[port] & ~bit);
+    enabledPins[port] |= bit;
+
+    configurePort(port);
+
+    UNLOCK();
+}
+
+void pinChangeDisable(uint8 pinNumber)
+{
+    uint8 port = pinNumber / 10;
+
+    LOCK();
+    enabledPins[port] &= ~(1 << (pinNumber % 10));
+    configurePort(port);
+    UNLOCK();
+}
+
+PIN_CHANGE_EVENT XDATA * pinChangeCurrentEvent(void)
+{
+    if (eventsAdded == eventsRemoved)
+    {
+        // Check the pins for changes that the hardware did not detect.
+        uint8 savedT4IE = T4IE;
+        uint8 port;
+
+        LOCK();
+        T4IE = 0;
+        for (port = 0; port < 3; port++)
+        {
+            if (enabledPins[port])
+            {
+                servicePort(port);
+            }
+        }
+        T4IE = savedT4IE;
+        UNLOCK();
+
+        if (eventsAdded == eventsRemoved)
+        {
+            return 0;
+        }
+    }
+
+    return &events[eventsRemoved & (PIN_CHANGE_QUEUE_SIZE - 1)];
+}
+
+void pinChangeDoneWithEvent(void)
+{
+    if (eventsAdded != eventsRemoved)
+    {
+        eventsRemoved++;
+    }
+}
@@ -3,6 +3,8 @@
 
 #define PAYLOAD_TYPE_DATA 0
 #define PAYLOAD_TYPE_CONTROL_SIGNALS 1
+#define PAYLOAD_TYPE_SIGNAL_EVENTS 2
+#define PAYLOAD_TYPE_LINE_CODING 3
 
 BIT radioComRxEnforceOrdering = 0;
 
@@ -18,6 +20,20 @@ static uint8 radioComTxSignals = 0;
 static uint8 lastRxSignals = 0; // The last RX signals sent to the higher-level code.
 static BIT sendSignalsSoon = 0; // 1 iff we should transmit control signals soon
 
+// Signal events are sent in the normal lane of the radio_link library, after
+// the data that came before them, so the other Wixel can tell where in the
+// data stream they happened.
+static uint8 txSignalEvents = 0; // Events that have not been sent yet.
+static uint8 rxSignalEvents = 0; // Events received but not yet read by the higher-level code.
+
+// The line coding is also sent in the normal lane, so the other Wixel can
+// apply it to the data that comes after it.
+static ACM_LINE_CODING XDATA txLineCoding;
+static ACM_LINE_CODING XDATA rxLineCoding;
+static BIT txLineCodingValid = 0;   // 1 iff txLineCoding has been set by the higher-level code.
+static BIT sendLineCodingSoon = 0;  // 1 iff we should transmit txLineCoding soon.
+static BIT rxLineCodingReady = 0;   // 1 iff rxLineCoding has not been read by the higher-level code.
+
 // For highest throughput, we want to send as much data in each packet
 // as possible.  But for lower latency, we sometimes need to send packets
 // that are NOT full.
@@ -56,6 +72,14 @@ static void receiveMorePackets(void)
         return;
     }
 
+    if (rxSignalEvents || rxLineCodingReady)
+    {
+        // The higher-level code needs to call radioComRxControlSignalEvents
+        // or radioComRxLineCoding before we feed it the data that came after
+        // the events or the line coding.
+        return;
+    }
+
     // Each iteration of this loop processes one packet received on the radio.
     // This loop stops when we are out of packets or when we received a packet
     // that contains some information that the higher-level code needs to process.
@@ -91,6 +115,38 @@ static void receiveMorePackets(void)
             // It was a redundant command so don't do anything special.
             // Keep processing packets.
             break;
+
+        case PAYLOAD_TYPE_SIGNAL_EVENTS:
+            rxSignalEvents |= packet[1];
+            radioLinkRxDoneWithPacket();
+
+            if (rxSignalEvents)
+            {
+                // Stop processing packets until the higher-level code reads
+                // the events by calling radioComRxControlSignalEvents().
+                return;
+            }
+            break;
+
+        case PAYLOAD_TYPE_LINE_CODING:
+            {
+                uint8 i;
+                for (i = 0; i < sizeof(ACM_LINE_CODING); i++)
+                {
+                    ((uint8 XDATA *)&rxLineCoding)[i] = packet[1 + i];
+                }
+            }
+            rxLineCodingReady = 1;
+            radioLinkRxDoneWithPacket();
+
+            // Stop processing packets until the higher-level code reads
+            // the line coding by calling radioComRxLineCoding().
+            return;
+
+        default:
+            // We do not know what this packet is, so ignore it.
+            radioLinkRxDoneWithPacket();
+            break;
         }
     }
 }
@@ -122,6 +178,26 @@ uint8 radioComRxReceiveByte(void)
     return tmp;
 }
 
+uint8 radioComRxControlSignalEvents(void)
+{
+    uint8 events;
+    receiveMorePackets();
+    events = rxSignalEvents;
+    rxSignalEvents = 0;
+    return events;
+}
+
+ACM_LINE_CODING XDATA * radioComRxLineCoding(void)
+{
+    receiveMorePackets();
+    if (!rxLineCodingReady)
+    {
+        return 0;
+    }
+    rxLineCodingReady = 0;
+    return &rxLineCoding;
+}
+
 uint8 radioComRxControlSignals(void)
 {
     receiveMorePackets();
@@ -140,16 +216,15 @@ static void radioComSendDataNow()
 
 static void radioComSendControlSignalsNow()
 {
-    // Assumption: txBytesLoaded is 0 (we are not in the middle of populating a data packet)
-    // Assumption: radioLinkTxAvailable() >= 1
+    // Assumption: radioLinkTxUrgentAvailable() >= 1
 
     uint8 XDATA * packet;
 
-    packet = radioLinkTxCurrentPacket();
+    packet = radioLinkTxUrgentCurrentPacket();
     packet[0] = 1;   // Payload length is one byte.
     packet[1] = radioComTxSignals;
     sendSignalsSoon = 0;
-    radioLinkTxSendPacket(PAYLOAD_TYPE_CONTROL_SIGNALS);
+    radioLinkTxUrgentSendPacket(PAYLOAD_TYPE_CONTROL_SIGNALS);
 }
 
 void radioComTxService(void)
@@ -160,57 +235,79 @@ void radioComTxService(void)
         // reset.  We should send the state of the control signals to it.
         radioLinkResetPacketReceived = 0;
         sendSignalsSoon = 1;
+
+        // It also lost the line coding we sent it.
+        sendLineCodingSoon = txLineCodingValid;
     }
 
-    if (sendSignalsSoon)
+    if (sendSignalsSoon && radioLinkTxUrgentAvailable())
     {
-        // We want to send the control signals ASAP.
+        // We want to send the control signals ASAP.  They go in the urgent lane
+        // of the radio_link library, so they do not have to wait for the data
+        // packets that are already queued.
+        radioComSendControlSignalsNow();
+    }
 
-        // NOTE: The if statement below could probably be moved to radioComTxControlSignals()
-        // and then you could add the assumption here that txBytesLoaded is 0
-        // (we are not in the middle of populating a data packet).
+    if (txSignalEvents && radioLinkTxAvailable())
+    {
         if (txBytesLoaded != 0)
         {
-            // There is normal data that needs to be sent before the control signals,
-            // so send it now.
+            // Send the data that came before the events first.
             radioComSendDataNow();
         }
 
         if (radioLinkTxAvailable())
         {
-            radioComSendControlSignalsNow();
+            uint8 XDATA * packet = radioLinkTxCurrentPacket();
+            packet[0] = 1;   // Payload length is one byte.
+            packet[1] = txSignalEvents;
+            txSignalEvents = 0;
+            radioLinkTxSendPacket(PAYLOAD_TYPE_SIGNAL_EVENTS);
         }
     }
-    else
-    {
-        // We don't need to send control signals ASAP, so we use the normal policy
-        // for sending data: only send a non-full packet if the number of packets
-        // queued in the lower level drops below the TX_QUEUE_THRESHOLD.
 
-        if (txBytesLoaded != 0 && radioLinkTxQueued() <= TX_QUEUE_THRESHOLD)
+    if (sendLineCodingSoon && !txSignalEvents && radioLinkTxAvailable())
+    {
+        if (txBytesLoaded != 0)
         {
+            // Send the data that came before the line coding first.
             radioComSendDataNow();
         }
+
+        if (radioLinkTxAvailable())
+        {
+            uint8 i;
+            uint8 XDATA * packet = radioLinkTxCurrentPacket();
+            packet[0] = sizeof(ACM_LINE_CODING);
+            for (i = 0; i < sizeof(ACM_LINE_CODING); i++)
+            {
+                packet[1 + i] = ((uint8 XDATA *)&txLineCoding)[i];
+            }
+            sendLineCodingSoon = 0;
+            radioLinkTxSendPacket(PAYLOAD_TYPE_LINE_CODING);
+        }
+    }
+
+    // Use the normal policy for sending data: only send a non-full packet if the
+    // number of packets queued in the lower level drops below the TX_QUEUE_THRESHOLD.
+    if (txBytesLoaded != 0 && radioLinkTxQueued() <= TX_QUEUE_THRESHOLD)
+    {
+        radioComSendDataNow();
     }
 }
 
 uint8 radioComTxAvailable(void)
 {
-    if (sendSignalsSoon)
+    if (txSignalEvents || sendLineCodingSoon)
     {
-        // We want to send the control signals ASAP, but have not yet been able to
-        // queue a packet for them.  Return 0 because we don't want to accept any
-        // more data bytes until we queue up those control signals.  This is part of
-        // the plan to ensure that everything is processed in the right order.
+        // The data after the events or line coding must wait until they are sent.
         return 0;
     }
-    else
-    {
-        // Assumption: If txBytesLoaded is non-zero, radioLinkTxAvailable will be non-zero,
-        // so the subtraction below does not overflow.
-        // Assumption: The multiplication below does not overflow ever.
-        return radioLinkTxAvailable()*RADIO_LINK_PAYLOAD_SIZE - txBytesLoaded;
-    }
+
+    // Assumption: If txBytesLoaded is non-zero, radioLinkTxAvailable will be non-zero,
+    // so the subtraction below does not overflow.
+    // Assumption: The multiplication below does not overflow ever.
+    return radioLinkTxAvailable()*RADIO_LINK_PAYLOAD_SIZE - txBytesLoaded;
 }
 
 void radioComTxSendByte(uint8 byte)
@@ -231,6 +328,32 @@ void radioComTxSendByte(uint8 byte)
     }
 }
 
+void radioComTxFlush(void)
+{
+    if (txBytesLoaded != 0)
+    {
+        radioComSendDataNow();
+    }
+}
+
+void radioComTxControlSignalEvents(uint8 signalEvents)
+{
+    txSignalEvents |= signalEvents;
+    radioComTxService();
+}
+
+void radioComTxLineCoding(const ACM_LINE_CODING XDATA * lineCoding)
+{
+    uint8 i;
+    for (i = 0; i < sizeof(ACM_LINE_CODING); i++)
+    {
+        ((uint8 XDATA *)&txLineCoding)[i] = ((const uint8 XDATA *)lineCoding)[i];
+    }
+    txLineCodingValid = 1;
+    sendLineCodingSoon = 1;
+    radioComTxService();
+}
+
 // If we are in the middle of building a packet, send it.
 void radioComTxControlSignals(uint8 controlSignals)
 {
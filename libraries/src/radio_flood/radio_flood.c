@@ -0,0 +1,263 @@
+/* radio_flood.c:
+ *  This layer builds on top of radio_queue.c to flood packets through a
+ *  multi-hop network.  See radio_flood.h for an overview.
+ *
+ *  Each radio_queue packet sent by this layer has this format:
+ *    Byte 0:  Length of the radio_queue payload (4 + number of data bytes).
+ *    Bytes 1-2: ID of the Wixel that created the packet (least significant byte first).
+ *    Byte 3:  Sequence number, incremented by the source for every packet.
+ *    Byte 4:  TTL (time to live): the number of hops the packet may still take.
+ *    Bytes 5+: Data.
+ *
+ *  The higher-level code sees packets in the usual format (a length byte
+ *  followed by data): the pointers we give it point to byte 4, which we use as
+ *  the payload length byte (the same trick radio_link.c uses for its header).
+ *
+ *  tools/radio_flood_sim runs this file on a simulated network of Wixels on the
+ *  computer (type "make -C tools/radio_flood_sim") to check that packets are
+ *  delivered once to every Wixel within range of their TTL.
+ */
+
+#include <radio_flood.h>
+#include <random.h>
+#include <board.h>
+#include <time.h>
+
+#define HEADER_LENGTH  4
+#define SOURCE_OFFSET  1
+#define SEQUENCE_OFFSET 3
+#define TTL_OFFSET     4
+
+uint16 radioFloodId = 0;
+uint8 radioFloodTtl = 3;
+BIT radioFloodRelayEnabled = 1;
+uint8 radioFloodRelayDelayMask = 15;
+
+uint16 radioFloodRelayedCount = 0;
+uint16 radioFloodDuplicateCount = 0;
+uint16 radioFloodRelayDropCount = 0;
+
+static uint8 txSequence;
+
+// 1 iff the current radio_queue RX packet has been checked and is waiting for
+// the higher-level code.
+static BIT rxReady = 0;
+
+/* DUPLICATE CACHE ************************************************************/
+
+// The source IDs and sequence numbers of the last RADIO_FLOOD_CACHE_SIZE
+// packets we have seen.  The oldest entry is replaced when a new packet arrives.
+static uint16 XDATA cacheSource[RADIO_FLOOD_CACHE_SIZE];
+static uint8 XDATA cacheSequence[RADIO_FLOOD_CACHE_SIZE];
+static uint8 cacheNextIndex = 0;
+
+static BIT cacheContains(uint16 source, uint8 sequence)
+{
+    uint8 i;
+    for (i = 0; i < RADIO_FLOOD_CACHE_SIZE; i++)
+    {
+        if (cacheSource[i] == source && cacheSequence[i] == sequence)
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void cacheAdd(uint16 source, uint8 sequence)
+{
+    cacheSource[cacheNextIndex] = source;
+    cacheSequence[cacheNextIndex] = sequence;
+
+    // Assumption: RADIO_FLOOD_CACHE_SIZE is a power of 2
+    cacheNextIndex = (cacheNextIndex + 1) & (RADIO_FLOOD_CACHE_SIZE - 1);
+}
+
+/* RELAYS *********************************************************************/
+
+// Packets waiting to be relayed.  relayTime holds the lower 16 bits of the
+// time (from getMs()) when each one should be sent.
+#define RELAY_COUNT 4
+static uint8 XDATA relayPacket[RELAY_COUNT][1 + RADIO_QUEUE_PAYLOAD_SIZE];
+static uint16 XDATA relayTime[RELAY_COUNT];
+static uint8 relayPending = 0;   // Bit N is 1 iff relayPacket[N] is waiting to be sent.
+
+static void relaySchedule(uint8 XDATA * packet)
+{
+    uint8 i, j;
+
+    for (i = 0; i < RELAY_COUNT; i++)
+    {
+        if (!(relayPending & (1 << i)))
+        {
+            for (j = 0; j <= packet[0]; j++)
+            {
+                relayPacket[i][j] = packet[j];
+            }
+            relayPacket[i][TTL_OFFSET]--;
+            relayTime[i] = (uint16)getMs() + 1 + (randomNumber() & radioFloodRelayDelayMask);
+            relayPending |= (1 << i);
+            return;
+        }
+    }
+
+    radioFloodRelayDropCount++;
+}
+
+static void relayService(void)
+{
+    uint8 i, j;
+    uint8 XDATA * packet;
+
+    for (i = 0; i < RELAY_COUNT; i++)
+    {
+        if ((relayPending & (1 << i)) && (int16)((uint16)getMs() - relayTime[i]) >= 0)
+        {
+            if (!(packet = radioQueueTxCurrentPacket()))
+            {
+                // No TX buffers are available right now, so try again later.
+                return;
+            }
+
+            for (j = 0; j <= relayPacket[i][0]; j++)
+            {
+                packet[j] = relayPacket[i][j];
+            }
+            radioQueueTxSendPacket();
+            relayPending &= ~(1 << i);
+            radioFloodRelayedCount++;
+        }
+    }
+}
+
+/* GENERAL FUNCTIONS **********************************************************/
+
+void radioFloodInit(void)
+{
+    uint8 i;
+
+    radioQueueInit();
+
+    if (radioFloodId == 0)
+    {
+        // Two bytes of the serial number make it unlikely that two Wixels in
+        // the same network get the same ID.
+        radioFloodId = serialNumber[0] | (serialNumber[1] << 8);
+        if (radioFloodId == 0)
+        {
+            radioFloodId = 1;
+        }
+    }
+
+    // Start with a random sequence number so that our first packets after a
+    // reset are not mistaken for duplicates by Wixels that still remember our
+    // packets from before the reset.
+    txSequence = randomNumber();
+
+    // Source ID 0 is never used, so these entries will not match anything.
+    for (i = 0; i < RADIO_FLOOD_CACHE_SIZE; i++)
+    {
+        cacheSource[i] = 0;
+    }
+}
+
+// Reads the source ID from a radio_queue packet.
+static uint16 packetSource(uint8 XDATA * packet)
+{
+    return packet[SOURCE_OFFSET] | (packet[SOURCE_OFFSET + 1] << 8);
+}
+
+// Checks the packets received by radio_queue until we find one that should be
+// given to the higher-level code.
+static void receiveMorePackets(void)
+{
+    uint8 XDATA * packet;
+
+    while (!rxReady && (packet = radioQueueRxCurrentPacket()))
+    {
+        uint16 source = packetSource(packet);
+        uint8 sequence = packet[SEQUENCE_OFFSET];
+
+        if (packet[0] < HEADER_LENGTH || source == 0)
+        {
+            // This packet was not sent by radio_flood.
+            radioQueueRxDoneWithPacket();
+            continue;
+        }
+
+        if (source == radioFloodId || cacheContains(source, sequence))
+        {
+            // We have seen this packet before (or it is one of ours, relayed
+            // back to us by a neighbor).
+            radioFloodDuplicateCount++;
+            radioQueueRxDoneWithPacket();
+            continue;
+        }
+
+        cacheAdd(source, sequence);
+
+        if (radioFloodRelayEnabled && packet[TTL_OFFSET] > 1)
+        {
+            relaySchedule(packet);
+        }
+
+        // Replace the TTL with the payload length that will be read by the
+        // higher-level code.
+        packet[TTL_OFFSET] = packet[0] - HEADER_LENGTH;
+        rxReady = 1;
+    }
+}
+
+void radioFloodService(void)
+{
+    receiveMorePackets();
+    relayService();
+}
+
+/* TX FUNCTIONS ***************************************************************/
+
+uint8 XDATA * radioFloodTxCurrentPacket(void)
+{
+    uint8 XDATA * packet = radioQueueTxCurrentPacket();
+    if (packet == 0)
+    {
+        return 0;
+    }
+    return packet + HEADER_LENGTH;
+}
+
+void radioFloodTxSendPacket(void)
+{
+    uint8 XDATA * packet = radioQueueTxCurrentPacket();
+
+    // The higher-level code wrote the payload length where the TTL goes.
+    packet[0] = packet[TTL_OFFSET] + HEADER_LENGTH;
+    packet[SOURCE_OFFSET] = (uint8)radioFloodId;
+    packet[SOURCE_OFFSET + 1] = radioFloodId >> 8;
+    packet[SEQUENCE_OFFSET] = txSequence++;
+    packet[TTL_OFFSET] = radioFloodTtl;
+    radioQueueTxSendPacket();
+}
+
+/* RX FUNCTIONS ***************************************************************/
+
+uint8 XDATA * radioFloodRxCurrentPacket(void)
+{
+    receiveMorePackets();
+    if (!rxReady)
+    {
+        return 0;
+    }
+    return radioQueueRxCurrentPacket() + HEADER_LENGTH;
+}
+
+uint16 radioFloodRxCurrentSource(void)
+{
+    return packetSource(radioQueueRxCurrentPacket());
+}
+
+void radioFloodRxDoneWithPacket(void)
+{
+    rxReady = 0;
+    radioQueueRxDoneWithPacket();
+}
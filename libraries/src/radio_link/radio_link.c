@@ -62,11 +62,29 @@ static volatile uint8 XDATA radioLinkRxPacket[RX_PACKET_COUNT][1 + RADIO_MAX_PAC
 volatile uint8 DATA radioLinkRxMainLoopIndex = 0;   // The index of the next rxBuffer to read from the main loop.
 volatile uint8 DATA radioLinkRxInterruptIndex = 0;  // The index of the next rxBuffer to write to when a packet comes from the radio.
 
-/* txPackets are handled similarly */
+/*  txPackets are handled similarly, except that there are two lanes:
+ *  the bulk lane and the urgent lane.  Both lanes share the radioLinkTxPacket
+ *  pool: the first TX_PACKET_COUNT buffers belong to the bulk lane and the last
+ *  TX_URGENT_PACKET_COUNT buffers are reserved for the urgent lane, so urgent
+ *  packets can always be queued no matter how much bulk data is waiting.
+ *
+ *  Each lane is a ring buffer with its own pair of indices.  When the ISR is
+ *  ready to start sending a new packet, it takes the next packet from the urgent
+ *  lane if there is one, and otherwise takes the next packet from the bulk lane.
+ *  The ISR never switches lanes while a packet is waiting to be acknowledged, so
+ *  packets in the same lane are always delivered in order.
+ */
 #define TX_PACKET_COUNT 16
-static volatile uint8 XDATA radioLinkTxPacket[TX_PACKET_COUNT][1 + RADIO_MAX_PACKET_SIZE];  // The first byte is the length, 2nd byte is link header.
+#define TX_URGENT_PACKET_COUNT 4
+static volatile uint8 XDATA radioLinkTxPacket[TX_PACKET_COUNT + TX_URGENT_PACKET_COUNT][1 + RADIO_MAX_PACKET_SIZE];  // The first byte is the length, 2nd byte is link header.
 volatile uint8 DATA radioLinkTxMainLoopIndex = 0;   // The index of the next txPacket to write to in the main loop.
 volatile uint8 DATA radioLinkTxInterruptIndex = 0;  // The index of the current txPacket we are trying to send on the radio.
+volatile uint8 DATA radioLinkTxUrgentMainLoopIndex = 0;   // Same as radioLinkTxMainLoopIndex, but for the urgent lane.
+volatile uint8 DATA radioLinkTxUrgentInterruptIndex = 0;  // Same as radioLinkTxInterruptIndex, but for the urgent lane.
+
+// 1 if the packet the ISR is currently sending comes from the urgent lane.
+// This is only changed by the ISR, and only between packets.
+static volatile BIT txUrgentLane = 0;
 
 uint8 XDATA shortTxPacket[2];
 
@@ -163,13 +181,19 @@ uint8 XDATA * radioLinkTxCurrentPacket()
     return radioLinkTxPacket[radioLinkTxMainLoopIndex] + RADIO_LINK_PACKET_HEADER_LENGTH;
 }
 
-void radioLinkTxSendPacket(uint8 payloadType)
+// Sets the length byte and the payload type of a packet that is about to be queued.
+static void txPreparePacket(uint8 XDATA * packet, uint8 payloadType)
 {
     // Now we set the length byte.
-    radioLinkTxPacket[radioLinkTxMainLoopIndex][0] = radioLinkTxPacket[radioLinkTxMainLoopIndex][RADIO_LINK_PACKET_HEADER_LENGTH] + RADIO_LINK_PACKET_HEADER_LENGTH;
+    packet[0] = packet[RADIO_LINK_PACKET_HEADER_LENGTH] + RADIO_LINK_PACKET_HEADER_LENGTH;
 
     // Put the payloadType into the packet header.
-    radioLinkTxPacket[radioLinkTxMainLoopIndex][RADIO_LINK_PACKET_TYPE_OFFSET] = payloadType << RADIO_LINK_PAYLOAD_TYPE_BIT_OFFSET;
+    packet[RADIO_LINK_PACKET_TYPE_OFFSET] = payloadType << RADIO_LINK_PAYLOAD_TYPE_BIT_OFFSET;
+}
+
+void radioLinkTxSendPacket(uint8 payloadType)
+{
+    txPreparePacket(radioLinkTxPacket[radioLinkTxMainLoopIndex], payloadType);
 
     // Update our index of which packet to populate in the main loop.
     if (radioLinkTxMainLoopIndex == TX_PACKET_COUNT - 1)
@@ -186,6 +210,39 @@ void radioLinkTxSendPacket(uint8 payloadType)
     radioMacStrobe();
 }
 
+uint8 radioLinkTxUrgentAvailable(void)
+{
+    // Assumption: TX_URGENT_PACKET_COUNT is a power of 2
+    return (radioLinkTxUrgentInterruptIndex - radioLinkTxUrgentMainLoopIndex - 1) & (TX_URGENT_PACKET_COUNT - 1);
+}
+
+uint8 radioLinkTxUrgentQueued(void)
+{
+    return (radioLinkTxUrgentMainLoopIndex - radioLinkTxUrgentInterruptIndex) & (TX_URGENT_PACKET_COUNT - 1);
+}
+
+uint8 XDATA * radioLinkTxUrgentCurrentPacket(void)
+{
+    if (!radioLinkTxUrgentAvailable())
+    {
+        return 0;
+    }
+
+    return radioLinkTxPacket[TX_PACKET_COUNT + radioLinkTxUrgentMainLoopIndex] + RADIO_LINK_PACKET_HEADER_LENGTH;
+}
+
+void radioLinkTxUrgentSendPacket(uint8 payloadType)
+{
+    txPreparePacket(radioLinkTxPacket[TX_PACKET_COUNT + radioLinkTxUrgentMainLoopIndex], payloadType);
+
+    // Assumption: TX_URGENT_PACKET_COUNT is a power of 2
+    radioLinkTxUrgentMainLoopIndex = (radioLinkTxUrgentMainLoopIndex + 1) & (TX_URGENT_PACKET_COUNT - 1);
+
+    // Make sure that radioMacEventHandler runs soon so it can see this new data and send it.
+    // This must be done LAST.
+    radioMacStrobe();
+}
+
 /* RX FUNCTIONS (called by higher-level code in main loop) ********************/
 
 uint8 XDATA * radioLinkRxCurrentPacket(void)
@@ -228,11 +285,43 @@ static void txResetPacket()
     }
 }
 
+// Returns a pointer to the TX packet that the ISR should be sending, or 0 if
+// there are no TX packets queued in either lane.
+static uint8 XDATA * txInterruptPacket()
+{
+    BIT urgentQueued = radioLinkTxUrgentInterruptIndex != radioLinkTxUrgentMainLoopIndex;
+    BIT bulkQueued = radioLinkTxInterruptIndex != radioLinkTxMainLoopIndex;
+
+    // We can only choose a new lane if we have not started sending the current
+    // packet yet.  Otherwise the other party might have already received it (and
+    // we just missed the ACK), so switching to a different packet with the
+    // same sequence bit would cause that packet to be discarded as a duplicate.
+    if (radioLinkTxCurrentPacketTries == 0 || (txUrgentLane ? !urgentQueued : !bulkQueued))
+    {
+        txUrgentLane = urgentQueued;
+    }
+
+    if (txUrgentLane)
+    {
+        return radioLinkTxPacket[TX_PACKET_COUNT + radioLinkTxUrgentInterruptIndex];
+    }
+
+    if (bulkQueued)
+    {
+        return radioLinkTxPacket[radioLinkTxInterruptIndex];
+    }
+
+    return 0;
+}
+
+// Assumption: txInterruptPacket() returns non-zero.
 static void txDataPacket(uint8 packetType)
 {
-    radioLinkTxPacket[radioLinkTxInterruptIndex][RADIO_LINK_PACKET_TYPE_OFFSET] =
-            (radioLinkTxPacket[radioLinkTxInterruptIndex][RADIO_LINK_PACKET_TYPE_OFFSET] & RADIO_LINK_PAYLOAD_TYPE_MASK) | packetType | txSequenceBit;
-    radioMacTx(radioLinkTxPacket[radioLinkTxInterruptIndex]);
+    uint8 XDATA * packet = txInterruptPacket();
+
+    packet[RADIO_LINK_PACKET_TYPE_OFFSET] =
+            (packet[RADIO_LINK_PACKET_TYPE_OFFSET] & RADIO_LINK_PAYLOAD_TYPE_MASK) | packetType | txSequenceBit;
+    radioMacTx(packet);
     if (radioLinkTxCurrentPacketTries < 255)
     {
         radioLinkTxCurrentPacketTries++;
@@ -247,7 +336,7 @@ static void takeInitiative()
         txResetPacket();
         radioLinkActivityOccurred = 1;
     }
-    else if (radioLinkTxInterruptIndex != radioLinkTxMainLoopIndex)
+    else if (txInterruptPacket())
     {
         // Try to send the next data packet.
         txDataPacket(PACKET_TYPE_PING);
@@ -278,7 +367,7 @@ void radioMacEventHandler(uint8 event) // called by the MAC in an ISR
 
         if (!radioCrcPassed())
         {
-            if (radioLinkTxInterruptIndex != radioLinkTxMainLoopIndex)
+            if (txInterruptPacket())
             {
                 radioMacRx(currentRxPacket, randomTxDelay());
             }
@@ -323,14 +412,19 @@ void radioMacEventHandler(uint8 event) // called by the MAC in an ISR
                 // Make sure the next packet we transmit has a sequence bit of 0.
                 txSequenceBit = 0;
             }
-            else if (radioLinkTxInterruptIndex != radioLinkTxMainLoopIndex)
+            else if (txInterruptPacket())
             {
                 // Check to see if there is actually any TX packet that we were sending that
                 // can be acknowledged.  This check should return true unless there is a bug
                 // on the other Wixel.
 
-                // Give ownership of the current TX packet back to the main loop by updated radioLinkTxInterruptIndex.
-                if (radioLinkTxInterruptIndex == TX_PACKET_COUNT - 1)
+                // Give ownership of the current TX packet back to the main loop by updating
+                // the interrupt index of the lane it came from.
+                if (txUrgentLane)
+                {
+                    radioLinkTxUrgentInterruptIndex = (radioLinkTxUrgentInterruptIndex + 1) & (TX_URGENT_PACKET_COUNT - 1);
+                }
+                else if (radioLinkTxInterruptIndex == TX_PACKET_COUNT - 1)
                 {
                     radioLinkTxInterruptIndex = 0;
                 }
@@ -403,7 +497,7 @@ void radioMacEventHandler(uint8 event) // called by the MAC in an ISR
 
             // Send an ACK or NAK to the other party.
 
-            if (radioLinkTxInterruptIndex != radioLinkTxMainLoopIndex)
+            if (txInterruptPacket())
             {
                 // Send some data along with the ACK or NAK.
                 txDataPacket(responsePacketType);
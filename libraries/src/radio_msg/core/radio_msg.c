@@ -0,0 +1,382 @@
+/** \file radio_msg.c
+ * This is the main source file for <code>radio_msg.lib</code>.  See
+ * radio_link_msg.h for information on how to use this library.
+ *
+ * Each fragment is a normal packet of the lower-level library with this format:
+ *   Byte 0:  Length of the packet payload (2 + number of data bytes).
+ *   Byte 1:  Message ID.  This is incremented for every message we send.
+ *   Byte 2:  Bits 0-6: Fragment index (0 for the first fragment of a message).
+ *            Bit 7:    1 if this is the last fragment of the message.
+ *   Bytes 3+: Message data.
+ *
+ * With radio_queue, several Wixels can be sending messages on the same channel
+ * and two of them might use the same message ID, so each fragment also
+ * identifies its sender with the first two bytes of the sender's serial number:
+ *   Byte 0:  Length of the packet payload (4 + number of data bytes).
+ *   Byte 1:  Message ID.
+ *   Byte 2:  Bits 0-6: Fragment index.  Bit 7: Last fragment.
+ *   Bytes 3-4: Sender ID.
+ *   Bytes 5+: Message data.
+ * The receiver reassembles a message from the fragments that have the same
+ * message ID and sender ID.
+ *
+ * Both lower-level libraries deliver the packets from one sender in the order
+ * they were sent, so the fragments of a message must arrive with consecutive
+ * indices; if an index is skipped, a fragment was lost and the message is
+ * discarded.
+ */
+
+#include <cc2511_types.h>
+#include <random.h>
+#include <time.h>
+#include <board.h>
+
+#if defined(__CDT_PARSER__)
+#define RADIO_MSG_LINK
+#endif
+
+#if defined(RADIO_MSG_LINK)
+#include <radio_link_msg.h>
+#define LOWER_PAYLOAD_SIZE              RADIO_LINK_PAYLOAD_SIZE
+#define lowerInit                       radioLinkInit
+#define lowerTxCurrentPacket            radioLinkTxCurrentPacket
+#define lowerTxSendPacket()             radioLinkTxSendPacket(0)
+#define lowerRxCurrentPacket            radioLinkRxCurrentPacket
+#define lowerRxDoneWithPacket           radioLinkRxDoneWithPacket
+#define radioNMsgInit                   radioLinkMsgInit
+#define radioNMsgService                radioLinkMsgService
+#define radioNMsgTxCurrentMessage       radioLinkMsgTxCurrentMessage
+#define radioNMsgTxSendMessage          radioLinkMsgTxSendMessage
+#define radioNMsgRxCurrentMessage       radioLinkMsgRxCurrentMessage
+#define radioNMsgRxCurrentLength        radioLinkMsgRxCurrentLength
+#define radioNMsgRxDoneWithMessage      radioLinkMsgRxDoneWithMessage
+#define radioNMsgRxTimeout              radioLinkMsgRxTimeout
+#define radioNMsgRxDropCount            radioLinkMsgRxDropCount
+
+#elif defined(RADIO_MSG_QUEUE)
+#include <radio_queue_msg.h>
+#define LOWER_PAYLOAD_SIZE              RADIO_QUEUE_PAYLOAD_SIZE
+#define lowerInit                       radioQueueInit
+#define lowerTxCurrentPacket            radioQueueTxCurrentPacket
+#define lowerTxSendPacket()             radioQueueTxSendPacket()
+#define lowerRxCurrentPacket            radioQueueRxCurrentPacket
+#define lowerRxDoneWithPacket           radioQueueRxDoneWithPacket
+#define radioNMsgInit                   radioQueueMsgInit
+#define radioNMsgService                radioQueueMsgService
+#define radioNMsgTxCurrentMessage       radioQueueMsgTxCurrentMessage
+#define radioNMsgTxSendMessage          radioQueueMsgTxSendMessage
+#define radioNMsgRxCurrentMessage       radioQueueMsgRxCurrentMessage
+#define radioNMsgRxCurrentLength        radioQueueMsgRxCurrentLength
+#define radioNMsgRxDoneWithMessage      radioQueueMsgRxDoneWithMessage
+#define radioNMsgRxTimeout              radioQueueMsgRxTimeout
+#define radioNMsgRxDropCount            radioQueueMsgRxDropCount
+#endif
+
+#define FRAGMENT_ID_OFFSET     1
+#define FRAGMENT_INDEX_OFFSET  2
+
+#if defined(RADIO_MSG_QUEUE)
+#define FRAGMENT_SENDER_OFFSET 3
+#define HEADER_LENGTH  4
+#else
+#define HEADER_LENGTH  2
+#endif
+
+#define FRAGMENT_DATA_OFFSET   (1 + HEADER_LENGTH)
+#define FRAGMENT_SIZE  (LOWER_PAYLOAD_SIZE - HEADER_LENGTH)
+
+#define FRAGMENT_LAST      0x80
+#define FRAGMENT_INDEX_MASK 0x7F
+
+uint16 radioNMsgRxTimeout = 100;
+uint16 radioNMsgRxDropCount = 0;
+
+/* TX VARIABLES ***************************************************************/
+
+static uint8 XDATA txMessage[RADIO_MSG_MAX_SIZE];
+static uint16 DATA txLength;         // Total length of the message being sent.
+static uint16 DATA txOffset;         // Offset of the next byte to put in a fragment.
+static uint8 DATA txId;              // ID of the message being sent.
+static uint8 DATA txIndex;           // Index of the next fragment.
+static BIT txBusy = 0;               // 1 iff the message in txMessage is still being sent.
+
+/* RX VARIABLES ***************************************************************/
+
+// States of an RX message buffer.
+#define RX_STATE_FREE        0
+#define RX_STATE_ASSEMBLING  1
+#define RX_STATE_COMPLETE    2
+
+typedef struct RX_MESSAGE
+{
+    uint8 state;
+    uint8 id;                // The ID of the message, from byte 1 of the fragments.
+    uint16 sender;           // The sender ID from the fragments (always 0 with radio_link).
+    uint8 nextIndex;         // The index of the next fragment we expect.
+    uint8 order;             // When the message was completed, relative to the others.
+    uint16 length;           // The number of data bytes received so far.
+    uint32 lastFragmentTime; // The time (from getMs()) when the last fragment was received.
+    uint8 buffer[RADIO_MSG_MAX_SIZE];
+} RX_MESSAGE;
+
+static RX_MESSAGE XDATA rxMessage[RADIO_MSG_RX_MESSAGE_COUNT];
+
+// rxCompleteOrder is the order number that will be given to the next message
+// completed, and rxDeliverOrder is the order number of the next message to give
+// to the higher-level code.  These let us return the messages in the order they
+// were completed, no matter which buffers they are in.
+static uint8 DATA rxCompleteOrder = 0;
+static uint8 DATA rxDeliverOrder = 0;
+
+/* GENERAL FUNCTIONS **********************************************************/
+
+void radioNMsgInit(void)
+{
+    uint8 i;
+
+    lowerInit();
+
+    // Start with a random message ID (the lower-level library seeds the random
+    // number generator from the serial number) so that a receiver that hears
+    // several Wixels is unlikely to mix up their messages.
+    txId = randomNumber();
+
+    for (i = 0; i < RADIO_MSG_RX_MESSAGE_COUNT; i++)
+    {
+        rxMessage[i].state = RX_STATE_FREE;
+    }
+}
+
+/* TX FUNCTIONS ***************************************************************/
+
+uint8 XDATA * radioNMsgTxCurrentMessage(void)
+{
+    if (txBusy)
+    {
+        return 0;
+    }
+    return txMessage;
+}
+
+void radioNMsgTxSendMessage(uint16 length)
+{
+    txLength = length;
+    txOffset = 0;
+    txIndex = 0;
+    txBusy = 1;
+
+    // Try to send the first fragments right away.
+    radioNMsgService();
+}
+
+static void txService(void)
+{
+    uint8 XDATA * packet;
+
+    while (txBusy && (packet = lowerTxCurrentPacket()))
+    {
+        uint8 i;
+        uint8 size = FRAGMENT_SIZE;
+        uint8 indexByte = txIndex;
+
+        if (txLength - txOffset <= FRAGMENT_SIZE)
+        {
+            // This is the last fragment.
+            size = txLength - txOffset;
+            indexByte |= FRAGMENT_LAST;
+        }
+
+        packet[0] = HEADER_LENGTH + size;
+        packet[FRAGMENT_ID_OFFSET] = txId;
+        packet[FRAGMENT_INDEX_OFFSET] = indexByte;
+#if defined(RADIO_MSG_QUEUE)
+        packet[FRAGMENT_SENDER_OFFSET] = serialNumber[0];
+        packet[FRAGMENT_SENDER_OFFSET + 1] = serialNumber[1];
+#endif
+        for (i = 0; i < size; i++)
+        {
+            packet[FRAGMENT_DATA_OFFSET + i] = txMessage[txOffset + i];
+        }
+        lowerTxSendPacket();
+
+        txOffset += size;
+        txIndex++;
+
+        if (indexByte & FRAGMENT_LAST)
+        {
+            txId++;
+            txBusy = 0;
+        }
+    }
+}
+
+/* RX FUNCTIONS ***************************************************************/
+
+static void rxDiscard(RX_MESSAGE XDATA * msg)
+{
+    msg->state = RX_STATE_FREE;
+    radioNMsgRxDropCount++;
+}
+
+static void rxFragment(uint8 XDATA * packet)
+{
+    uint8 i;
+    uint8 id = packet[FRAGMENT_ID_OFFSET];
+    uint8 index = packet[FRAGMENT_INDEX_OFFSET] & FRAGMENT_INDEX_MASK;
+    uint8 size = packet[0] - HEADER_LENGTH;
+    RX_MESSAGE XDATA * msg = 0;
+#if defined(RADIO_MSG_QUEUE)
+    uint16 sender = packet[FRAGMENT_SENDER_OFFSET] | (packet[FRAGMENT_SENDER_OFFSET + 1] << 8);
+#else
+    uint16 sender = 0;
+#endif
+
+    // Find the buffer that is reassembling this message.
+    for (i = 0; i < RADIO_MSG_RX_MESSAGE_COUNT; i++)
+    {
+        if (rxMessage[i].state == RX_STATE_ASSEMBLING && rxMessage[i].id == id &&
+            rxMessage[i].sender == sender)
+        {
+            msg = &rxMessage[i];
+            break;
+        }
+    }
+
+    if (index == 0)
+    {
+        if (msg != 0)
+        {
+            // We were already reassembling a message with this ID, but it
+            // never got finished.
+            rxDiscard(msg);
+        }
+        else
+        {
+            // Find a free buffer for the new message.
+            for (i = 0; i < RADIO_MSG_RX_MESSAGE_COUNT; i++)
+            {
+                if (rxMessage[i].state == RX_STATE_FREE)
+                {
+                    msg = &rxMessage[i];
+                    break;
+                }
+            }
+
+            if (msg == 0)
+            {
+                // All the buffers are busy, so we have to drop the message.
+                radioNMsgRxDropCount++;
+                return;
+            }
+        }
+
+        msg->state = RX_STATE_ASSEMBLING;
+        msg->id = id;
+        msg->sender = sender;
+        msg->nextIndex = 0;
+        msg->length = 0;
+    }
+    else if (msg == 0)
+    {
+        // We did not receive the beginning of this message.
+        return;
+    }
+
+    if (index != msg->nextIndex || msg->length + size > RADIO_MSG_MAX_SIZE)
+    {
+        // A fragment was lost or the message is too long.
+        rxDiscard(msg);
+        return;
+    }
+
+    for (i = 0; i < size; i++)
+    {
+        msg->buffer[msg->length + i] = packet[FRAGMENT_DATA_OFFSET + i];
+    }
+    msg->length += size;
+    msg->nextIndex++;
+    msg->lastFragmentTime = getMs();
+
+    if (packet[FRAGMENT_INDEX_OFFSET] & FRAGMENT_LAST)
+    {
+        msg->order = rxCompleteOrder++;
+        msg->state = RX_STATE_COMPLETE;
+    }
+}
+
+static void rxService(void)
+{
+    uint8 i;
+    uint8 XDATA * packet;
+
+    while (packet = lowerRxCurrentPacket())
+    {
+        if (packet[0] >= HEADER_LENGTH)
+        {
+            rxFragment(packet);
+        }
+        lowerRxDoneWithPacket();
+    }
+
+    // Discard the messages that stopped arriving.
+    for (i = 0; i < RADIO_MSG_RX_MESSAGE_COUNT; i++)
+    {
+        if (rxMessage[i].state == RX_STATE_ASSEMBLING &&
+            getMs() - rxMessage[i].lastFragmentTime > radioNMsgRxTimeout)
+        {
+            rxDiscard(&rxMessage[i]);
+        }
+    }
+}
+
+// Returns the buffer holding the next complete message to give to the
+// higher-level code, or 0 if there is none.
+static RX_MESSAGE XDATA * rxCurrent(void)
+{
+    uint8 i;
+    for (i = 0; i < RADIO_MSG_RX_MESSAGE_COUNT; i++)
+    {
+        if (rxMessage[i].state == RX_STATE_COMPLETE && rxMessage[i].order == rxDeliverOrder)
+        {
+            return &rxMessage[i];
+        }
+    }
+    return 0;
+}
+
+uint8 XDATA * radioNMsgRxCurrentMessage(void)
+{
+    RX_MESSAGE XDATA * msg = rxCurrent();
+    if (msg == 0)
+    {
+        return 0;
+    }
+    return msg->buffer;
+}
+
+uint16 radioNMsgRxCurrentLength(void)
+{
+    RX_MESSAGE XDATA * msg = rxCurrent();
+    if (msg == 0)
+    {
+        return 0;
+    }
+    return msg->length;
+}
+
+void radioNMsgRxDoneWithMessage(void)
+{
+    RX_MESSAGE XDATA * msg = rxCurrent();
+    if (msg == 0)
+    {
+        return;
+    }
+    msg->state = RX_STATE_FREE;
+    rxDeliverOrder++;
+}
+
+void radioNMsgService(void)
+{
+    txService();
+    rxService();
+}
@@ -0,0 +1,17 @@
+# This library will be made by linking radio_link_msg.rel and radio_queue_msg.rel.
+LIB_RELS := libraries/src/radio_msg/radio_link_msg.rel libraries/src/radio_msg/radio_queue_msg.rel
+
+# When those rel (object) files are compiled, there will be a
+# special preprocessor flag to specify which lower-level library to use.
+libraries/src/radio_msg/radio_link_msg.rel : C_FLAGS += -DRADIO_MSG_LINK
+libraries/src/radio_msg/radio_queue_msg.rel : C_FLAGS += -DRADIO_MSG_QUEUE
+
+# The rel files will be compiled from radio_link_msg.c and radio_queue_msg.c,
+# which will both be copies of core/radio_msg.c.
+libraries/src/radio_msg/radio_link_msg.c : libraries/src/radio_msg/core/radio_msg.c
+	$(CP) $< $@
+
+libraries/src/radio_msg/radio_queue_msg.c : libraries/src/radio_msg/core/radio_msg.c
+	$(CP) $< $@
+
+TARGETS += libraries/src/radio_msg/radio_link_msg.c libraries/src/radio_msg/radio_queue_msg.c
@@ -4,9 +4,11 @@
  *  not ensure reliability or specify the format of the packets, except that the
  *  first byte of the packet must contain its length.
  *
- *  This layer does not transmit packets as quickly as possible; instead, it
- *  listens for incoming packets for a random interval of 1-4 ms between sending
- *  packets.
+ *  By default, this layer does not transmit packets as quickly as possible;
+ *  instead, it listens for incoming packets for a random interval of 1-4 ms
+ *  between sending packets.  The length of that interval and the number of
+ *  packets that can be sent back-to-back before it (a burst) are configurable,
+ *  see radioQueueTxBurstSize, radioQueueTxListenTime, and radioQueueTxBackoffMask.
  *
  *  This layer defines the RF packet memory buffers used, and controls access to
  *  those buffers.
@@ -14,11 +16,55 @@
  *  Radio_queue is essentially a stripped-down version of the radio_link
  *  library, so radio_link is a good alternative if you want a more specialized
  *  implementation with more features.
+ *
+ *  When radioQueueAggregation is 1, each RF packet is an aggregate frame that
+ *  holds one or more messages.  Each message has the same format as a normal
+ *  packet (a length byte followed by the data), and the messages are simply
+ *  placed one after the other in the payload of the frame.  On the TX side,
+ *  the main loop builds the frame in the TX buffer at radioQueueTxMainLoopIndex
+ *  and only hands it to the ISR when it is full or when the aggregation window
+ *  expires.  On the RX side, the main loop walks through the messages in the
+ *  frame at radioQueueRxMainLoopIndex without copying them.
+ *
+ *  When radioQueueAddressing is 1, every RF packet has a three-byte header
+ *  after the length byte:
+ *    Byte 1: Destination address (RADIO_QUEUE_BROADCAST_ADDRESS for broadcasts).
+ *    Byte 2: Source address.
+ *    Byte 3: Bit 7:    1 if this is an ACK packet.
+ *            Bit 6:    1 if the sender wants an ACK for this packet.
+ *            Bits 5-0: Sequence number.
+ *  The destination address is in the same place that the radio's hardware
+ *  address filter (PKTCTRL1.ADR_CHK) expects it.  We do not enable that filter
+ *  though, because a packet rejected by it is dropped after its first bytes
+ *  have already been read by the radio DMA channel, and radio_mac assumes that
+ *  every packet that starts arriving finishes with a RADIO_MAC_EVENT_RX.
+ *  Instead, the address is checked in the ISR.
+ *
+ *  The higher-level code does not see the header: the packet pointers we give
+ *  it point to the last header byte, which we use as the length byte of the
+ *  payload (the same trick radio_link.c uses for its one-byte header).
+ *
+ *  A unicast packet is kept at the head of the TX queue until an ACK with the
+ *  same sequence number comes back from the destination, or until it has been
+ *  retransmitted radioQueueTxRetries times.  The receiver remembers the source and
+ *  sequence number of the last packet it acknowledged so that it does not pass a
+ *  retransmitted packet to the main loop twice.
+ *
+ *  Broadcasts do not use the sequence number, and unicast sequence numbers are
+ *  counted separately for each destination (destinations with the same lower 4
+ *  bits share a counter), so the next unicast to a Wixel only has the same
+ *  sequence number as the last one after 64 more unicasts to that group of
+ *  destinations.  The receiver also forgets the last packet it acknowledged
+ *  once a retransmission of it can no longer arrive (see rxDuplicateWindow), so
+ *  a new packet that happens to reuse the sequence number later is not
+ *  mistaken for a retransmission.
  */
 
 #include <radio_queue.h>
 #include <radio_registers.h>
 #include <random.h>
+#include <time.h>
+#include <board.h>
 
 /* PARAMETERS *****************************************************************/
 
@@ -62,16 +108,93 @@ static volatile uint8 DATA radioQueueTxInterruptIndex = 0;  // The index of the
 
 BIT radioQueueAllowCrcErrors = 0;
 
+/* BURST VARIABLES ************************************************************/
+
+uint8 radioQueueTxBurstSize = 1;
+uint8 radioQueueTxListenTime = 1;
+uint8 radioQueueTxBackoffMask = 3;
+
+// The number of packets sent since the last time we listened.
+static uint8 DATA txBurstCount = 0;
+
+/* AGGREGATION VARIABLES ******************************************************/
+
+BIT radioQueueAggregation = 0;
+uint8 radioQueueTxAggregationWindow = 2;
+
+// The main loop writes each message here and radioQueueTxSendPacket copies it
+// into the frame being built.
+static uint8 XDATA radioQueueTxMessage[1 + RADIO_MAX_PACKET_SIZE];
+
+static BIT txFrameOpen = 0;         // 1 iff the TX buffer at radioQueueTxMainLoopIndex holds a frame being built.
+static uint8 DATA txFrameOpenTime;  // Lower 8 bits of getMs() when the first message was put in the frame.
+
+// The offset (from the first payload byte) of the current message in the RX
+// frame at radioQueueRxMainLoopIndex.
+static uint8 DATA rxMessageOffset = 0;
+
+/* ADDRESSING VARIABLES *******************************************************/
+
+#define ADDRESS_HEADER_LENGTH 3
+#define ADDRESS_DESTINATION_OFFSET 1
+#define ADDRESS_SOURCE_OFFSET      2
+#define ADDRESS_CONTROL_OFFSET     3
+
+#define CONTROL_ACK            0x80
+#define CONTROL_ACK_REQUEST    0x40
+#define CONTROL_SEQUENCE_MASK  0x3F
+
+BIT radioQueueAddressing = 0;
+uint8 radioQueueAddress = 0;
+uint8 radioQueueTxRetries = 3;
+uint8 radioQueueAckTimeout = 2;
+volatile uint8 radioQueueTxNoAckCount = 0;
+
+// The sequence number of the next unicast packet to each group of destinations.
+#define TX_SEQUENCE_COUNT 16    // Must be a power of two.
+static uint8 XDATA txSequence[TX_SEQUENCE_COUNT];
+
+static uint8 XDATA ackPacket[1 + ADDRESS_HEADER_LENGTH];
+
+static volatile BIT txSendingAck = 0;   // 1 iff the radio is transmitting ackPacket.
+static volatile BIT txAwaitingAck = 0;  // 1 iff we sent the packet at the head of the TX queue and are listening for its ACK.
+static uint8 DATA txRetryCount = 0;     // The number of times the packet at the head of the TX queue has been retransmitted.
+
+// The source address and sequence number of the last packet we acknowledged,
+// and the last time (see getMsFromIsr) we received it.  The source address is
+// never RADIO_QUEUE_BROADCAST_ADDRESS, so nothing matches at first.
+static uint8 rxLastSource = RADIO_QUEUE_BROADCAST_ADDRESS;
+static uint8 rxLastSequence = 0;
+static uint32 rxLastMs;
+
 /* GENERAL FUNCTIONS **********************************************************/
 
 void radioQueueInit()
 {
     randomSeedFromSerialNumber();
 
+    if (radioQueueAddressing)
+    {
+        // The two packet formats can not be combined, so addressing wins.
+        radioQueueAggregation = 0;
+    }
+
     PKTLEN = RADIO_MAX_PACKET_SIZE;
     CHANNR = param_radio_channel;
 
+    if (radioQueueAddress == RADIO_QUEUE_BROADCAST_ADDRESS)
+    {
+        // The higher-level code did not choose an address, so make one from
+        // the serial number.
+        radioQueueAddress = serialNumber[0] ? serialNumber[0] : 1;
+    }
+
     radioMacInit();
+
+    // radioRegistersInit leaves the address check off (PKTCTRL1.ADR_CHK = 00), and
+    // we keep it that way (see the comment at the top of this file), but we put our
+    // address in ADDR anyway so it is visible to debugging tools.
+    ADDR = radioQueueAddress;
     radioMacStrobe();
 }
 
@@ -79,7 +202,10 @@ void radioQueueInit()
 // This is used to decide when to next transmit a queued data packet.
 static uint8 randomTxDelay()
 {
-    return 1 + (randomNumber() & 3);
+    uint8 delay = radioQueueTxListenTime + (randomNumber() & radioQueueTxBackoffMask);
+
+    // A timeout of 0 would mean "listen forever" to radioMacRx.
+    return delay ? delay : 1;
 }
 
 /* TX FUNCTIONS (called by higher-level code in main loop) ********************/
@@ -97,15 +223,32 @@ uint8 radioQueueTxQueued(void)
 
 uint8 XDATA * radioQueueTxCurrentPacket()
 {
+    if (radioQueueAggregation && !radioQueueAddressing)
+    {
+        // If there is a frame being built, we need another free buffer in case
+        // the next message does not fit in the frame.
+        if (radioQueueTxAvailable() < (txFrameOpen ? 2 : 1))
+        {
+            return 0;
+        }
+        return radioQueueTxMessage;
+    }
+
     if (!radioQueueTxAvailable())
     {
         return 0;
     }
 
+    if (radioQueueAddressing)
+    {
+        return radioQueueTxPacket[radioQueueTxMainLoopIndex] + ADDRESS_HEADER_LENGTH;
+    }
+
     return radioQueueTxPacket[radioQueueTxMainLoopIndex];
 }
 
-void radioQueueTxSendPacket(void)
+// Gives ownership of the TX packet at radioQueueTxMainLoopIndex to the ISR.
+static void txCommitPacket(void)
 {
     // Update our index of which packet to populate in the main loop.
     if (radioQueueTxMainLoopIndex == TX_PACKET_COUNT - 1)
@@ -122,19 +265,108 @@ void radioQueueTxSendPacket(void)
     radioMacStrobe();
 }
 
-/* RX FUNCTIONS (called by higher-level code in main loop) ********************/
+// Adds the message in radioQueueTxMessage to the frame being built,
+// starting a new frame if necessary.
+static void txAggregateMessage(void)
+{
+    uint8 XDATA * frame;
+    uint8 messageSize;
+    uint8 i;
 
-uint8 XDATA * radioQueueRxCurrentPacket(void)
+    // A message with a longer payload would not fit in a frame, even by itself,
+    // so truncate it.
+    if (radioQueueTxMessage[0] > RADIO_QUEUE_PAYLOAD_SIZE - 1)
+    {
+        radioQueueTxMessage[0] = RADIO_QUEUE_PAYLOAD_SIZE - 1;
+    }
+    messageSize = 1 + radioQueueTxMessage[0];
+
+    if (txFrameOpen && radioQueueTxPacket[radioQueueTxMainLoopIndex][0] + messageSize > RADIO_QUEUE_PAYLOAD_SIZE)
+    {
+        // The message does not fit in the current frame, so send the frame now.
+        txCommitPacket();
+        txFrameOpen = 0;
+    }
+
+    frame = radioQueueTxPacket[radioQueueTxMainLoopIndex];
+
+    if (!txFrameOpen)
+    {
+        frame[0] = 0;
+        txFrameOpen = 1;
+        txFrameOpenTime = getMs();
+    }
+
+    for (i = 0; i < messageSize; i++)
+    {
+        frame[1 + frame[0] + i] = radioQueueTxMessage[i];
+    }
+    frame[0] += messageSize;
+
+    if (frame[0] >= RADIO_QUEUE_PAYLOAD_SIZE - 1)
+    {
+        // There is no room for another message (even an empty one), so send the frame now.
+        txCommitPacket();
+        txFrameOpen = 0;
+    }
+}
+
+// Fills in the address header of the packet at radioQueueTxMainLoopIndex.
+static void txAddressPacket(uint8 destination)
+{
+    uint8 XDATA * packet = radioQueueTxPacket[radioQueueTxMainLoopIndex];
+    uint8 control = 0;
+
+    if (destination != RADIO_QUEUE_BROADCAST_ADDRESS)
+    {
+        uint8 XDATA * sequence = &txSequence[destination & (TX_SEQUENCE_COUNT - 1)];
+        control = CONTROL_ACK_REQUEST | (*sequence & CONTROL_SEQUENCE_MASK);
+        (*sequence)++;
+    }
+
+    // The higher-level code wrote the payload length where the control byte goes.
+    packet[0] = packet[ADDRESS_CONTROL_OFFSET] + ADDRESS_HEADER_LENGTH;
+    packet[ADDRESS_DESTINATION_OFFSET] = destination;
+    packet[ADDRESS_SOURCE_OFFSET] = radioQueueAddress;
+    packet[ADDRESS_CONTROL_OFFSET] = control;
+}
+
+void radioQueueTxSendPacket(void)
 {
-    if (radioQueueRxMainLoopIndex == radioQueueRxInterruptIndex)
+    if (radioQueueAddressing)
     {
-        return 0;
+        txAddressPacket(RADIO_QUEUE_BROADCAST_ADDRESS);
     }
-    return radioQueueRxPacket[radioQueueRxMainLoopIndex];
+    else if (radioQueueAggregation)
+    {
+        txAggregateMessage();
+        return;
+    }
+
+    txCommitPacket();
 }
 
-void radioQueueRxDoneWithPacket(void)
+void radioQueueTxSendPacketTo(uint8 address)
+{
+    txAddressPacket(address);
+    txCommitPacket();
+}
+
+void radioQueueTxService(void)
+{
+    if (txFrameOpen && (uint8)((uint8)getMs() - txFrameOpenTime) >= radioQueueTxAggregationWindow)
+    {
+        txCommitPacket();
+        txFrameOpen = 0;
+    }
+}
+
+/* RX FUNCTIONS (called by higher-level code in main loop) ********************/
+
+static void rxDoneWithFrame(void)
 {
+    rxMessageOffset = 0;
+
     if (radioQueueRxMainLoopIndex == RX_PACKET_COUNT - 1)
     {
         radioQueueRxMainLoopIndex = 0;
@@ -145,8 +377,128 @@ void radioQueueRxDoneWithPacket(void)
     }
 }
 
+uint8 XDATA * radioQueueRxCurrentPacket(void)
+{
+    uint8 XDATA * frame;
+
+    if (!radioQueueAggregation)
+    {
+        if (radioQueueRxMainLoopIndex == radioQueueRxInterruptIndex)
+        {
+            return 0;
+        }
+        if (radioQueueAddressing)
+        {
+            // The ISR replaced the last header byte with the payload length.
+            return radioQueueRxPacket[radioQueueRxMainLoopIndex] + ADDRESS_HEADER_LENGTH;
+        }
+        return radioQueueRxPacket[radioQueueRxMainLoopIndex];
+    }
+
+    while (radioQueueRxMainLoopIndex != radioQueueRxInterruptIndex)
+    {
+        frame = radioQueueRxPacket[radioQueueRxMainLoopIndex];
+
+        if (rxMessageOffset + 1 + frame[1 + rxMessageOffset] <= frame[0])
+        {
+            // The current message fits in the frame, so return it.
+            return frame + 1 + rxMessageOffset;
+        }
+
+        // The frame is malformed (probably because it was not sent by a Wixel that
+        // is using aggregation), so discard the rest of it.
+        rxDoneWithFrame();
+    }
+
+    return 0;
+}
+
+uint8 radioQueueRxCurrentSource(void)
+{
+    return radioQueueRxPacket[radioQueueRxMainLoopIndex][ADDRESS_SOURCE_OFFSET];
+}
+
+void radioQueueRxDoneWithPacket(void)
+{
+    if (radioQueueAggregation)
+    {
+        uint8 XDATA * frame = radioQueueRxPacket[radioQueueRxMainLoopIndex];
+
+        // Advance to the next message in the frame.
+        rxMessageOffset += 1 + frame[1 + rxMessageOffset];
+        if (rxMessageOffset < frame[0])
+        {
+            return;
+        }
+    }
+
+    rxDoneWithFrame();
+}
+
 /* FUNCTIONS CALLED IN RF_ISR *************************************************/
 
+// Gives ownership of the packet at the head of the TX queue back to the main loop.
+static void txDoneWithPacket()
+{
+    if (radioQueueTxInterruptIndex == TX_PACKET_COUNT - 1)
+    {
+        radioQueueTxInterruptIndex = 0;
+    }
+    else
+    {
+        radioQueueTxInterruptIndex++;
+    }
+    txRetryCount = 0;
+}
+
+// Tries to pass the packet that was just received to the main loop.
+// Returns 1 if successful, or 0 if the main loop owns all the other RX buffers.
+static BIT rxGiveToMainLoop()
+{
+    uint8 nextradioQueueRxInterruptIndex;
+
+    if (radioQueueRxInterruptIndex == RX_PACKET_COUNT - 1)
+    {
+        nextradioQueueRxInterruptIndex = 0;
+    }
+    else
+    {
+        nextradioQueueRxInterruptIndex = radioQueueRxInterruptIndex + 1;
+    }
+
+    if (nextradioQueueRxInterruptIndex == radioQueueRxMainLoopIndex)
+    {
+        return 0;
+    }
+
+    radioQueueRxInterruptIndex = nextradioQueueRxInterruptIndex;
+    return 1;
+}
+
+// Returns the RX timeout to use while waiting for an ACK.
+static uint8 ackTimeout()
+{
+    // A timeout of 0 would mean "listen forever" to radioMacRx.
+    return radioQueueAckTimeout ? radioQueueAckTimeout : 1;
+}
+
+// Called when we were waiting for an ACK and it did not arrive.
+static void txNoAck()
+{
+    txAwaitingAck = 0;
+
+    if (txRetryCount >= radioQueueTxRetries)
+    {
+        // We are out of retries, so give up on this packet.
+        txDoneWithPacket();
+        radioQueueTxNoAckCount++;
+    }
+    else
+    {
+        txRetryCount++;
+    }
+}
+
 static void takeInitiative()
 {
     if (radioQueueTxInterruptIndex != radioQueueTxMainLoopIndex)
@@ -160,26 +512,175 @@ static void takeInitiative()
     }
 }
 
+// Decides what to do after receiving a packet.
+static void rxFinished()
+{
+    if (txAwaitingAck)
+    {
+        // The packet was not the ACK we are waiting for (it might have been
+        // sent by a Wixel that is talking to someone else), so keep listening
+        // for the ACK.  Only an RX timeout counts as a failed attempt.
+        radioMacRx(radioQueueRxPacket[radioQueueRxInterruptIndex], ackTimeout());
+    }
+    else
+    {
+        takeInitiative();
+    }
+}
+
+// Decides what to do after listening without receiving a packet.
+static void rxTimedOut()
+{
+    if (txAwaitingAck)
+    {
+        // We did not get the ACK we were waiting for, so wait a random amount of
+        // time before retransmitting to avoid colliding with the same sender again.
+        txNoAck();
+        radioMacRx(radioQueueRxPacket[radioQueueRxInterruptIndex], randomTxDelay());
+    }
+    else
+    {
+        takeInitiative();
+    }
+}
+
+// Returns the number of milliseconds after we receive a unicast packet during
+// which the sender might still retransmit it: one ACK timeout and one random
+// TX delay (plus 1 ms for the packets themselves) for each attempt.  Both are
+// in units of 0.922 ms, so this is a little longer than necessary.
+static uint32 rxDuplicateWindow()
+{
+    return (uint32)(radioQueueTxRetries + 1) * (ackTimeout() + radioQueueTxListenTime + radioQueueTxBackoffMask + 1);
+}
+
+static void rxAddressedPacket(uint8 XDATA * packet)
+{
+    uint8 control = packet[ADDRESS_CONTROL_OFFSET];
+    uint8 source = packet[ADDRESS_SOURCE_OFFSET];
+    uint8 sequence = control & CONTROL_SEQUENCE_MASK;
+    uint8 ticks;
+    uint32 ms;
+    BIT accepted = 1;
+
+    if (packet[RADIO_QUEUE_PACKET_LENGTH_OFFSET] < ADDRESS_HEADER_LENGTH ||
+        (packet[ADDRESS_DESTINATION_OFFSET] != radioQueueAddress &&
+         packet[ADDRESS_DESTINATION_OFFSET] != RADIO_QUEUE_BROADCAST_ADDRESS))
+    {
+        // This packet is not for us.
+        rxFinished();
+        return;
+    }
+
+    if (control & CONTROL_ACK)
+    {
+        uint8 XDATA * txPacket = radioQueueTxPacket[radioQueueTxInterruptIndex];
+
+        if (txAwaitingAck && source == txPacket[ADDRESS_DESTINATION_OFFSET] &&
+            sequence == (txPacket[ADDRESS_CONTROL_OFFSET] & CONTROL_SEQUENCE_MASK))
+        {
+            // This is the ACK we were waiting for.
+            txAwaitingAck = 0;
+            txDoneWithPacket();
+        }
+        rxFinished();
+        return;
+    }
+
+    ticks = T4CNT;
+    ms = getMsFromIsr(ticks);
+
+    if ((control & CONTROL_ACK_REQUEST) && source == rxLastSource && sequence == rxLastSequence &&
+        ms - rxLastMs <= rxDuplicateWindow())
+    {
+        // This is a retransmission of a packet we already received (our ACK was
+        // lost), so we will ACK it again but not give it to the main loop.
+        // Each retransmission starts the window over.
+    }
+    else
+    {
+        // Replace the last header byte with the payload length that will be
+        // read by the higher-level code.
+        packet[ADDRESS_CONTROL_OFFSET] = packet[RADIO_QUEUE_PACKET_LENGTH_OFFSET] - ADDRESS_HEADER_LENGTH;
+
+        // If the main loop can not take the packet, we do not ACK it so the
+        // sender will try again later.
+        accepted = rxGiveToMainLoop();
+    }
+
+    if ((control & CONTROL_ACK_REQUEST) && accepted)
+    {
+        rxLastSource = source;
+        rxLastSequence = sequence;
+        rxLastMs = ms;
+
+        ackPacket[RADIO_QUEUE_PACKET_LENGTH_OFFSET] = ADDRESS_HEADER_LENGTH;
+        ackPacket[ADDRESS_DESTINATION_OFFSET] = source;
+        ackPacket[ADDRESS_SOURCE_OFFSET] = radioQueueAddress;
+        ackPacket[ADDRESS_CONTROL_OFFSET] = CONTROL_ACK | sequence;
+        txSendingAck = 1;
+        radioMacTx(ackPacket);
+        return;
+    }
+
+    rxFinished();
+}
+
 void radioMacEventHandler(uint8 event) // called by the MAC in an ISR
 {
     if (event == RADIO_MAC_EVENT_STROBE)
     {
+        if (txAwaitingAck)
+        {
+            // Keep listening for the ACK.
+            radioMacRx(radioQueueRxPacket[radioQueueRxInterruptIndex], ackTimeout());
+            return;
+        }
+
         takeInitiative();
         return;
     }
     else if (event == RADIO_MAC_EVENT_TX)
     {
-        // Give ownership of the current TX packet back to the main loop by updated radioQueueTxInterruptIndex.
-        if (radioQueueTxInterruptIndex == TX_PACKET_COUNT - 1)
+        if (txSendingAck)
+        {
+            // We just sent an ACK for a packet we received.
+            txSendingAck = 0;
+            if (txAwaitingAck)
+            {
+                radioMacRx(radioQueueRxPacket[radioQueueRxInterruptIndex], ackTimeout());
+            }
+            else
+            {
+                takeInitiative();
+            }
+            return;
+        }
+
+        if (radioQueueAddressing && (radioQueueTxPacket[radioQueueTxInterruptIndex][ADDRESS_CONTROL_OFFSET] & CONTROL_ACK_REQUEST))
         {
-            radioQueueTxInterruptIndex = 0;
+            // We just sent a unicast packet, so listen for the ACK.  The packet
+            // stays at the head of the queue until the ACK arrives or we give up.
+            txAwaitingAck = 1;
+            txBurstCount = 0;
+            radioMacRx(radioQueueRxPacket[radioQueueRxInterruptIndex], ackTimeout());
+            return;
         }
-        else
+
+        // Give ownership of the current TX packet back to the main loop by updated radioQueueTxInterruptIndex.
+        txDoneWithPacket();
+
+        txBurstCount++;
+        if (txBurstCount < radioQueueTxBurstSize && radioQueueTxInterruptIndex != radioQueueTxMainLoopIndex)
         {
-            radioQueueTxInterruptIndex++;
+            // We are in the middle of a burst and there is another packet queued,
+            // so send it right away.  The radio is already in FSTXON, so this
+            // is much faster than going through RX.
+            radioMacTx(radioQueueTxPacket[radioQueueTxInterruptIndex]);
+            return;
         }
 
-        // We sent a packet, so now let's give another party a chance to talk.
+        // We sent a packet (or a burst of packets), so now let's give another party a chance to talk.
+        txBurstCount = 0;
         radioMacRx(radioQueueRxPacket[radioQueueRxInterruptIndex], randomTxDelay());
         return;
     }
@@ -189,6 +690,15 @@ void radioMacEventHandler(uint8 event) // called by the MAC in an ISR
 
         if (!radioQueueAllowCrcErrors && !radioCrcPassed())
         {
+            if (txAwaitingAck)
+            {
+                // The corrupted packet might have been our ACK, but the
+                // destination might also still be about to send it, so keep
+                // listening until the ACK timeout expires.
+                radioMacRx(currentRxPacket, ackTimeout());
+                return;
+            }
+
             if (radioQueueTxInterruptIndex != radioQueueTxMainLoopIndex)
             {
                 radioMacRx(currentRxPacket, randomTxDelay());
@@ -200,27 +710,17 @@ void radioMacEventHandler(uint8 event) // called by the MAC in an ISR
             return;
         }
 
+        if (radioQueueAddressing)
+        {
+            rxAddressedPacket(currentRxPacket);
+            return;
+        }
+
         if (currentRxPacket[RADIO_QUEUE_PACKET_LENGTH_OFFSET] > 0)
         {
             // We received a packet that contains actual data.
-
-            uint8 nextradioQueueRxInterruptIndex;
-
-            // See if we can give the data to the main loop.
-            if (radioQueueRxInterruptIndex == RX_PACKET_COUNT - 1)
-            {
-                nextradioQueueRxInterruptIndex = 0;
-            }
-            else
-            {
-                nextradioQueueRxInterruptIndex = radioQueueRxInterruptIndex + 1;
-            }
-
-            if (nextradioQueueRxInterruptIndex != radioQueueRxMainLoopIndex)
-            {
-                // We can accept this packet!
-                radioQueueRxInterruptIndex = nextradioQueueRxInterruptIndex;
-            }
+            // If the main loop already owns all the other buffers, we discard it.
+            rxGiveToMainLoop();
         }
 
         takeInitiative();
@@ -228,7 +728,7 @@ void radioMacEventHandler(uint8 event) // called by the MAC in an ISR
     }
     else if (event == RADIO_MAC_EVENT_RX_TIMEOUT)
     {
-        takeInitiative();
+        rxTimedOut();
         return;
     }
 }
@@ -0,0 +1,495 @@
+/* radio_tree.c:
+ *  This layer builds on top of radio_queue.c (with addressing enabled) to
+ *  route data packets up a tree toward a sink.  See radio_tree.h for an overview.
+ *
+ *  The payload of each radio_queue packet sent by this layer starts with a
+ *  type byte:
+ *    Bits 7-6: Packet type (PACKET_TYPE_BEACON or PACKET_TYPE_DATA).
+ *    Bits 3-0: Number of hops a data packet has been forwarded.
+ *
+ *  Beacon (broadcast):
+ *    Byte 1:  Type.
+ *    Byte 2:  Cost of the sender.
+ *    Byte 3:  Address of the sender's parent (0 if none).
+ *
+ *  Data (unicast to the parent):
+ *    Byte 1:  Type and hop count.
+ *    Byte 2:  Address of the Wixel that created the packet (the origin).
+ *    Byte 3:  Cost of the Wixel that sent (or forwarded) the packet.
+ *    Bytes 4+: Data.
+ *
+ *  As in radio_flood.c, the packet pointers given to the higher-level code point
+ *  to byte 3, which we use as the payload length byte.
+ */
+
+#include <radio_tree.h>
+#include <radio_registers.h>
+#include <time.h>
+
+#define HEADER_LENGTH  3
+#define TYPE_OFFSET    1
+#define ORIGIN_OFFSET  2
+#define COST_OFFSET    3
+#define BEACON_COST_OFFSET    2
+#define BEACON_PARENT_OFFSET  3
+
+#define PACKET_TYPE_MASK    0xC0
+#define PACKET_TYPE_BEACON  0x40
+#define PACKET_TYPE_DATA    0x80
+#define HOPS_MASK           0x0F
+
+// Link cost penalties.  See linkCost().
+#define WEAK_RSSI        -80   // dBm
+#define MARGINAL_RSSI    -70   // dBm
+#define LOW_LQI          32
+#define MAX_FAILURES     4     // After this many unacknowledged packets, the parent is abandoned.
+
+// A new route must be cheaper than the current one by this much before we switch parents.
+#define PARENT_SWITCH_THRESHOLD  2
+
+BIT radioTreeSink = 0;
+uint16 radioTreeBeaconInterval = 1000;
+
+uint16 radioTreeForwardedCount = 0;
+uint16 radioTreeDropCount = 0;
+uint16 radioTreeLoopCount = 0;
+uint16 radioTreeParentChangeCount = 0;
+
+static uint8 parent = 0;      // Address of our parent, or 0 if we have none.
+static uint8 cost = RADIO_TREE_NO_ROUTE;
+
+static uint16 lastBeaconTime;
+static BIT beaconSoon = 1;    // 1 iff we should send a beacon as soon as possible.
+
+static uint8 lastNoAckCount = 0;  // The last value of radioQueueTxNoAckCount that we saw.
+
+// 1 iff the current radio_queue RX packet is a data packet waiting for the
+// higher-level code on the sink.
+static BIT rxReady = 0;
+
+/* NEIGHBOR TABLE *************************************************************/
+
+#define NEIGHBOR_COUNT 8
+
+typedef struct NEIGHBOR
+{
+    uint8 address;     // 0 if this entry is not used.
+    uint8 cost;        // The cost in the neighbor's last beacon.
+    uint8 parent;      // The parent in the neighbor's last beacon.
+    int8 rssi;         // Smoothed signal strength of the neighbor's beacons, in dBm.
+    uint8 lqi;         // Smoothed link quality of the neighbor's beacons.
+    uint8 failures;    // Recent packets the neighbor failed to acknowledge.
+    uint16 lastHeard;  // Lower 16 bits of getMs() when we last received a beacon.
+} NEIGHBOR;
+
+static NEIGHBOR XDATA neighbors[NEIGHBOR_COUNT];
+
+static BIT neighborStale(NEIGHBOR XDATA * n)
+{
+    return (uint16)((uint16)getMs() - n->lastHeard) > 4 * radioTreeBeaconInterval;
+}
+
+static NEIGHBOR XDATA * neighborFind(uint8 address)
+{
+    uint8 i;
+    for (i = 0; i < NEIGHBOR_COUNT; i++)
+    {
+        if (neighbors[i].address == address)
+        {
+            return &neighbors[i];
+        }
+    }
+    return 0;
+}
+
+// Returns the entry to use for a newly-heard neighbor: an unused or stale
+// entry if there is one, or else the most expensive neighbor other than our parent.
+static NEIGHBOR XDATA * neighborAllocate(void)
+{
+    uint8 i;
+    NEIGHBOR XDATA * worst = 0;
+
+    for (i = 0; i < NEIGHBOR_COUNT; i++)
+    {
+        NEIGHBOR XDATA * n = &neighbors[i];
+
+        if (n->address == 0 || neighborStale(n))
+        {
+            return n;
+        }
+
+        if (n->address != parent && (worst == 0 || n->cost > worst->cost))
+        {
+            worst = n;
+        }
+    }
+    return worst;
+}
+
+static uint8 linkCost(NEIGHBOR XDATA * n)
+{
+    uint8 c = 1 + n->failures;
+
+    if (n->rssi < WEAK_RSSI)
+    {
+        c += 2;
+    }
+    else if (n->rssi < MARGINAL_RSSI)
+    {
+        c += 1;
+    }
+
+    if (n->lqi < LOW_LQI)
+    {
+        c += 1;
+    }
+
+    return c;
+}
+
+// Returns the cost of the route to the sink through the specified neighbor,
+// or RADIO_TREE_NO_ROUTE if that neighbor can not be our parent.
+static uint8 routeCost(NEIGHBOR XDATA * n)
+{
+    uint16 c;
+
+    if (n->address == 0 || neighborStale(n) || n->failures >= MAX_FAILURES ||
+        n->parent == radioQueueAddress)  // Choosing a child as our parent would make a loop.
+    {
+        return RADIO_TREE_NO_ROUTE;
+    }
+
+    c = n->cost + linkCost(n);
+    return c >= RADIO_TREE_NO_ROUTE ? RADIO_TREE_NO_ROUTE : c;
+}
+
+static void chooseParent(void)
+{
+    uint8 i;
+    uint8 bestCost = RADIO_TREE_NO_ROUTE;
+    uint8 bestAddress = 0;
+    uint8 currentCost = RADIO_TREE_NO_ROUTE;
+    uint8 oldCost = cost;
+
+    if (radioTreeSink)
+    {
+        return;
+    }
+
+    for (i = 0; i < NEIGHBOR_COUNT; i++)
+    {
+        uint8 c = routeCost(&neighbors[i]);
+
+        if (neighbors[i].address == parent)
+        {
+            currentCost = c;
+        }
+
+        if (c < bestCost)
+        {
+            bestCost = c;
+            bestAddress = neighbors[i].address;
+        }
+    }
+
+    if (currentCost == RADIO_TREE_NO_ROUTE || bestCost + PARENT_SWITCH_THRESHOLD <= currentCost)
+    {
+        if (bestAddress != parent)
+        {
+            parent = bestAddress;
+            radioTreeParentChangeCount++;
+        }
+        cost = bestCost;
+    }
+    else
+    {
+        cost = currentCost;
+    }
+
+    if (cost != oldCost)
+    {
+        // Let our neighbors know about the change right away.
+        beaconSoon = 1;
+    }
+}
+
+/* GENERAL FUNCTIONS **********************************************************/
+
+void radioTreeInit(void)
+{
+    uint8 i;
+
+    radioQueueAddressing = 1;
+    radioQueueInit();
+
+    for (i = 0; i < NEIGHBOR_COUNT; i++)
+    {
+        neighbors[i].address = 0;
+    }
+
+    if (radioTreeSink)
+    {
+        cost = 0;
+    }
+}
+
+BIT radioTreeConnected(void)
+{
+    return cost != RADIO_TREE_NO_ROUTE;
+}
+
+uint8 radioTreeParent(void)
+{
+    return parent;
+}
+
+uint8 radioTreeCost(void)
+{
+    return cost;
+}
+
+static void rxBeacon(uint8 XDATA * packet)
+{
+    NEIGHBOR XDATA * n;
+    uint8 source = radioQueueRxCurrentSource();
+    int8 rssi;
+    uint8 lqi;
+
+    if (packet[0] < HEADER_LENGTH)
+    {
+        return;
+    }
+
+    // The radio appends the RSSI and LQI bytes after the payload.
+    // These are converted the same way as in radioRssi() and radioLqi().
+    rssi = ((int8)packet[1 + packet[0]])/2 - RSSI_OFFSET;
+    lqi = packet[2 + packet[0]] & 0x7F;
+
+    n = neighborFind(source);
+    if (n == 0)
+    {
+        n = neighborAllocate();
+        if (n == 0)
+        {
+            return;
+        }
+    }
+
+    if (n->address != source || neighborStale(n))
+    {
+        // This is a new neighbor (or one we have not heard from in a long time).
+        n->address = source;
+        n->rssi = rssi;
+        n->lqi = lqi;
+        n->failures = 0;
+    }
+    else
+    {
+        // Smooth the signal measurements so one bad packet does not change our route.
+        n->rssi = (n->rssi + rssi) / 2;
+        n->lqi = (n->lqi + lqi) / 2;
+
+        // Hearing the beacon means the link works in at least one direction,
+        // so forgive one failure.
+        if (n->failures)
+        {
+            n->failures--;
+        }
+    }
+
+    n->cost = packet[BEACON_COST_OFFSET];
+    n->parent = packet[BEACON_PARENT_OFFSET];
+    n->lastHeard = getMs();
+
+    chooseParent();
+}
+
+static void checkForLoop(uint8 XDATA * packet)
+{
+    if (cost != RADIO_TREE_NO_ROUTE && packet[COST_OFFSET] <= cost)
+    {
+        // Costs always decrease toward the sink, so the packet should have come
+        // from a Wixel with a higher cost than ours.  There might be a loop,
+        // so tell our neighbors our cost right away.
+        radioTreeLoopCount++;
+        beaconSoon = 1;
+    }
+}
+
+// Handles a received data packet.  Returns 0 if the packet can not be
+// processed yet and should be left in the RX queue.
+static BIT rxData(uint8 XDATA * packet)
+{
+    uint8 XDATA * txPacket;
+    uint8 i;
+
+    if (packet[0] < HEADER_LENGTH)
+    {
+        return 1;
+    }
+
+    if (radioTreeSink)
+    {
+        checkForLoop(packet);
+
+        // Replace the cost with the payload length that will be read by the
+        // higher-level code.
+        packet[COST_OFFSET] = packet[0] - HEADER_LENGTH;
+        rxReady = 1;
+        return 0;
+    }
+
+    if (parent == 0 || (packet[TYPE_OFFSET] & HOPS_MASK) >= RADIO_TREE_MAX_HOPS)
+    {
+        radioTreeDropCount++;
+        return 1;
+    }
+
+    if (!(txPacket = radioQueueTxCurrentPacket()))
+    {
+        // The TX queue is full.  Leave the packet in the RX queue; when the RX
+        // queue fills up, radio_queue will stop acknowledging packets from our
+        // children, so they will hold their packets and retry later.
+        return 0;
+    }
+
+    checkForLoop(packet);
+
+    for (i = 0; i <= packet[0]; i++)
+    {
+        txPacket[i] = packet[i];
+    }
+    txPacket[TYPE_OFFSET]++;   // Increment the hop count.
+    txPacket[COST_OFFSET] = cost;
+    radioQueueTxSendPacketTo(parent);
+    radioTreeForwardedCount++;
+    return 1;
+}
+
+static void receiveMorePackets(void)
+{
+    uint8 XDATA * packet;
+
+    while (!rxReady && (packet = radioQueueRxCurrentPacket()))
+    {
+        if (packet[0] == 0)
+        {
+            radioQueueRxDoneWithPacket();
+            continue;
+        }
+
+        switch (packet[TYPE_OFFSET] & PACKET_TYPE_MASK)
+        {
+        case PACKET_TYPE_BEACON:
+            rxBeacon(packet);
+            break;
+
+        case PACKET_TYPE_DATA:
+            if (!rxData(packet))
+            {
+                return;
+            }
+            break;
+        }
+
+        radioQueueRxDoneWithPacket();
+    }
+}
+
+static void beaconService(void)
+{
+    uint8 XDATA * packet;
+
+    if (!beaconSoon && (uint16)((uint16)getMs() - lastBeaconTime) < radioTreeBeaconInterval)
+    {
+        return;
+    }
+
+    if (packet = radioQueueTxCurrentPacket())
+    {
+        packet[0] = HEADER_LENGTH;
+        packet[TYPE_OFFSET] = PACKET_TYPE_BEACON;
+        packet[BEACON_COST_OFFSET] = cost;
+        packet[BEACON_PARENT_OFFSET] = parent;
+        radioQueueTxSendPacket();
+
+        lastBeaconTime = getMs();
+        beaconSoon = 0;
+    }
+}
+
+void radioTreeService(void)
+{
+    uint8 noAckCount = radioQueueTxNoAckCount;
+
+    if (noAckCount != lastNoAckCount)
+    {
+        // Some of our unicast packets were not acknowledged.  We only send
+        // unicast packets to our parent, so blame the parent.
+        NEIGHBOR XDATA * n = neighborFind(parent);
+        if (n != 0)
+        {
+            n->failures += (uint8)(noAckCount - lastNoAckCount);
+            if (n->failures > MAX_FAILURES)
+            {
+                n->failures = MAX_FAILURES;
+            }
+        }
+        lastNoAckCount = noAckCount;
+    }
+
+    // Neighbors can go stale and failures can accumulate, so re-evaluate the
+    // route regularly and not only when a beacon arrives.
+    chooseParent();
+
+    receiveMorePackets();
+    beaconService();
+}
+
+/* TX FUNCTIONS ***************************************************************/
+
+uint8 XDATA * radioTreeTxCurrentPacket(void)
+{
+    uint8 XDATA * packet;
+
+    if (parent == 0 || !(packet = radioQueueTxCurrentPacket()))
+    {
+        return 0;
+    }
+    return packet + HEADER_LENGTH;
+}
+
+void radioTreeTxSendPacket(void)
+{
+    uint8 XDATA * packet = radioQueueTxCurrentPacket();
+
+    // The higher-level code wrote the payload length where the cost goes.
+    packet[0] = packet[COST_OFFSET] + HEADER_LENGTH;
+    packet[TYPE_OFFSET] = PACKET_TYPE_DATA;
+    packet[ORIGIN_OFFSET] = radioQueueAddress;
+    packet[COST_OFFSET] = cost;
+    radioQueueTxSendPacketTo(parent);
+}
+
+/* RX FUNCTIONS ***************************************************************/
+
+uint8 XDATA * radioTreeRxCurrentPacket(void)
+{
+    receiveMorePackets();
+    if (!rxReady)
+    {
+        return 0;
+    }
+    return radioQueueRxCurrentPacket() + HEADER_LENGTH;
+}
+
+uint8 radioTreeRxCurrentOrigin(void)
+{
+    return radioQueueRxCurrentPacket()[ORIGIN_OFFSET];
+}
+
+void radioTreeRxDoneWithPacket(void)
+{
+    rxReady = 0;
+    radioQueueRxDoneWithPacket();
+}
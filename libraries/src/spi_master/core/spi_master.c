@@ -5,6 +5,7 @@
 
 #include <cc2511_map.h>
 #include <cc2511_types.h>
+#include <dma.h>
 
 #if defined(__CDT_PARSER__)
 #define SPI0
@@ -19,6 +20,9 @@
 #define UNGCR                       U0GCR
 #define UNBAUD                      U0BAUD
 #define UNDBUF                      U0DBUF
+#define URXN_DMA_TRIGGER            14
+#define UTXN_DMA_TRIGGER            15
+#define spiNMasterDmaEnabled        spi0MasterDmaEnabled
 #define spiNMasterInit              spi0MasterInit
 #define spiNMasterSetFrequency      spi0MasterSetFrequency
 #define spiNMasterSetClockPolarity  spi0MasterSetClockPolarity
@@ -29,6 +33,8 @@
 #define spiNMasterTransfer          spi0MasterTransfer
 #define spiNMasterSendByte          spi0MasterSendByte
 #define spiNMasterReceiveByte       spi0MasterReceiveByte
+#define spiNMasterTransactionFormat spi0MasterTransactionFormat
+#define spiNMasterQueueTransaction  spi0MasterQueueTransaction
 
 #elif defined(SPI1)
 #include <spi1_master.h>
@@ -39,6 +45,9 @@
 #define UNGCR                       U1GCR
 #define UNBAUD                      U1BAUD
 #define UNDBUF                      U1DBUF
+#define URXN_DMA_TRIGGER            16
+#define UTXN_DMA_TRIGGER            17
+#define spiNMasterDmaEnabled        spi1MasterDmaEnabled
 #define spiNMasterInit              spi1MasterInit
 #define spiNMasterSetFrequency      spi1MasterSetFrequency
 #define spiNMasterSetClockPolarity  spi1MasterSetClockPolarity
@@ -49,6 +58,8 @@
 #define spiNMasterTransfer          spi1MasterTransfer
 #define spiNMasterSendByte          spi1MasterSendByte
 #define spiNMasterReceiveByte       spi1MasterReceiveByte
+#define spiNMasterTransactionFormat spi1MasterTransactionFormat
+#define spiNMasterQueueTransaction  spi1MasterQueueTransaction
 #endif
 
 // txPointer points to the last byte that was written to SPI.
@@ -60,8 +71,71 @@ static volatile uint8 XDATA * DATA rxPointer = 0;
 // bytesLeft is the number of bytes we still need to send to/receive from SPI.
 static volatile uint16 DATA bytesLeft = 0;
 
+/* DMA mode:
+ *
+ * Transfers of at least SPI_DMA_MIN_SIZE bytes are done by two DMA channels
+ * instead of the RX interrupt.  The RX channel is triggered by URXN and copies
+ * each received byte from UNDBUF to the RX buffer.  The TX channel is
+ * triggered by UTXN, which happens when UNDBUF is ready for the next byte, so
+ * the USART always has the next byte waiting and the bytes go out back to
+ * back.  The TX channel is always one byte ahead of the RX channel, so the RX
+ * buffer can be the same as the TX buffer.  The transfer is done when the RX
+ * channel is no longer armed.  For shorter transfers, setting up the channels
+ * takes longer than the interrupts would. */
+#define SPI_DMA_MIN_SIZE            8
+
+BIT spiNMasterDmaEnabled = 0;
+
+static uint8 rxDmaChannel = DMA_CHANNEL_NONE;
+static uint8 txDmaChannel = DMA_CHANNEL_NONE;
+static uint8 rxDmaMask = 0;             // The bit of the RX channel in DMAARM, or 0 if DMA is not used.
+static uint16 dmaSize;                  // The size of the current DMA transfer.
+
+/* Transaction queue:
+ *
+ * The queued transactions form a linked list from queueHead to queueTail.
+ * The transaction at the head is the one being transferred.  When a transfer
+ * finishes, the RX interrupt or the DMA interrupt (whichever did the transfer)
+ * releases the chip select, calls the callback of the finished transaction,
+ * and starts the next transaction in the queue right away.  The main loop
+ * only adds transactions, with the interrupts disabled. */
+static SPI_TRANSACTION XDATA * volatile DATA queueHead = 0;
+static SPI_TRANSACTION XDATA * DATA queueTail;
+
+static BIT queueLockUrx;
+static BIT queueLockDma;
+#define QUEUE_LOCK()    { queueLockUrx = URXNIE; queueLockDma = DMAIE; URXNIE = 0; DMAIE = 0; }
+#define QUEUE_UNLOCK()  { DMAIE = queueLockDma; URXNIE = queueLockUrx; }
+
+// The results of computeBaud.
+static uint8 computedBaudE;
+static uint8 computedBaudM;
+
+static void queueNext(void);
+
 void spiNMasterInit(void)
 {
+    if (spiNMasterDmaEnabled)
+    {
+        // Reserve the DMA channels the first time this is called.  If there
+        // are not enough free channels, we use the interrupt instead.
+        if (rxDmaChannel == DMA_CHANNEL_NONE)
+        {
+            rxDmaChannel = dmaAllocateChannel();
+        }
+        if (txDmaChannel == DMA_CHANNEL_NONE)
+        {
+            txDmaChannel = dmaAllocateChannel();
+        }
+    }
+    rxDmaMask = 0;
+    if (spiNMasterDmaEnabled && rxDmaChannel != DMA_CHANNEL_NONE && txDmaChannel != DMA_CHANNEL_NONE)
+    {
+        rxDmaMask = (1<<rxDmaChannel);
+        dmaSetCallback(rxDmaChannel, queueNext);
+    }
+    queueHead = 0;
+
     /* From datasheet Table 50 */
 
     /* USART0 SPI Alt. 1:
@@ -115,14 +189,16 @@ void spiNMasterInit(void)
     EA = 1;     // Enable interrupts in general.
 }
 
-void spiNMasterSetFrequency(uint32 freq)
+// Computes the register values for the specified frequency and puts them in
+// computedBaudE and computedBaudM.  Returns 0 if the frequency is out of range.
+static BIT computeBaud(uint32 freq)
 {
     uint32 baudMPlus256;
     uint8 baudE = 0;
 
     // max baud rate is 3000000 (F/8); min is 23 (baudM = 1)
     if (freq < 23 || freq > 3000000)
-        return;
+        return 0;
 
     // 495782 is the largest value that will not overflow the following calculation
     while (freq > 495782)
@@ -141,9 +217,19 @@ void spiNMasterSetFrequency(uint32 freq)
         baudE++;
         baudMPlus256 /= 2;
     }
+    computedBaudE = baudE;
+    computedBaudM = baudMPlus256; // only the lowest 8 bits of baudMPlus256 are used, so this is effectively baudMPlus256 - 256
+    return 1;
+}
+
+void spiNMasterSetFrequency(uint32 freq)
+{
+    if (!computeBaud(freq))
+        return;
+
     UNGCR &= 0xE0; // preserve CPOL, CPHA, ORDER (7:5)
-    UNGCR |= baudE; // UNGCR.BAUD_E (4:0)
-    UNBAUD = baudMPlus256; // UNBAUD.BAUD_M (7:0) - only the lowest 8 bits of baudMPlus256 are used, so this is effectively baudMPlus256 - 256
+    UNGCR |= computedBaudE; // UNGCR.BAUD_E (4:0)
+    UNBAUD = computedBaudM; // UNBAUD.BAUD_M (7:0)
 }
 
 void spiNMasterSetClockPolarity(BIT polarity)
@@ -184,13 +270,19 @@ void spiNMasterSetBitOrder(BIT bitOrder)
 
 BIT spiNMasterBusy(void)
 {
-    return URXNIE;
+    return URXNIE || (DMAARM & rxDmaMask) || queueHead;
 }
 
 uint16 spiNMasterBytesLeft(void)
 {
     uint16 bytes;
 
+    if (DMAARM & rxDmaMask)
+    {
+        // The DMA does not tell us how far it has gotten.
+        return dmaSize;
+    }
+
     // bytesLeft is 16 bits, so it takes more than one instruction to read. Disable interrupts so it's not updated while we do this
     URXNIE = 0;
     bytes = bytesLeft;
@@ -199,19 +291,181 @@ uint16 spiNMasterBytesLeft(void)
     return bytes;
 }
 
+static void spiNMasterDmaTransfer(const uint8 XDATA * txBuffer, uint8 XDATA * rxBuffer, uint16 size)
+{
+    volatile DMA_CONFIG XDATA * config;
+
+    dmaSize = size;
+
+    config = dmaChannelConfig(rxDmaChannel);
+    config->SRCADDRH = XDATA_SFR_ADDRESS(UNDBUF) >> 8;
+    config->SRCADDRL = XDATA_SFR_ADDRESS(UNDBUF);
+    config->DESTADDRH = (unsigned int)rxBuffer >> 8;
+    config->DESTADDRL = (unsigned int)rxBuffer;
+    config->VLEN_LENH = size >> 8;
+    config->LENL = size & 0xFF;
+    config->DC6 = URXN_DMA_TRIGGER; // WORDSIZE = 0, TMODE = 0, TRIG = URXN
+    config->DC7 = 0x1A;  // SRCINC = 0, DESTINC = 1, IRQMASK = 1, M8 = 0, PRIORITY = 2 (high)
+
+    config = dmaChannelConfig(txDmaChannel);
+    config->SRCADDRH = (unsigned int)txBuffer >> 8;
+    config->SRCADDRL = (unsigned int)txBuffer;
+    config->DESTADDRH = XDATA_SFR_ADDRESS(UNDBUF) >> 8;
+    config->DESTADDRL = XDATA_SFR_ADDRESS(UNDBUF);
+    config->VLEN_LENH = size >> 8;
+    config->LENL = size & 0xFF;
+    config->DC6 = UTXN_DMA_TRIGGER; // WORDSIZE = 0, TMODE = 0, TRIG = UTXN
+    config->DC7 = 0x40;  // SRCINC = 1, DESTINC = 0, IRQMASK = 0, M8 = 0, PRIORITY = 0
+
+    DMAARM = rxDmaMask | (1<<txDmaChannel);
+
+    // UNDBUF is empty, so the USART will not generate the trigger for the
+    // first byte; we have to do it.  The datasheet says to wait 9 cycles
+    // after arming.
+    __asm nop __endasm; __asm nop __endasm; __asm nop __endasm;
+    __asm nop __endasm; __asm nop __endasm; __asm nop __endasm;
+    __asm nop __endasm; __asm nop __endasm; __asm nop __endasm;
+    DMAREQ = (1<<txDmaChannel);
+}
+
 void spiNMasterTransfer(const uint8 XDATA * txBuffer, uint8 XDATA * rxBuffer, uint16 size)
 {
-    if (size)
+    if (size >= SPI_DMA_MIN_SIZE && rxDmaMask)
+    {
+        spiNMasterDmaTransfer(txBuffer, rxBuffer, size);
+    }
+    else if (size)
     {
         txPointer = txBuffer;
         rxPointer = rxBuffer;
         bytesLeft = size;
 
+        URXNIF = 0;         // The flag might have been left set by a DMA transfer.
         UNDBUF = *txBuffer; // transmit first byte
         URXNIE = 1;         // Enable RX interrupt.
     }
 }
 
+void spiNMasterTransactionFormat(SPI_TRANSACTION XDATA * transaction, uint32 freq, BIT polarity, BIT phase, BIT bitOrder)
+{
+    if (!computeBaud(freq))
+        return;
+
+    transaction->gcr = computedBaudE;
+    if (polarity == SPI_POLARITY_IDLE_HIGH)  { transaction->gcr |= (1<<7); }
+    if (phase == SPI_PHASE_EDGE_TRAILING)    { transaction->gcr |= (1<<6); }
+    if (bitOrder == SPI_BIT_ORDER_MSB_FIRST) { transaction->gcr |= (1<<5); }
+    transaction->baud = computedBaudM;
+}
+
+// Drives the chip select pin of a transaction high or low.  Only P0 and P1
+// pins are supported.
+static void queueWriteCs(uint8 pin, BIT value)
+{
+    uint8 mask;
+
+    if (pin == SPI_CS_NONE)
+    {
+        return;
+    }
+
+    mask = 1 << (pin % 10);
+    if (pin >= 10)
+    {
+        if (value) { P1 |= mask; } else { P1 &= ~mask; }
+    }
+    else
+    {
+        if (value) { P0 |= mask; } else { P0 &= ~mask; }
+    }
+}
+
+// Starts the transaction at the head of the queue.  This is called from the
+// interrupts, or from the main loop when the queue is idle.
+static void queueStart(void)
+{
+    SPI_TRANSACTION XDATA * t = queueHead;
+
+    UNGCR = t->gcr;
+    UNBAUD = t->baud;
+    t->status = SPI_TRANSACTION_ACTIVE;
+    queueWriteCs(t->csPin, 0);
+    spiNMasterTransfer(t->txBuffer, t->rxBuffer, t->size);
+}
+
+// Finishes the transaction at the head of the queue and starts the next one.
+// This is called from the interrupts when a transfer is done.
+static void queueNext(void)
+{
+    SPI_TRANSACTION XDATA * t = queueHead;
+
+    if (t == 0)
+    {
+        // The transfer was not started by the queue.
+        return;
+    }
+
+    queueWriteCs(t->csPin, 1);
+    t->status = SPI_TRANSACTION_DONE;
+
+    // Call the callback before starting the next transaction.  Otherwise, if
+    // we are in the DMA interrupt and the next transaction uses the RX
+    // interrupt, which has a higher priority, the RX interrupt could finish
+    // that transaction and call the callback while this one is still running.
+    if (t->callback)
+    {
+        t->callback(t);
+    }
+
+    queueHead = t->next;
+    if (queueHead)
+    {
+        queueStart();
+    }
+}
+
+void spiNMasterQueueTransaction(SPI_TRANSACTION XDATA * transaction)
+{
+    BIT idle;
+    uint8 pin = transaction->csPin;
+
+    if (pin != SPI_CS_NONE)
+    {
+        // Make the chip select pin an output that is high (inactive).
+        uint8 mask = 1 << (pin % 10);
+        if (pin >= 10)
+        {
+            if (!(P1DIR & mask)) { P1 |= mask; P1SEL &= ~mask; P1DIR |= mask; }
+        }
+        else
+        {
+            if (!(P0DIR & mask)) { P0 |= mask; P0SEL &= ~mask; P0DIR |= mask; }
+        }
+    }
+
+    transaction->next = 0;
+    transaction->status = SPI_TRANSACTION_QUEUED;
+
+    QUEUE_LOCK();
+    idle = (queueHead == 0);
+    if (idle)
+    {
+        queueHead = transaction;
+    }
+    else
+    {
+        queueTail->next = transaction;
+    }
+    queueTail = transaction;
+    QUEUE_UNLOCK();
+
+    if (idle)
+    {
+        // No interrupt will start this transaction, so we have to.
+        queueStart();
+    }
+}
+
 uint8 spiNMasterSendByte(uint8 XDATA byte)
 {
     uint8 XDATA rxByte;
@@ -219,6 +473,7 @@ uint8 spiNMasterSendByte(uint8 XDATA byte)
     rxPointer = &rxByte;
     bytesLeft = 1;
 
+    URXNIF = 0;
     UNDBUF = byte;
     URXNIE = 1; // Enable RX interrupt.
 
@@ -247,5 +502,6 @@ ISR_URX()
     else
     {
         URXNIE = 0;
+        queueNext();
     }
 }
@@ -0,0 +1,421 @@
+/** \file spi_slave.c
+ * This is the main source file for <code>spi_slave.lib</code>.  See
+ * spi0_slave.h for information on how to use this library.
+ *
+ * Every SPI transaction is exactly SPI_SLAVE_FRAME_SIZE bytes long.  Before
+ * each transaction, we arm two DMA channels: the RX channel, triggered by URXN,
+ * copies the bytes from the master into a free RX frame buffer, and the TX
+ * channel, triggered by UTXN, copies our frame from the loaded TX frame buffer
+ * into UNDBUF, one byte ahead of the master.  When the RX channel has received
+ * the last byte of the frame, the DMA interrupt calls frameDone, which hands
+ * the RX frame to the main loop and arms the channels for the next frame.
+ *
+ * If the master stops a transaction early (or we were armed in the middle of
+ * one), the channels would get out of step with the frames.  Before arming,
+ * the length byte of the RX frame is set to RX_EMPTY, which is never a valid
+ * length, so spiNSlaveService can tell that a frame was started: if SSN is
+ * high and the RX channel is still armed but the length byte has changed, the
+ * frame was cut short, so we discard it and arm again.
+ */
+
+#include <cc2511_map.h>
+#include <cc2511_types.h>
+#include <dma.h>
+
+#if defined(__CDT_PARSER__)
+#define SPI0
+#endif
+
+#if defined(SPI0)
+#include <spi0_slave.h>
+#define UNCSR                       U0CSR
+#define UNGCR                       U0GCR
+#define UNUCR                       U0UCR
+#define UNDBUF                      U0DBUF
+#define URXN_DMA_TRIGGER            14
+#define UTXN_DMA_TRIGGER            15
+#define SPI_SSN                     P0_4
+#define spiNSlaveInit               spi0SlaveInit
+#define spiNSlaveSetClockPolarity   spi0SlaveSetClockPolarity
+#define spiNSlaveSetClockPhase      spi0SlaveSetClockPhase
+#define spiNSlaveSetBitOrder        spi0SlaveSetBitOrder
+#define spiNSlaveSetSignalPins      spi0SlaveSetSignalPins
+#define spiNSlaveService            spi0SlaveService
+#define spiNSlaveMaxPayloadSize     spi0SlaveMaxPayloadSize
+#define spiNSlaveTxCurrentFrame     spi0SlaveTxCurrentFrame
+#define spiNSlaveTxSendFrame        spi0SlaveTxSendFrame
+#define spiNSlaveRxCurrentFrame     spi0SlaveRxCurrentFrame
+#define spiNSlaveRxDoneWithFrame    spi0SlaveRxDoneWithFrame
+#define spiNSlaveRxDropCount        spi0SlaveRxDropCount
+
+#elif defined(SPI1)
+#include <spi1_slave.h>
+#define UNCSR                       U1CSR
+#define UNGCR                       U1GCR
+#define UNUCR                       U1UCR
+#define UNDBUF                      U1DBUF
+#define URXN_DMA_TRIGGER            16
+#define UTXN_DMA_TRIGGER            17
+#define SPI_SSN                     P1_4
+#define spiNSlaveInit               spi1SlaveInit
+#define spiNSlaveSetClockPolarity   spi1SlaveSetClockPolarity
+#define spiNSlaveSetClockPhase      spi1SlaveSetClockPhase
+#define spiNSlaveSetBitOrder        spi1SlaveSetBitOrder
+#define spiNSlaveSetSignalPins      spi1SlaveSetSignalPins
+#define spiNSlaveService            spi1SlaveService
+#define spiNSlaveMaxPayloadSize     spi1SlaveMaxPayloadSize
+#define spiNSlaveTxCurrentFrame     spi1SlaveTxCurrentFrame
+#define spiNSlaveTxSendFrame        spi1SlaveTxSendFrame
+#define spiNSlaveRxCurrentFrame     spi1SlaveRxCurrentFrame
+#define spiNSlaveRxDoneWithFrame    spi1SlaveRxDoneWithFrame
+#define spiNSlaveRxDropCount        spi1SlaveRxDropCount
+#endif
+
+// The frame size is set for each USART in lib_options.mk.
+#ifndef SPI_SLAVE_FRAME_SIZE
+#define SPI_SLAVE_FRAME_SIZE 33
+#endif
+
+#if SPI_SLAVE_FRAME_SIZE < 2 || SPI_SLAVE_FRAME_SIZE > 255
+#error SPI_SLAVE_FRAME_SIZE must be between 2 and 255.
+#endif
+
+// The length byte of an RX frame buffer before the DMA writes to it.
+#define RX_EMPTY                    0xFF
+
+uint16 spiNSlaveRxDropCount = 0;
+
+static uint8 rxDmaChannel = DMA_CHANNEL_NONE;
+static uint8 txDmaChannel = DMA_CHANNEL_NONE;
+
+// The RX frame buffers form a queue of two frames.  The interrupt fills the
+// frame at rxInterruptIndex and the main loop reads the frame at
+// rxMainLoopIndex.  rxCount is the number of frames waiting for the main loop.
+static volatile uint8 XDATA rxFrame[2][SPI_SLAVE_FRAME_SIZE];
+static volatile uint8 rxInterruptIndex = 0;
+static volatile uint8 rxMainLoopIndex = 0;
+static volatile uint8 rxCount = 0;
+
+// txFrame[txLoadedIndex] is the frame that will be sent in the next
+// transaction and the other one belongs to the main loop.  txPending is 1
+// after the main loop has filled its frame and before the interrupt loads it.
+static volatile uint8 XDATA txFrame[2][SPI_SLAVE_FRAME_SIZE];
+static volatile uint8 txLoadedIndex = 0;
+static volatile BIT txPending = 0;
+
+static volatile BIT armed = 0;      // 1 iff the DMA channels are armed for a frame.
+
+// The ready and IRQ pins, numbered as in gpio.h, or SPI_SLAVE_PIN_NONE.
+static uint8 readyPin = SPI_SLAVE_PIN_NONE;
+static uint8 irqPin = SPI_SLAVE_PIN_NONE;
+
+// Drives one of the signal pins high or low.  Only P0 and P1 pins are
+// supported.
+static void writePin(uint8 pin, BIT value)
+{
+    uint8 mask;
+
+    if (pin == SPI_SLAVE_PIN_NONE)
+    {
+        return;
+    }
+
+    mask = 1 << (pin % 10);
+    if (pin >= 10)
+    {
+        if (value) { P1 |= mask; } else { P1 &= ~mask; }
+    }
+    else
+    {
+        if (value) { P0 |= mask; } else { P0 &= ~mask; }
+    }
+}
+
+// Arms the DMA channels for the next frame, if there is a free RX buffer.
+// This is called from the DMA interrupt, or from the main loop with the DMA
+// interrupt disabled.
+static void armFrame(void)
+{
+    volatile DMA_CONFIG XDATA * config;
+    volatile uint8 XDATA * tx;
+
+    if (rxCount == 2)
+    {
+        // There is nowhere to put the next frame.  spiNSlaveRxDoneWithFrame
+        // will arm the channels.
+        armed = 0;
+        return;
+    }
+
+    if (txPending)
+    {
+        txLoadedIndex ^= 1;
+        txPending = 0;
+    }
+    tx = txFrame[txLoadedIndex];
+
+    rxFrame[rxInterruptIndex][0] = RX_EMPTY;
+
+    config = dmaChannelConfig(rxDmaChannel);
+    config->SRCADDRH = XDATA_SFR_ADDRESS(UNDBUF) >> 8;
+    config->SRCADDRL = XDATA_SFR_ADDRESS(UNDBUF);
+    config->DESTADDRH = (unsigned int)rxFrame[rxInterruptIndex] >> 8;
+    config->DESTADDRL = (unsigned int)rxFrame[rxInterruptIndex];
+    config->VLEN_LENH = 0;
+    config->LENL = SPI_SLAVE_FRAME_SIZE;
+    config->DC6 = URXN_DMA_TRIGGER; // WORDSIZE = 0, TMODE = 0, TRIG = URXN
+    config->DC7 = 0x1A;  // SRCINC = 0, DESTINC = 1, IRQMASK = 1, M8 = 0, PRIORITY = 2 (high)
+
+    config = dmaChannelConfig(txDmaChannel);
+    config->SRCADDRH = (unsigned int)tx >> 8;
+    config->SRCADDRL = (unsigned int)tx;
+    config->DESTADDRH = XDATA_SFR_ADDRESS(UNDBUF) >> 8;
+    config->DESTADDRL = XDATA_SFR_ADDRESS(UNDBUF);
+    config->VLEN_LENH = 0;
+    config->LENL = SPI_SLAVE_FRAME_SIZE;
+    config->DC6 = UTXN_DMA_TRIGGER; // WORDSIZE = 0, TMODE = 0, TRIG = UTXN
+    config->DC7 = 0x40;  // SRCINC = 1, DESTINC = 0, IRQMASK = 0, M8 = 0, PRIORITY = 0
+
+    DMAARM = (1<<rxDmaChannel) | (1<<txDmaChannel);
+
+    // Put the first byte of our frame in UNDBUF so it is ready when the
+    // master starts clocking.  The datasheet says to wait 9 cycles after
+    // arming.
+    __asm nop __endasm; __asm nop __endasm; __asm nop __endasm;
+    __asm nop __endasm; __asm nop __endasm; __asm nop __endasm;
+    __asm nop __endasm; __asm nop __endasm; __asm nop __endasm;
+    DMAREQ = (1<<txDmaChannel);
+
+    armed = 1;
+    writePin(irqPin, tx[0] == 0);   // Active low: we have data for the master.
+    writePin(readyPin, 1);
+}
+
+// Called from the DMA interrupt when the RX channel has received a frame.
+static void frameDone(void)
+{
+    writePin(readyPin, 0);
+    armed = 0;
+
+    if (rxFrame[rxInterruptIndex][0] < SPI_SLAVE_FRAME_SIZE)
+    {
+        rxInterruptIndex ^= 1;
+        rxCount++;
+    }
+    else
+    {
+        // The length byte is not valid.
+        spiNSlaveRxDropCount++;
+    }
+
+    // Our frame has been sent, so do not send it again.
+    txFrame[txLoadedIndex][0] = 0;
+
+    armFrame();
+}
+
+void spiNSlaveInit(void)
+{
+    /* USART0 SPI Alt. 1:
+     *                     SSN  = P0_4
+     *                     SCK  = P0_5
+     *                     MOSI = P0_3
+     *                     MISO = P0_2
+     */
+
+    /* USART1 SPI Alt. 2:
+     *                     SSN  = P1_4
+     *                     SCK  = P1_5
+     *                     MOSI = P1_6
+     *                     MISO = P1_7
+     */
+
+    if (rxDmaChannel == DMA_CHANNEL_NONE)
+    {
+        rxDmaChannel = dmaAllocateChannel();
+    }
+    if (txDmaChannel == DMA_CHANNEL_NONE)
+    {
+        txDmaChannel = dmaAllocateChannel();
+    }
+    if (rxDmaChannel == DMA_CHANNEL_NONE || txDmaChannel == DMA_CHANNEL_NONE)
+    {
+        // This library can not work without DMA.
+        return;
+    }
+
+#ifdef SPI0
+    P2DIR &= ~0xC0;  // P2DIR.PRIP0 (7:6) = 00 : USART0 takes priority over USART1.
+    PERCFG &= ~0x01; // PERCFG.U0CFG (0) = 0 (Alt. 1) : USART0 uses alt. location 1.
+#else
+    P2SEL |= 0x40;   // USART1 takes priority over USART0 on Port 1.
+    PERCFG |= 0x02;  // PERCFG.U1CFG (1) = 1 (Alt. 2) : USART1 uses alt. location 2.
+#endif
+
+    DMAARM = 0x80 | (1<<rxDmaChannel) | (1<<txDmaChannel);  // Abort the transfers, if any.
+    UNCSR = 0x20;    // UNCSR.MODE = 0 (SPI), UNCSR.SLAVE = 1
+
+    // In slave mode, all four pins must be peripheral function pins.
+#ifdef SPI0
+    P0SEL |= 0x3C;   // P0SEL.SELP0_2-5 = 1
+#else
+    P1SEL |= 0xF0;   // P1SEL.SELP1_4-7 = 1
+#endif
+
+    rxInterruptIndex = 0;
+    rxMainLoopIndex = 0;
+    rxCount = 0;
+    txFrame[0][0] = 0;
+    txFrame[1][0] = 0;
+    txLoadedIndex = 0;
+    txPending = 0;
+
+    dmaSetCallback(rxDmaChannel, frameDone);
+    EA = 1;     // Enable interrupts in general.
+
+    DMAIE = 0;
+    armFrame();
+    DMAIE = 1;
+}
+
+void spiNSlaveSetClockPolarity(BIT polarity)
+{
+    if (polarity == SPI_POLARITY_IDLE_LOW)
+    {
+        UNGCR &= ~(1<<7);   // SCK idle low (negative polarity)
+    }
+    else
+    {
+        UNGCR |= (1<<7);    // SCK idle high (positive polarity)
+    }
+}
+
+void spiNSlaveSetClockPhase(BIT phase)
+{
+    if (phase == SPI_PHASE_EDGE_LEADING)
+    {
+        UNGCR &= ~(1<<6);   // data centered on leading (first) edge - rising for idle low, falling for idle high
+    }
+    else
+    {
+        UNGCR |= (1<<6);    // data centered on trailing (second) edge - falling for idle low, rising for idle high
+    }
+}
+
+void spiNSlaveSetBitOrder(BIT bitOrder)
+{
+    if (bitOrder == SPI_BIT_ORDER_LSB_FIRST)
+    {
+        UNGCR &= ~(1<<5);   // LSB first
+    }
+    else
+    {
+        UNGCR |= (1<<5);    // MSB first
+    }
+}
+
+void spiNSlaveSetSignalPins(uint8 newReadyPin, uint8 newIrqPin)
+{
+    uint8 i;
+
+    DMAIE = 0;
+    readyPin = newReadyPin;
+    irqPin = newIrqPin;
+
+    // Make the pins outputs with the right values.
+    writePin(readyPin, armed);
+    writePin(irqPin, !armed || txFrame[txLoadedIndex][0] == 0);
+    for (i = 0; i < 2; i++)
+    {
+        uint8 pin = i ? irqPin : readyPin;
+        uint8 mask = 1 << (pin % 10);
+        if (pin == SPI_SLAVE_PIN_NONE)
+        {
+            continue;
+        }
+        if (pin >= 10)
+        {
+            P1SEL &= ~mask; P1DIR |= mask;
+        }
+        else
+        {
+            P0SEL &= ~mask; P0DIR |= mask;
+        }
+    }
+    DMAIE = 1;
+}
+
+void spiNSlaveService(void)
+{
+    // Read the length byte before SSN so that a frame that starts in between
+    // is not mistaken for one that was cut short.
+    uint8 length = rxFrame[rxInterruptIndex][0];
+
+    if (armed && length != RX_EMPTY && SPI_SSN && (DMAARM & (1<<rxDmaChannel)))
+    {
+        DMAIE = 0;
+        if (armed && (DMAARM & (1<<rxDmaChannel)))
+        {
+            // The master started a frame but did not finish it.
+            writePin(readyPin, 0);
+            DMAARM = 0x80 | (1<<rxDmaChannel) | (1<<txDmaChannel);  // Abort the transfers.
+            UNUCR |= 0x80;   // UNUCR.FLUSH = 1: Forget the byte in UNDBUF.
+            spiNSlaveRxDropCount++;
+            armFrame();
+        }
+        DMAIE = 1;
+    }
+}
+
+uint8 spiNSlaveMaxPayloadSize(void)
+{
+    return SPI_SLAVE_FRAME_SIZE - 1;
+}
+
+uint8 XDATA * spiNSlaveTxCurrentFrame(void)
+{
+    if (txPending)
+    {
+        return 0;
+    }
+    return txFrame[txLoadedIndex ^ 1];
+}
+
+void spiNSlaveTxSendFrame(void)
+{
+    DMAIE = 0;
+    txPending = 1;
+    if (armed && txFrame[txLoadedIndex][0] == 0 && SPI_SSN &&
+        rxFrame[rxInterruptIndex][0] == RX_EMPTY)
+    {
+        // The master is not reading a frame right now and the loaded frame
+        // is empty, so load the new one right away.
+        DMAARM = 0x80 | (1<<rxDmaChannel) | (1<<txDmaChannel);  // Abort the transfers.
+        UNUCR |= 0x80;   // UNUCR.FLUSH = 1
+        armFrame();
+    }
+    DMAIE = 1;
+}
+
+uint8 XDATA * spiNSlaveRxCurrentFrame(void)
+{
+    spiNSlaveService();
+    if (rxCount == 0)
+    {
+        return 0;
+    }
+    return rxFrame[rxMainLoopIndex];
+}
+
+void spiNSlaveRxDoneWithFrame(void)
+{
+    rxMainLoopIndex ^= 1;
+
+    DMAIE = 0;
+    rxCount--;
+    if (!armed)
+    {
+        armFrame();
+    }
+    DMAIE = 1;
+}
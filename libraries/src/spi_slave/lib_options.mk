@@ -0,0 +1,26 @@
+# This library will be made by linking spi0_slave.rel and spi1_slave.rel.
+LIB_RELS := libraries/src/spi_slave/spi0_slave.rel libraries/src/spi_slave/spi1_slave.rel
+
+# The size of each frame, in bytes, including the length byte.  Must be
+# between 2 and 255.  Each slave uses four frame buffers in XDATA.
+# The SPI master must use the same size.
+SPI0_SLAVE_FRAME_SIZE ?= 33
+SPI1_SLAVE_FRAME_SIZE ?= 33
+
+# When those rel (object) files are compiled, there will be a
+# special preprocessor flag to specify which USART to use.
+libraries/src/spi_slave/spi0_slave.rel : C_FLAGS += -DSPI0 -DSPI_SLAVE_FRAME_SIZE=$(SPI0_SLAVE_FRAME_SIZE)
+libraries/src/spi_slave/spi1_slave.rel : C_FLAGS += -DSPI1 -DSPI_SLAVE_FRAME_SIZE=$(SPI1_SLAVE_FRAME_SIZE)
+
+# Recompile the library if the sizes above are edited.
+libraries/src/spi_slave/spi0_slave.rel libraries/src/spi_slave/spi1_slave.rel : libraries/src/spi_slave/lib_options.mk
+
+# The rel files will be compiled from spi0_slave.c and spi1_slave.c,
+# which will both be copies of core/spi_slave.c.
+libraries/src/spi_slave/spi0_slave.c : libraries/src/spi_slave/core/spi_slave.c
+	$(CP) $< $@
+	
+libraries/src/spi_slave/spi1_slave.c : libraries/src/spi_slave/core/spi_slave.c
+	$(CP) $< $@
+
+TARGETS += libraries/src/spi_slave/spi0_slave.c libraries/src/spi_slave/spi1_slave.c
@@ -5,6 +5,8 @@
 
 #include <cc2511_map.h>
 #include <cc2511_types.h>
+#include <dma.h>
+#include <time.h>
 
 #if defined(__CDT_PARSER__)
 #define UART0
@@ -24,19 +26,39 @@
 #define UNBAUD                      U0BAUD
 #define UNDBUF                      U0DBUF
 #define BV_UTXNIE                   (1<<2)
+#define URXN_DMA_TRIGGER            14
+#define UTXN_DMA_TRIGGER            15
+#define UART_RTS                    P0_5
+#define UART_FLOW_PORT_DIR          P0DIR
 #define uartNRxParityErrorOccurred  uart0RxParityErrorOccurred
 #define uartNRxFramingErrorOccurred uart0RxFramingErrorOccurred
 #define uartNRxBufferFullOccurred   uart0RxBufferFullOccurred
+#define uartNDmaEnabled             uart0DmaEnabled
 #define uartNRxAvailable            uart0RxAvailable
 #define uartNTxAvailable            uart0TxAvailable
+#define uartNTxIdle                 uart0TxIdle
+#define uartNService                uart0Service
 #define uartNInit                   uart0Init
 #define uartNSetBaudRate            uart0SetBaudRate
 #define uartNSetParity              uart0SetParity
 #define uartNSetStopBits            uart0SetStopBits
+#define uartNSetFlowControl         uart0SetFlowControl
+#define uartNSetRxFrameGap          uart0SetRxFrameGap
+#define uartNSetDriverEnable        uart0SetDriverEnable
+#define uartNSetNineBit             uart0SetNineBit
+#define uartNSetRxAddressFilter     uart0SetRxAddressFilter
+#define uartNAutoBaudStart          uart0AutoBaudStart
+#define uartNAutoBaudService        uart0AutoBaudService
+#define uartNAutoBaudErrorPpm       uart0AutoBaudErrorPpm
+#define uartNRxFrameLength          uart0RxFrameLength
+#define uartNRxFrameTime            uart0RxFrameTime
 #define uartNTxSend                 uart0TxSend
 #define uartNRxReceiveByte          uart0RxReceiveByte
+#define uartNRxErrors               uart0RxErrors
 #define uartNTxSend                 uart0TxSend
 #define uartNTxSendByte             uart0TxSendByte
+#define uartNTxSendNineBits         uart0TxSendNineBits
+#define uartNRxReceiveNineBits      uart0RxReceiveNineBits
 
 #elif defined(UART1)
 #include <uart1.h>
@@ -52,38 +74,794 @@
 #define UNBAUD                      U1BAUD
 #define UNDBUF                      U1DBUF
 #define BV_UTXNIE                   (1<<3)
+#define URXN_DMA_TRIGGER            16
+#define UTXN_DMA_TRIGGER            17
+#define UART_RTS                    P1_5
+#define UART_FLOW_PORT_DIR          P1DIR
 #define uartNRxParityErrorOccurred  uart1RxParityErrorOccurred
 #define uartNRxFramingErrorOccurred uart1RxFramingErrorOccurred
 #define uartNRxBufferFullOccurred   uart1RxBufferFullOccurred
+#define uartNDmaEnabled             uart1DmaEnabled
 #define uartNRxAvailable            uart1RxAvailable
 #define uartNTxAvailable            uart1TxAvailable
+#define uartNTxIdle                 uart1TxIdle
+#define uartNService                uart1Service
 #define uartNInit                   uart1Init
 #define uartNSetBaudRate            uart1SetBaudRate
 #define uartNSetParity              uart1SetParity
 #define uartNSetStopBits            uart1SetStopBits
+#define uartNSetFlowControl         uart1SetFlowControl
+#define uartNSetRxFrameGap          uart1SetRxFrameGap
+#define uartNSetDriverEnable        uart1SetDriverEnable
+#define uartNSetNineBit             uart1SetNineBit
+#define uartNSetRxAddressFilter     uart1SetRxAddressFilter
+#define uartNRxFrameLength          uart1RxFrameLength
+#define uartNRxFrameTime            uart1RxFrameTime
 #define uartNTxSend                 uart1TxSend
 #define uartNRxReceiveByte          uart1RxReceiveByte
+#define uartNRxErrors               uart1RxErrors
 #define uartNTxSend                 uart1TxSend
 #define uartNTxSendByte             uart1TxSendByte
+#define uartNTxSendNineBits         uart1TxSendNineBits
+#define uartNRxReceiveNineBits      uart1RxReceiveNineBits
 #endif
 
-static volatile uint8 XDATA uartTxBuffer[256];         // sizeof(uartTxBuffer) must be a power of two
-static volatile uint8 DATA uartTxBufferMainLoopIndex;  // Index of next byte main loop will write.
-static volatile uint8 DATA uartTxBufferInterruptIndex; // Index of next byte interrupt will read.
+// The buffer sizes are set for each UART in lib_options.mk.
+#ifndef UART_TX_BUFFER_SIZE
+#define UART_TX_BUFFER_SIZE 256
+#endif
+
+#ifndef UART_RX_BUFFER_SIZE
+#define UART_RX_BUFFER_SIZE 256
+#endif
+
+#if (UART_TX_BUFFER_SIZE & (UART_TX_BUFFER_SIZE - 1)) || UART_TX_BUFFER_SIZE < 2 || UART_TX_BUFFER_SIZE > 2048
+#error UART_TX_BUFFER_SIZE must be a power of two between 2 and 2048.
+#endif
+
+// 9-bit mode needs XDATA for the ninth bits, so it is only available if it is
+// enabled for the UART in lib_options.mk.
+#ifndef UART_NINE_BIT
+#define UART_NINE_BIT 0
+#endif
+
+#if (UART_RX_BUFFER_SIZE & (UART_RX_BUFFER_SIZE - 1)) || UART_RX_BUFFER_SIZE < 4 || UART_RX_BUFFER_SIZE > 2048
+#error UART_RX_BUFFER_SIZE must be a power of two between 4 and 2048.
+#endif
+
+// Buffers bigger than 256 bytes need 16-bit indices.  The interrupts can
+// not read or write a 16-bit index while the main loop is in the middle of
+// reading or writing it, so the main loop disables the interrupt around
+// those accesses.  With 8-bit indices, the accesses are atomic and the locks
+// do nothing.  The indices are also used by the DMA interrupt (see the
+// "DMA mode" comment below), so the locks disable it too.
+#if UART_TX_BUFFER_SIZE > 256
+typedef uint16 UART_TX_INDEX;
+static BIT uartTxLockSaved;
+static BIT uartTxLockSavedDma;
+#define UART_TX_LOCK()      { uartTxLockSaved = (IEN2 & BV_UTXNIE) ? 1 : 0; uartTxLockSavedDma = DMAIE; IEN2 &= ~BV_UTXNIE; DMAIE = 0; }
+#define UART_TX_UNLOCK()    { DMAIE = uartTxLockSavedDma; if (uartTxLockSaved) { IEN2 |= BV_UTXNIE; } }
+#else
+typedef uint8 UART_TX_INDEX;
+#define UART_TX_LOCK()
+#define UART_TX_UNLOCK()
+#endif
+
+#if UART_RX_BUFFER_SIZE > 256
+typedef uint16 UART_RX_INDEX;
+static BIT uartRxLockSaved;
+static BIT uartRxLockSavedDma;
+#define UART_RX_LOCK()      { uartRxLockSaved = URXNIE; uartRxLockSavedDma = DMAIE; URXNIE = 0; DMAIE = 0; }
+#define UART_RX_UNLOCK()    { DMAIE = uartRxLockSavedDma; URXNIE = uartRxLockSaved; }
+#else
+typedef uint8 UART_RX_INDEX;
+#define UART_RX_LOCK()
+#define UART_RX_UNLOCK()
+#endif
+
+static volatile uint8 XDATA uartTxBuffer[UART_TX_BUFFER_SIZE];
+static volatile UART_TX_INDEX DATA uartTxBufferMainLoopIndex;  // Index of next byte main loop will write.
+static volatile UART_TX_INDEX DATA uartTxBufferInterruptIndex; // Index of next byte interrupt will read.
+
+#define UART_TX_BUFFER_FREE_BYTES() ((UART_TX_INDEX)(uartTxBufferInterruptIndex - uartTxBufferMainLoopIndex - 1) & (sizeof(uartTxBuffer) - 1))
+
+static volatile uint8 XDATA uartRxBuffer[UART_RX_BUFFER_SIZE];
+static volatile UART_RX_INDEX DATA uartRxBufferMainLoopIndex;  // Index of next byte main loop will read.
+static volatile UART_RX_INDEX DATA uartRxBufferInterruptIndex; // Index of next byte interrupt will write.
+
+#define UART_RX_BUFFER_FREE_BYTES() ((UART_RX_INDEX)(uartRxBufferMainLoopIndex - uartRxBufferInterruptIndex - 1) & (sizeof(uartRxBuffer) - 1))
+#define UART_RX_BUFFER_USED_BYTES() ((UART_RX_INDEX)(uartRxBufferInterruptIndex - uartRxBufferMainLoopIndex) & (sizeof(uartRxBuffer) - 1))
+
+// When flow control is enabled, RTS is deasserted when fewer than
+// UART_RX_RTS_OFF_FREE bytes are free in the RX buffer, which leaves room for
+// the bytes the other device sends before it notices.  RTS is asserted again
+// when at least UART_RX_RTS_ON_FREE bytes are free.
+#define UART_RX_RTS_OFF_FREE        (UART_RX_BUFFER_SIZE / 8)
+#define UART_RX_RTS_ON_FREE         (UART_RX_BUFFER_SIZE / 4)
+
+/* DMA mode:
+ *
+ * In DMA mode, the RX DMA channel copies 16 bits from the UART into
+ * uartRxBuffer every time a byte is received: the byte from UNDBUF, and the
+ * contents of the next register, UNBAUD.  The channel uses repeated transfers,
+ * so it wraps around to the beginning of the buffer on its own.  The CC2511
+ * does not let us read how far the DMA has gotten, so the main loop finds the
+ * new bytes by looking at their second byte (the "mark"): a slot whose mark
+ * equals UNBAUD has just been written by the DMA, and after the main loop reads
+ * a slot it sets the mark to ~UNBAUD.  In this mode the RX indices count slots
+ * instead of bytes, and uartRxBufferInterruptIndex is updated by the main loop.
+ *
+ * The RX DMA channel must never write over a slot that the main loop has not
+ * read, so each RX transfer only covers the free slots from uartRxDmaNext up to
+ * the end of the buffer, or up to the slot before uartRxBufferMainLoopIndex,
+ * whichever comes first.  When a transfer finishes, the DMA interrupt calls
+ * uartRxDmaFinished, which arms the next one.  If no slots are free, the
+ * channel stays disarmed (uartRxDmaStalled) and, like in interrupt mode, the
+ * bytes received until the main loop reads some are discarded and reported as
+ * an overrun; uartRxDmaService arms the channel again.  A byte that arrives
+ * while the channel is being re-armed does not trigger it, but it stays in
+ * UNDBUF with UNCSR.RX_BYTE set, so uartRxDmaCatchUp triggers the channel for
+ * it.  That only works if the DMA interrupt runs within one character time of
+ * the end of the transfer; otherwise another byte overwrites it.
+ *
+ * The TX DMA channel sends the bytes at the front of uartTxBuffer, up to the
+ * end of the buffer, as one linear transfer triggered by the UART.  When a
+ * transfer finishes, the DMA interrupt calls uartTxDmaFinished, which removes
+ * the bytes from the buffer and, if more bytes have been queued, arms the next
+ * transfer right away, so the bytes keep going out even if the main loop does
+ * not call any UART functions.  At that point the last byte of the finished
+ * transfer is still in UNDBUF, and the UART generates the trigger for the
+ * first byte of the next transfer when it moves that byte into its shift
+ * register, one character time later, so there is no gap between transfers.
+ *
+ * The UART does not tell us when UNDBUF is empty (the UTX interrupt flag was
+ * already set by the previous transfers), so when the main loop starts a
+ * transfer, it only triggers the first byte itself if the last transfer
+ * finished at least uartTxDmaGap ticks of Timer 4 (one character time) ago.
+ * Otherwise it leaves the transfer to be triggered by the UART, like the DMA
+ * interrupt does.  If the DMA interrupt is delayed by more than a character
+ * time (e.g. by a long interrupt of the same priority), the trigger happens
+ * before the transfer is armed and it is missed; the main loop detects that
+ * when the transfer has been armed longer than it could possibly take, and
+ * triggers it. */
+#define UART_RX_DMA_SLOT_COUNT      (sizeof(uartRxBuffer) / 2)
+#define UART_RX_DMA_DATA(slot)      uartRxBuffer[(slot) * 2]
+#define UART_RX_DMA_MARK(slot)      uartRxBuffer[(slot) * 2 + 1]
+
+/* Timing:
+ *
+ * Short times (the gap after a TX DMA transfer and the gaps between received
+ * bytes) are measured in Timer 4 ticks.  time.c sets up Timer 4 to count from
+ * 0 to T4CC0 once per millisecond, so each tick is 1/188 ms (5.33 us).
+ * A time is represented as a 16-bit number: the lower 8 bits of the
+ * millisecond count times 188, plus the Timer 4 counter, so it wraps around
+ * every 256 ms. */
+#define T4_TICKS_PER_MS             188
+#define UART_TIME_DIFF(a, b)        ((a) >= (b) ? (a) - (b) : (a) + (uint16)(256 * T4_TICKS_PER_MS) - (b))
+
+/* Framing:
+ *
+ * When the frame gap is non-zero, the RX interrupt measures the time between
+ * each received byte and the one before it.  If that gap is at least
+ * uartRxFrameGap ticks long, the next byte stored in the RX buffer starts a
+ * new frame: the interrupt adds its index and the time it was received to the
+ * frame queue.  The main loop removes a frame from the queue after it has read
+ * all of the frame's bytes.  A frame is complete if there is another frame
+ * after it in the queue, or if no bytes have been received for longer than
+ * the frame gap. */
+#define UART_RX_FRAME_COUNT         8       // Must be a power of two.
+
+static uint32 uartBaudRate = 0;           // The last baud rate passed to uartNSetBaudRate.
+static uint8 uartRxFrameGapBits = 0;      // The frame gap, in bit times.
+static uint16 uartRxFrameGap = 0;         // The frame gap, in Timer 4 ticks, or 0 if framing is disabled.
+static volatile uint16 uartRxLastTime;    // When the last byte was received.  Written by the interrupt.
+static volatile uint32 uartRxLastMs;      // The same time, in milliseconds.  Written by the interrupt.
+static volatile BIT uartRxNewFrame = 0;   // 1 iff the next byte stored should start a new frame.
+
+static volatile UART_RX_INDEX XDATA uartRxFrameStart[UART_RX_FRAME_COUNT];  // Index of the first byte of each frame.
+static volatile uint32 XDATA uartRxFrameMs[UART_RX_FRAME_COUNT];           // Time (see getMs) of the first byte of each frame.
+static volatile uint8 uartRxFrameMainLoopIndex = 0;  // Index of the oldest frame in the queue.
+static volatile uint8 uartRxFrameInterruptIndex = 0; // Index where the interrupt will add the next frame.
+
+/* Errors:
+ *
+ * Bytes with framing or parity errors are not put in the RX buffer, and
+ * neither are the bytes that arrive when the buffer is full.  Instead, the
+ * error is recorded in the error queue along with its position in the RX
+ * buffer: the index where the bad byte would have gone.  Errors that happen at
+ * the same position are combined into one entry, and if the queue is full,
+ * the new errors are combined with the newest entry.  The main loop removes an
+ * entry when uartNRxErrors is called with the RX buffer at that position.
+ * In DMA mode, the errors are only noticed when uartNRxAvailable is called,
+ * so their positions are not exact. */
+#define UART_RX_ERROR_COUNT         8       // Must be a power of two.
+
+static volatile UART_RX_INDEX XDATA uartRxErrorPosition[UART_RX_ERROR_COUNT];
+static volatile uint8 XDATA uartRxErrorFlags[UART_RX_ERROR_COUNT];   // ACM_SERIAL_STATE_* bits.
+static volatile uint8 uartRxErrorMainLoopIndex = 0;   // Index of the oldest error in the queue.
+static volatile uint8 uartRxErrorInterruptIndex = 0;  // Index where the next error will be added.
+
+// Records errors (ACM_SERIAL_STATE_* bits) at the current position of the
+// RX buffer.  This is a macro so that it can be used in the RX interrupt and
+// in uartRxDmaService.
+#define UART_RX_ADD_ERROR(flags)                                                    \
+{                                                                                   \
+    uint8 last = (uartRxErrorInterruptIndex - 1) & (UART_RX_ERROR_COUNT - 1);       \
+    uint8 next = (uartRxErrorInterruptIndex + 1) & (UART_RX_ERROR_COUNT - 1);       \
+    if (uartRxErrorInterruptIndex != uartRxErrorMainLoopIndex &&                    \
+        (uartRxErrorPosition[last] == uartRxBufferInterruptIndex || next == uartRxErrorMainLoopIndex)) \
+    {                                                                               \
+        uartRxErrorFlags[last] |= (flags);                                          \
+    }                                                                               \
+    else                                                                            \
+    {                                                                               \
+        uartRxErrorPosition[uartRxErrorInterruptIndex] = uartRxBufferInterruptIndex; \
+        uartRxErrorFlags[uartRxErrorInterruptIndex] = (flags);                      \
+        uartRxErrorInterruptIndex = next;                                           \
+    }                                                                               \
+}
+
+static uint8 uartRxDmaChannel = DMA_CHANNEL_NONE;
+static uint8 uartTxDmaChannel = DMA_CHANNEL_NONE;
+static BIT uartRxDma = 0;                 // 1 iff RX is done with DMA.
+static BIT uartTxDma = 0;                 // 1 iff TX can be done with DMA.
+static volatile DMA_CONFIG XDATA * uartTxDmaConfig;
+static volatile UART_TX_INDEX uartTxDmaLength = 0; // Length of the current TX DMA transfer, or 0 if there is none.
+static volatile BIT uartTxDmaChained = 0; // 1 iff the current TX DMA transfer waits for the UART to trigger it.
+static volatile uint32 uartTxDmaDoneMs;   // When the last TX DMA transfer finished (see getMsFromIsr).
+static volatile uint8 uartTxDmaDoneTicks; // The Timer 4 count at that time.
+static uint8 uartTxDmaGap = 0;            // Timer 4 ticks to wait after a TX transfer, or 0 if TX DMA should not be used.
+
+static BIT uartTxDmaLockSaved;
+#define UART_TX_DMA_LOCK()      { uartTxDmaLockSaved = DMAIE; DMAIE = 0; }
+#define UART_TX_DMA_UNLOCK()    { DMAIE = uartTxDmaLockSaved; }
 
-#define UART_TX_BUFFER_FREE_BYTES() ((uartTxBufferInterruptIndex - uartTxBufferMainLoopIndex - 1) & (sizeof(uartTxBuffer) - 1))
+static volatile DMA_CONFIG XDATA * uartRxDmaConfig;
+static volatile UART_RX_INDEX uartRxDmaNext;  // The slot after the last one of the current RX DMA transfer.
+static volatile BIT uartRxDmaStalled = 0; // 1 iff the RX DMA channel is disarmed because no slots are free.
+static volatile BIT uartRxDmaDropped = 0; // 1 iff a byte was discarded because no slots were free.
+static volatile uint8 uartRxDmaCsr = 0;   // The UNCSR error bits (FE and ERR) read by uartRxDmaCatchUp.
 
-static volatile uint8 XDATA uartRxBuffer[256];     // sizeof(uartRxBuffer) must be a power of two
-static volatile uint8 DATA uartRxBufferMainLoopIndex;  // Index of next byte main loop will read.
-static volatile uint8 DATA uartRxBufferInterruptIndex; // Index of next byte interrupt will write.
+static BIT uartRxDmaLockSaved;
+#define UART_RX_DMA_LOCK()      { uartRxDmaLockSaved = DMAIE; DMAIE = 0; }
+#define UART_RX_DMA_UNLOCK()    { DMAIE = uartRxDmaLockSaved; }
 
-#define UART_RX_BUFFER_FREE_BYTES() ((uartRxBufferMainLoopIndex - uartRxBufferInterruptIndex - 1) & (sizeof(uartRxBuffer) - 1))
-#define UART_RX_BUFFER_USED_BYTES() ((uartRxBufferInterruptIndex - uartRxBufferMainLoopIndex) & (sizeof(uartRxBuffer) - 1))
+static volatile BIT uartFlowControl = 0;  // 1 iff RTS/CTS flow control is enabled.
+
+/* RS-485:
+ *
+ * When a driver enable (DE) pin is configured, the TX interrupt drives it high
+ * before it writes the first byte of a transmission to UNDBUF.  When the TX
+ * interrupt runs and finds the TX buffer empty, the last byte has just moved
+ * into the UART's shift register.  The CC2511 has no interrupt for the end of
+ * a transmission, so the interrupt records the time in uartTxStopMs and
+ * uartTxStopTicks and sets an alarm (see timeSetAlarm) for uartCharTicks
+ * later, which is right after the last stop bit.  The alarm runs uartDeRelease
+ * from the Timer 4 interrupt, which drives DE low.  We do not poll
+ * UNCSR.ACTIVE because reading UNCSR clears the RX error bits.  If no alarm
+ * was available, the main loop (uartTxService) drives DE low instead.  If echo
+ * suppression is enabled, the RX interrupt discards the bytes received while
+ * DE is high (the transceiver's copy of the bytes we are sending). */
+static uint8 uartDePort = 0xFF;           // The port of the DE pin (0 or 1), or 0xFF if there is none.
+static uint8 uartDeMask;                  // The bit of the DE pin in its port.
+static volatile BIT uartDeAsserted = 0;   // 1 iff the DE pin is high.
+static BIT uartRxSuppressEcho = 0;        // 1 iff bytes received while DE is high should be discarded.
+static volatile uint32 uartTxStopMs;      // When the TX interrupt last disabled itself (see getMsFromIsr).
+                                          // The byte the UART was sending then ends one character time later.
+static volatile uint8 uartTxStopTicks;    // The Timer 4 count at that time.
+static uint32 uartCharTicks;              // The length of a character, in Timer 4 ticks.
+static uint16 uartCharMs;                 // The same length, in whole milliseconds...
+static uint8 uartCharExtraTicks;          // ...plus this many Timer 4 ticks.
+static uint8 uartDeAlarm = TIME_ALARM_NONE; // The alarm that releases the DE pin (see timeAllocateAlarm).
+static volatile uint32 uartDeReleaseMs;   // When that alarm is set to go off.
+static volatile uint8 uartDeReleaseTicks; // The Timer 4 count at that time.
+
+/* 9-bit mode:
+ *
+ * In 9-bit mode, the UART is set up as if for mark parity (UNUCR.BIT9 = 1,
+ * UNUCR.PARITY = 0), so the ninth bit of each byte sent is UNUCR.D9.  The
+ * CC2511 does not have a register that holds the ninth bit of a received byte,
+ * but it compares that bit to D9 and sets UNCSR.ERR if they are different, so
+ * the RX interrupt can work out what the bit was.  The ninth bit of each byte
+ * in the TX and RX buffers is stored in a bit array next to the buffer.
+ *
+ * D9 can not be changed until the byte that is being sent has finished,
+ * because that byte's ninth bit might not have been sent yet.  So when the TX
+ * interrupt finds that the next byte needs a different D9, it stops sending:
+ * it disables itself, records the time like it does for the DE pin (see the
+ * "RS-485" comment), and sets uartTxD9Pending.  After one character time, the
+ * main loop (uartTxService) changes D9 and enables the TX interrupt again.
+ * The main loop only changes D9 while no received byte is waiting for the RX
+ * interrupt, because the RX interrupt uses D9 to work out the ninth bit.  A
+ * byte that is being received while D9 changes can still get the wrong ninth
+ * bit, so 9-bit mode is meant for half-duplex links.
+ *
+ * The bit arrays take (UART_TX_BUFFER_SIZE + UART_RX_BUFFER_SIZE) / 8 bytes of
+ * XDATA, so they only exist if UART_NINE_BIT is 1. */
+#if UART_NINE_BIT
+static volatile uint8 XDATA uartTxNinthBits[(UART_TX_BUFFER_SIZE + 7) / 8];
+static volatile uint8 XDATA uartRxNinthBits[(UART_RX_BUFFER_SIZE + 7) / 8];
+#define UART_NINTH_BIT(bits, i)         ((bits)[(i) >> 3] & (1 << ((i) & 7)))
+#define UART_SET_NINTH_BIT(bits, i)     { (bits)[(i) >> 3] |= (1 << ((i) & 7)); }
+#define UART_CLEAR_NINTH_BIT(bits, i)   { (bits)[(i) >> 3] &= ~(1 << ((i) & 7)); }
+#else
+#define UART_NINTH_BIT(bits, i)         0
+#define UART_SET_NINTH_BIT(bits, i)     {}
+#define UART_CLEAR_NINTH_BIT(bits, i)   {}
+#endif
+static volatile BIT uartNineBit = 0;      // 1 iff 9-bit mode is enabled.
+static volatile BIT uartTxD9Pending = 0;  // 1 iff the TX interrupt is waiting for the main loop to change D9.
+static BIT uartRxAddressFilter = 0;       // 1 iff the RX interrupt discards bytes that are not for us.
+static uint8 uartRxAddress;               // Our address, when uartRxAddressFilter is 1.
+static volatile BIT uartRxAddressed = 0;  // 1 iff the last address byte received was ours.
+
+#define UART_DE_HIGH()  { if (uartDePort) { P1 |= uartDeMask; } else { P0 |= uartDeMask; } }
+#define UART_DE_LOW()   { if (uartDePort) { P1 &= ~uartDeMask; } else { P0 &= ~uartDeMask; } }
+
+BIT uartNDmaEnabled = 0;
 
 volatile BIT uartNRxParityErrorOccurred;
 volatile BIT uartNRxFramingErrorOccurred;
 volatile BIT uartNRxBufferFullOccurred;
 
+// Returns the current time (see the "Timing" comment above).
+// This must only be called from the main loop.
+static uint16 uartTime(void)
+{
+    uint8 ms;
+    uint8 ticks;
+
+    // If Timer 4 overflows between reading the milliseconds and reading the
+    // counter, the two numbers would not match, so try again.
+    do
+    {
+        ms = getMs();
+        ticks = T4CNT;
+    } while ((uint8)getMs() != ms);
+
+    return (uint16)ms * T4_TICKS_PER_MS + ticks;
+}
+
+// Returns the number of Timer 4 ticks that have passed since a time that was
+// recorded by an interrupt (a count from getMsFromIsr and the Timer 4 count
+// passed to it).  This must only be called from the main loop.
+static uint32 uartTicksSince(uint32 ms, uint8 ticks)
+{
+    uint32 nowMs;
+    uint8 nowTicks;
+
+    do
+    {
+        nowMs = getMs();
+        nowTicks = T4CNT;
+    } while (getMs() != nowMs);
+
+    nowMs -= ms;
+    if (nowMs > 60000)
+    {
+        // Longer than anything we measure; do not let the result overflow.
+        return 0xFFFFFFFF;
+    }
+    return nowMs * T4_TICKS_PER_MS + nowTicks - ticks;
+}
+
+// Works out the length of a character from the baud rate (23 if it has not
+// been set) and the frame format: the start bit, 8 data bits, the parity or
+// ninth bit if there is one, and the stop bits.
+static void uartUpdateCharTicks(void)
+{
+    uint8 bits = 10;
+
+    if (UNUCR & 0x10)   // UNUCR.BIT9 (4)
+    {
+        bits++;
+    }
+    if (UNUCR & 0x04)   // UNUCR.SPB (2)
+    {
+        bits++;
+    }
+
+    // Timer 4 ticks 187500 times per second.  Add 2 ticks because we only
+    // know the time to within a tick.
+    uartCharTicks = (uint32)bits * 187500 / (uartBaudRate ? uartBaudRate : 23) + 2;
+    uartCharMs = uartCharTicks / T4_TICKS_PER_MS;
+    uartCharExtraTicks = uartCharTicks % T4_TICKS_PER_MS;
+}
+
+// Called from the Timer 4 interrupt by the alarm that the TX interrupt sets
+// when it sends the last byte in the TX buffer (see the "RS-485" comment).
+static void uartDeRelease(void)
+{
+    uint8 ticks = T4CNT;
+    uint32 ms = getMsFromIsr(ticks);
+
+    // The TX interrupt has a higher priority than this one, so keep it from
+    // starting a new byte while we decide.  If it sent more bytes after
+    // setting the alarm, it moved uartDeReleaseMs later.
+    EA = 0;
+    if (uartDeAsserted && !(IEN2 & BV_UTXNIE) && !uartTxD9Pending &&
+        ((int32)(ms - uartDeReleaseMs) > 0 || (ms == uartDeReleaseMs && ticks >= uartDeReleaseTicks)))
+    {
+        UART_DE_LOW();
+        uartDeAsserted = 0;
+    }
+    EA = 1;
+}
+
+// Returns 1 iff there are bytes that have not been sent yet, or the DE pin
+// has not been released yet.
+static BIT uartTxBusy(void)
+{
+    return (IEN2 & BV_UTXNIE) || uartTxDmaLength || uartTxD9Pending || uartDeAsserted ||
+        uartTxBufferInterruptIndex != uartTxBufferMainLoopIndex;
+}
+
+// Returns the number of bytes that can be added to the RX buffer before it is
+// full.  This must only be called from the main loop.
+static UART_RX_INDEX uartRxFreeBytes(void)
+{
+    UART_RX_INDEX free;
+
+    if (uartRxDma)
+    {
+        return (UART_RX_INDEX)(uartRxBufferMainLoopIndex - uartRxBufferInterruptIndex - 1) & (UART_RX_DMA_SLOT_COUNT - 1);
+    }
+
+    UART_RX_LOCK();
+    free = UART_RX_BUFFER_FREE_BYTES();
+    UART_RX_UNLOCK();
+    return free;
+}
+
+// Arms the RX DMA channel to fill the free slots after the current transfer
+// (see the "DMA mode" comment).  If no slots are free, this leaves the channel
+// disarmed and sets uartRxDmaStalled.  This is called from the DMA interrupt,
+// or from the main loop with the DMA interrupt disabled.
+static void uartRxDmaArm(void)
+{
+    UART_RX_INDEX start = uartRxDmaNext & (UART_RX_DMA_SLOT_COUNT - 1);
+    UART_RX_INDEX end = (uartRxBufferMainLoopIndex - 1) & (UART_RX_DMA_SLOT_COUNT - 1);
+
+    if (start == end)
+    {
+        uartRxDmaStalled = 1;
+        if (uartFlowControl)
+        {
+            UART_RTS = 1;  // Deassert RTS.
+        }
+        return;
+    }
+    if (end < start)
+    {
+        // Only fill the slots up to the end of the buffer; the rest will be
+        // filled by the next transfer.
+        end = UART_RX_DMA_SLOT_COUNT;
+    }
+
+    uartRxDmaConfig->DESTADDRH = (unsigned int)&UART_RX_DMA_DATA(start) >> 8;
+    uartRxDmaConfig->DESTADDRL = (unsigned int)&UART_RX_DMA_DATA(start);
+    uartRxDmaConfig->VLEN_LENH = (end - start) >> 8;
+    uartRxDmaConfig->LENL = (end - start) & 0xFF;
+    uartRxDmaNext = end;
+    uartRxDmaStalled = 0;
+
+    DMAARM = (1<<uartRxDmaChannel);
+}
+
+// Handles a byte that is waiting in UNDBUF because it arrived while the RX DMA
+// channel was disarmed (see the "DMA mode" comment): triggers the channel to
+// copy it, or discards it if the channel is stalled.  Returns 1 iff it
+// discarded a byte.  This also saves the UNCSR error bits for
+// uartRxDmaService, because reading UNCSR clears them.  This is called from
+// the DMA interrupt, or from the main loop with the DMA interrupt disabled.
+static BIT uartRxDmaCatchUp(void)
+{
+    uint8 csr = UNCSR;
+    uartRxDmaCsr |= csr & 0x18;
+
+    if (!(csr & 0x04)) // UNCSR.RX_BYTE (2) == 0
+    {
+        return 0;
+    }
+
+    if (uartRxDmaStalled)
+    {
+        // Reading UNDBUF clears UNCSR.RX_BYTE.
+        csr = UNDBUF;
+        return 1;
+    }
+
+    // If the channel was armed when the byte arrived, the DMA is about to copy
+    // it (which clears UNCSR.RX_BYTE), so give it time to do that.  The
+    // datasheet also says to wait 9 cycles after arming before triggering.
+    __asm nop __endasm; __asm nop __endasm; __asm nop __endasm;
+    __asm nop __endasm; __asm nop __endasm; __asm nop __endasm;
+    __asm nop __endasm; __asm nop __endasm; __asm nop __endasm;
+    csr = UNCSR;
+    uartRxDmaCsr |= csr & 0x18;
+    if (csr & 0x04)
+    {
+        DMAREQ = (1<<uartRxDmaChannel);
+    }
+    return 0;
+}
+
+// Called from the DMA interrupt when an RX DMA transfer finishes, which means
+// that the last slot before uartRxDmaNext has just been written.
+static void uartRxDmaFinished(void)
+{
+    uartRxDmaArm();
+    if (uartRxDmaCatchUp())
+    {
+        uartRxDmaDropped = 1;
+    }
+}
+
+// Configures and arms the RX DMA channel, discarding any bytes in the RX buffer.
+// This must be called again whenever UNBAUD changes because UNBAUD is the mark
+// of the new bytes.
+static void uartRxDmaStart(void)
+{
+    UART_RX_INDEX i;
+
+    UART_RX_DMA_LOCK();
+    DMAARM = 0x80 | (1<<uartRxDmaChannel);  // Abort the transfer, if any.
+    DMAIRQ = ~(1<<uartRxDmaChannel);        // Forget about the last transfer finishing.
+
+    for (i = 0; i < UART_RX_DMA_SLOT_COUNT; i++)
+    {
+        UART_RX_DMA_MARK(i) = ~UNBAUD;
+    }
+    uartRxBufferMainLoopIndex = 0;
+    uartRxBufferInterruptIndex = 0;
+    uartRxDmaNext = 0;
+    uartRxDmaDropped = 0;
+    uartRxDmaCsr = 0;
+
+    uartRxDmaArm();
+    UART_RX_DMA_UNLOCK();
+}
+
+// Finds the slots that the RX DMA channel filled since the last time this was
+// called, re-arms the channel if it stalled, and checks for errors.
+static void uartRxDmaService(void)
+{
+    uint8 csr;
+    uint8 mark = UNBAUD;
+    BIT stalled;
+    BIT dropped;
+
+    // If the channel is stalled, it has finished writing, so the loop below
+    // finds all the slots it filled before we discard any bytes.
+    UART_RX_DMA_LOCK();
+    stalled = uartRxDmaStalled;
+    dropped = uartRxDmaDropped;
+    uartRxDmaDropped = 0;
+    UART_RX_DMA_UNLOCK();
+
+    while (UART_RX_DMA_MARK(uartRxBufferInterruptIndex) == mark)
+    {
+        UART_RX_INDEX next = (uartRxBufferInterruptIndex + 1) & (UART_RX_DMA_SLOT_COUNT - 1);
+        if (next == uartRxBufferMainLoopIndex)
+        {
+            // The channel never writes the slot before the main loop's, so
+            // this should not happen.
+            break;
+        }
+        uartRxBufferInterruptIndex = next;
+    }
+
+    if (stalled)
+    {
+        UART_RX_DMA_LOCK();
+        if (uartRxDmaCatchUp())
+        {
+            dropped = 1;
+        }
+        uartRxDmaArm();
+        if (!uartRxDmaStalled)
+        {
+            uartRxDmaCatchUp();
+        }
+        UART_RX_DMA_UNLOCK();
+    }
+
+    if (dropped)
+    {
+        uartNRxBufferFullOccurred = 1;
+        UART_RX_ADD_ERROR(ACM_SERIAL_STATE_OVERRUN);
+    }
+
+    if (uartFlowControl && uartRxFreeBytes() < UART_RX_RTS_OFF_FREE)
+    {
+        UART_RTS = 1;  // Deassert RTS.
+    }
+
+    // We can not tell which byte had an error, but we can at least report it.
+    // Reading UNCSR clears the FE and ERR bits.
+    UART_RX_DMA_LOCK();
+    csr = UNCSR | uartRxDmaCsr;
+    uartRxDmaCsr = 0;
+    UART_RX_DMA_UNLOCK();
+    if (csr & 0x10) // UNCSR.FE (4) == 1
+    {
+        uartNRxFramingErrorOccurred = 1;
+        UART_RX_ADD_ERROR(ACM_SERIAL_STATE_FRAMING);
+    }
+    if (csr & 0x08) // UNCSR.ERR (3) == 1
+    {
+        uartNRxParityErrorOccurred = 1;
+        UART_RX_ADD_ERROR(ACM_SERIAL_STATE_PARITY);
+    }
+}
+
+// Arms the TX DMA channel to send the bytes at the front of uartTxBuffer, up to
+// the end of the buffer.  The transfer starts at the next trigger from the
+// UART, or when the caller triggers it.  This is called from the DMA interrupt,
+// or from the main loop with the DMA interrupt disabled.
+static void uartTxDmaArm(void)
+{
+    if (uartTxBufferMainLoopIndex > uartTxBufferInterruptIndex)
+    {
+        uartTxDmaLength = uartTxBufferMainLoopIndex - uartTxBufferInterruptIndex;
+    }
+    else
+    {
+        // Only send the bytes up to the end of the buffer; the rest will be
+        // sent in the next transfer.
+        uartTxDmaLength = sizeof(uartTxBuffer) - uartTxBufferInterruptIndex;
+    }
+
+    uartTxDmaConfig->SRCADDRH = (unsigned int)&uartTxBuffer[uartTxBufferInterruptIndex] >> 8;
+    uartTxDmaConfig->SRCADDRL = (unsigned int)&uartTxBuffer[uartTxBufferInterruptIndex];
+    uartTxDmaConfig->VLEN_LENH = uartTxDmaLength >> 8;
+    uartTxDmaConfig->LENL = uartTxDmaLength & 0xFF;
+
+    DMAARM = (1<<uartTxDmaChannel);
+}
+
+// Returns 1 iff the bytes in the TX buffer can be sent with DMA.
+static BIT uartTxDmaAllowed(void)
+{
+    // When CTS is deasserted, the last byte of a DMA transfer can stay in
+    // UNDBUF for a long time, so we can not use DMA with flow control.
+    // The DE pin and the ninth bit are set by the TX interrupt, so we can
+    // not use DMA with them either.
+    return uartTxDma && !uartFlowControl && uartDePort == 0xFF && !uartNineBit;
+}
+
+// Called from the DMA interrupt when a TX DMA transfer finishes, which means
+// that its last byte has just been written to UNDBUF.
+static void uartTxDmaFinished(void)
+{
+    uartTxDmaDoneTicks = T4CNT;
+    uartTxDmaDoneMs = getMsFromIsr(uartTxDmaDoneTicks);
+
+    uartTxBufferInterruptIndex = (uartTxBufferInterruptIndex + uartTxDmaLength) & (sizeof(uartTxBuffer) - 1);
+    uartTxDmaLength = 0;
+
+    if (uartTxBufferInterruptIndex != uartTxBufferMainLoopIndex && uartTxDmaAllowed())
+    {
+        // The UART will trigger this transfer when it moves the byte that is
+        // in UNDBUF now into its shift register.
+        uartTxDmaArm();
+        uartTxDmaChained = 1;
+    }
+}
+
+// Makes sure that the bytes in the TX buffer will be sent, using DMA if
+// possible.  This must only be called from the main loop.
+static void uartTxService(void)
+{
+    UART_TX_DMA_LOCK();
+
+    if (uartDeAsserted && !(IEN2 & BV_UTXNIE) && uartTxBufferInterruptIndex == uartTxBufferMainLoopIndex &&
+        uartTicksSince(uartTxStopMs, uartTxStopTicks) >= uartCharTicks)
+    {
+        // The last byte has been sent (see the "RS-485" comment), and the TX
+        // interrupt is disabled, so it can not send another one now.
+        UART_DE_LOW();
+        uartDeAsserted = 0;
+    }
+
+    if (uartTxD9Pending && uartTicksSince(uartTxStopMs, uartTxStopTicks) >= uartCharTicks)
+    {
+        // The last byte has been sent, so change D9 for the next one (see the
+        // "9-bit mode" comment), unless the RX interrupt has a byte to read.
+        URXNIE = 0;
+        if (!URXNIF)
+        {
+            UNUCR ^= 0x20;  // UNUCR.D9
+            uartTxD9Pending = 0;
+        }
+        URXNIE = 1;  // 9-bit mode is not used with RX DMA.
+    }
+
+    if (uartTxDmaLength)
+    {
+        // A transfer is going on, and uartTxDmaFinished will take care of the
+        // next one.  A transfer can take at most one character time per byte,
+        // plus one for the byte that was in UNDBUF when it was armed, so if
+        // it has been armed longer than that, it missed its trigger.  The
+        // UART is idle, so we can trigger it ourselves.
+        if (uartTxDmaChained && (DMAARM & (1<<uartTxDmaChannel)) &&
+            uartTicksSince(uartTxDmaDoneMs, uartTxDmaDoneTicks) > (uint32)(uartTxDmaLength + 1) * uartTxDmaGap)
+        {
+            uartTxDmaChained = 0;
+            DMAREQ = (1<<uartTxDmaChannel);
+        }
+    }
+    else if (!uartTxDmaAllowed())
+    {
+        // The TX interrupt disables itself when the buffer is empty, and it
+        // must not run again before there is something to send, because it
+        // would record a new stop time and keep the DE pin high.
+        if (!(IEN2 & BV_UTXNIE) && !uartTxD9Pending && uartTxBufferInterruptIndex != uartTxBufferMainLoopIndex &&
+            uartTicksSince(uartTxDmaDoneMs, uartTxDmaDoneTicks) >= uartTxDmaGap)
+        {
+            // The last byte of the last DMA transfer (if any) has left UNDBUF,
+            // so the TX interrupt will not overwrite it.
+            IEN2 |= BV_UTXNIE; // Enable TX interrupt
+        }
+    }
+    else if (!(IEN2 & BV_UTXNIE) && uartTxBufferInterruptIndex != uartTxBufferMainLoopIndex)
+    {
+        // There are bytes to send, and the TX interrupt is not sending them
+        // (it might be if the baud rate was changed recently).
+        uartTxDmaArm();
+
+        if (uartTicksSince(uartTxDmaDoneMs, uartTxDmaDoneTicks) >= uartTxDmaGap)
+        {
+            // UNDBUF is empty, so the UART will not generate the trigger for
+            // the first byte; we have to do it.  The datasheet says to wait 9
+            // cycles after arming.
+            __asm nop __endasm; __asm nop __endasm; __asm nop __endasm;
+            __asm nop __endasm; __asm nop __endasm; __asm nop __endasm;
+            __asm nop __endasm; __asm nop __endasm; __asm nop __endasm;
+            DMAREQ = (1<<uartTxDmaChannel);
+            uartTxDmaChained = 0;
+        }
+        else
+        {
+            uartTxDmaChained = 1;
+        }
+    }
+
+    UART_TX_DMA_UNLOCK();
+}
+
+// Stops sending: discards the bytes in the TX buffer that have not been sent,
+// aborts the byte that the UART is sending, and releases the DE pin.  This
+// must only be called from the main loop.
+static void uartTxAbort(void)
+{
+    UART_TX_DMA_LOCK();
+    IEN2 &= ~BV_UTXNIE;
+    if (uartTxDmaChannel != DMA_CHANNEL_NONE)
+    {
+        DMAARM = 0x80 | (1<<uartTxDmaChannel);  // Abort the TX transfer, if any.
+    }
+    uartTxDmaLength = 0;
+    uartTxDmaChained = 0;
+    uartTxD9Pending = 0;
+
+    UART_TX_LOCK();
+    uartTxBufferInterruptIndex = uartTxBufferMainLoopIndex;
+    UART_TX_UNLOCK();
+
+    UNUCR |= 0x80;  // UNUCR.FLUSH: Stop the current operation.
+    UTXNIF = 1;     // UNDBUF is empty, so the TX interrupt can run when it is enabled.
+    uartTxDmaDoneMs = getMs() - 1000;
+    uartTxStopMs = getMs() - 1000;
+    UART_TX_DMA_UNLOCK();
+
+    if (uartDeAsserted)
+    {
+        UART_DE_LOW();
+        uartDeAsserted = 0;
+    }
+}
+
 void uartNInit(void)
 {
     /* USART0 UART Alt. 1:
@@ -96,6 +874,51 @@ void uartNInit(void)
      *                     RX  = P1_7
      */
 
+    if (uartNDmaEnabled)
+    {
+        // Reserve the DMA channels the first time this is called.  If there
+        // are not enough free channels, we use interrupts instead.
+        if (uartRxDmaChannel == DMA_CHANNEL_NONE)
+        {
+            uartRxDmaChannel = dmaAllocateChannel();
+            if (uartRxDmaChannel != DMA_CHANNEL_NONE)
+            {
+                // These parts of the configuration never change.
+                uartRxDmaConfig = dmaChannelConfig(uartRxDmaChannel);
+                uartRxDmaConfig->SRCADDRH = XDATA_SFR_ADDRESS(UNDBUF) >> 8;
+                uartRxDmaConfig->SRCADDRL = XDATA_SFR_ADDRESS(UNDBUF);
+                uartRxDmaConfig->DC6 = 0b10000000 | URXN_DMA_TRIGGER; // WORDSIZE = 1, TMODE = 00 (single), TRIG = URXN
+                uartRxDmaConfig->DC7 = 0x18;  // SRCINC = 0, DESTINC = 1, IRQMASK = 1, M8 = 0, PRIORITY = 0
+                dmaSetCallback(uartRxDmaChannel, uartRxDmaFinished);
+            }
+        }
+        if (uartTxDmaChannel == DMA_CHANNEL_NONE)
+        {
+            uartTxDmaChannel = dmaAllocateChannel();
+            if (uartTxDmaChannel != DMA_CHANNEL_NONE)
+            {
+                // These parts of the configuration never change.
+                uartTxDmaConfig = dmaChannelConfig(uartTxDmaChannel);
+                uartTxDmaConfig->DESTADDRH = XDATA_SFR_ADDRESS(UNDBUF) >> 8;
+                uartTxDmaConfig->DESTADDRL = XDATA_SFR_ADDRESS(UNDBUF);
+                uartTxDmaConfig->DC6 = UTXN_DMA_TRIGGER; // WORDSIZE = 0, TMODE = 0, TRIG = UTXN
+                uartTxDmaConfig->DC7 = 0x48;  // SRCINC = 1, DESTINC = 0, IRQMASK = 1, M8 = 0, PRIORITY = 0
+                dmaSetCallback(uartTxDmaChannel, uartTxDmaFinished);
+            }
+        }
+    }
+    uartTxDma = 0;
+    if (uartTxDmaChannel != DMA_CHANNEL_NONE)
+    {
+        UART_TX_DMA_LOCK();
+        DMAARM = 0x80 | (1<<uartTxDmaChannel);  // Abort the TX transfer, if any.
+        uartTxDmaLength = 0;
+        UART_TX_DMA_UNLOCK();
+    }
+    uartRxDma = uartNDmaEnabled && uartRxDmaChannel != DMA_CHANNEL_NONE;
+    uartTxDmaDoneMs = getMs() - 1000;  // Long enough ago that UNDBUF is empty.
+    uartTxStopMs = getMs() - 1000;     // Long enough ago that the shift register is empty.
+
     uartTxBufferMainLoopIndex = 0;
     uartTxBufferInterruptIndex = 0;
     uartRxBufferMainLoopIndex = 0;
@@ -103,6 +926,19 @@ void uartNInit(void)
     uartNRxParityErrorOccurred = 0;
     uartNRxFramingErrorOccurred = 0;
     uartNRxBufferFullOccurred = 0;
+    uartRxErrorMainLoopIndex = 0;
+    uartRxErrorInterruptIndex = 0;
+    uartFlowControl = 0;
+    uartDePort = 0xFF;
+    uartDeAsserted = 0;
+    uartRxSuppressEcho = 0;
+    uartNineBit = 0;
+    uartTxD9Pending = 0;
+    uartRxAddressFilter = 0;
+    uartRxFrameGapBits = 0;
+    uartRxFrameGap = 0;
+    uartRxFrameMainLoopIndex = 0;
+    uartRxFrameInterruptIndex = 0;
 
     // Note: We do NOT set the mode of the RX pin to "peripheral function"
     // because that seems to have no benefits, and is actually bad because
@@ -118,6 +954,7 @@ void uartNInit(void)
 
     UNUCR = 0x82;    // Stops the "current operation" and resets settings to their defaults.
     UNCSR |= 0xc0;   // Enable UART mode and enable receiver.  TODO: change '|=' to '='
+    uartUpdateCharTicks();
 
     // Set the mode of the TX pin to "peripheral function".  This must be done AFTER
     // enabling the UART, or else we get a tiny glitch on the TX line.
@@ -136,13 +973,26 @@ void uartNInit(void)
 
     UTXNIF = 1; // Set TX flag so the interrupt fires when we enable it for the first time.
     URXNIF = 0; // Clear RX flag.
-    URXNIE = 1; // Enable Rx interrupt.
+    if (uartRxDma)
+    {
+        URXNIE = 0; // The DMA reads the bytes, so we don't need the Rx interrupt.
+        uartRxDmaStart();
+    }
+    else
+    {
+        URXNIE = 1; // Enable Rx interrupt.
+    }
     EA = 1;     // Enable interrupts in general.
+
+    // TX DMA is not used until uartNSetBaudRate is called because it needs to
+    // know the baud rate.
 }
 
 void uartNSetBaudRate(uint32 baud)
 {
     uint32 baudMPlus256;
+    uint32 originalBaud = baud;
+    uint32 gap;
     uint8 baudE = 0;
 
     // max baud rate is 1500000 (F/16); min is 23 (baudM = 1)
@@ -168,6 +1018,25 @@ void uartNSetBaudRate(uint32 baud)
     }
     UNGCR = baudE; // UNGCR.BAUD_E (4:0)
     UNBAUD = baudMPlus256; // UNBAUD.BAUD_M (7:0) - only the lowest 8 bits of baudMPlus256 are used, so this is effectively baudMPlus256 - 256
+
+    if (uartRxDma)
+    {
+        // The marks of the new bytes in the RX buffer come from UNBAUD.
+        uartRxDmaStart();
+    }
+
+    // The TX DMA gap is the length of the longest character (start bit, 8
+    // data bits, parity bit, 2 stop bits), 12 * 187500 / baud Timer 4 ticks,
+    // so it does not depend on the frame format.  Add 2 ticks because we only
+    // know the time to within a tick.  At low baud rates, the TX interrupt is
+    // not a significant load, so we do not use DMA.
+    gap = (uint32)12 * 187500 / originalBaud + 2;
+    uartTxDmaGap = gap > 255 ? 0 : gap;
+    uartTxDma = uartNDmaEnabled && uartTxDmaChannel != DMA_CHANNEL_NONE && uartTxDmaGap;
+
+    uartBaudRate = originalBaud;
+    uartUpdateCharTicks();
+    uartNSetRxFrameGap(uartRxFrameGapBits);
 }
 
 void uartNSetParity(uint8 parity)
@@ -189,7 +1058,53 @@ void uartNSetParity(uint8 parity)
     case PARITY_SPACE: tmp = 0b010 << 3; break;
     }
 
+    uartNineBit = 0;
+    uartTxD9Pending = 0;
+    uartRxAddressFilter = 0;
     UNUCR = (UNUCR & 0b01000111) | tmp;
+    uartUpdateCharTicks();
+}
+
+void uartNSetNineBit(BIT enable)
+{
+    if (uartRxDma || !UART_NINE_BIT)
+    {
+        // 9-bit mode needs the RX interrupt, and it must be enabled in
+        // lib_options.mk.
+        return;
+    }
+
+    URXNIE = 0;
+    uartRxAddressFilter = 0;
+    if (enable)
+    {
+        // Same as PARITY_MARK: D9 = 1, BIT9 = 1, PARITY = 0.
+        UNUCR = (UNUCR & 0b01000111) | (0b110 << 3);
+        uartNineBit = 1;
+    }
+    else
+    {
+        uartNineBit = 0;
+        uartTxD9Pending = 0;
+        UNUCR &= 0b01000111;
+    }
+    URXNIE = 1;
+    uartUpdateCharTicks();
+}
+
+void uartNSetRxAddressFilter(BIT enable, uint8 address)
+{
+    if (!uartNineBit)
+    {
+        return;
+    }
+
+    // Discard the rest of the current message until the next address byte.
+    URXNIE = 0;
+    uartRxAddress = address;
+    uartRxAddressed = 0;
+    uartRxAddressFilter = enable;
+    URXNIE = 1;
 }
 
 void uartNSetStopBits(uint8 stopBits)
@@ -203,11 +1118,460 @@ void uartNSetStopBits(uint8 stopBits)
         UNUCR &= ~(1<<2);   // 1 stop bit
         // NOTE: An argument of STOP_BITS_1_5 is treated the same as STOP_BITS_1.
     }
+    uartUpdateCharTicks();
+}
+
+void uartNSetFlowControl(BIT enable)
+{
+    /* USART0 flow control pins (Alt. 1):
+     *                     CTS = P0_4
+     *                     RTS = P0_5
+     */
+
+    /* USART1 flow control pins (Alt. 2):
+     *                     CTS = P1_4
+     *                     RTS = P1_5
+     */
+
+    if (enable)
+    {
+        // The UART only starts sending a byte while CTS is low.
+        // Like the RX pin, the CTS pin does not need to be set to
+        // "peripheral function".
+        UART_FLOW_PORT_DIR &= ~(1<<4);
+        UNUCR |= (1<<6);    // UNUCR.FLOW = 1
+
+        // We drive RTS ourselves instead of letting the UART do it, because
+        // the UART would only deassert it when its one-byte buffer is full.
+        UART_RTS = (uartRxFreeBytes() < UART_RX_RTS_ON_FREE);
+        UART_FLOW_PORT_DIR |= (1<<5);
+        uartFlowControl = 1;
+    }
+    else
+    {
+        uartFlowControl = 0;
+        UART_FLOW_PORT_DIR &= ~(1<<5);
+        UNUCR &= ~(1<<6);   // UNUCR.FLOW = 0
+    }
+}
+
+void uartNSetDriverEnable(uint8 pinNumber, BIT suppressEcho)
+{
+    uint8 port = pinNumber / 10;
+    uint8 mask = 1 << (pinNumber % 10);
+    UART_TX_INDEX lastIndex = uartTxBufferInterruptIndex;
+    uint32 lastMs;
+    uint8 lastTicks;
+
+    // Wait for the bytes in the TX buffer to be sent and for the old pin to be
+    // released.  If no bytes leave the buffer for longer than that should take
+    // (for example because CTS is deasserted), give up and discard them.
+    do
+    {
+        lastMs = getMs();
+        lastTicks = T4CNT;
+    } while (getMs() != lastMs);
+
+    while (uartTxBusy())
+    {
+        uartTxService();
+
+        if (uartTxBufferInterruptIndex != lastIndex)
+        {
+            lastIndex = uartTxBufferInterruptIndex;
+            do
+            {
+                lastMs = getMs();
+                lastTicks = T4CNT;
+            } while (getMs() != lastMs);
+        }
+        else if (uartTicksSince(lastMs, lastTicks) > (uint32)(uartTxDmaLength + 2) * uartCharTicks)
+        {
+            uartTxAbort();
+            break;
+        }
+    }
+
+    if (uartDePort != 0xFF)
+    {
+        // Stop driving the old pin.
+        if (uartDePort) { P1DIR &= ~uartDeMask; } else { P0DIR &= ~uartDeMask; }
+    }
+
+    uartDePort = 0xFF;
+    uartDeAsserted = 0;
+    uartRxSuppressEcho = 0;
+
+    if (pinNumber == DRIVER_ENABLE_NONE || port > 1)
+    {
+        return;
+    }
+
+    if (uartDeAlarm == TIME_ALARM_NONE)
+    {
+        // If there are no alarms left, uartTxService releases the pin.
+        uartDeAlarm = timeAllocateAlarm();
+    }
+
+    uartDeMask = mask;
+    uartDePort = port;
+    UART_DE_LOW();
+    if (port) { P1SEL &= ~mask; P1DIR |= mask; } else { P0SEL &= ~mask; P0DIR |= mask; }
+    uartRxSuppressEcho = suppressEcho;
+}
+
+void uartNSetRxFrameGap(uint8 bitTimes)
+{
+    uint32 gap = 0;
+
+    if (uartRxDma)
+    {
+        // Framing needs the RX interrupt.
+        return;
+    }
+
+    uartRxFrameGapBits = bitTimes;
+    if (bitTimes && uartBaudRate)
+    {
+        // Timer 4 ticks 187500 times per second.  Add one tick because we
+        // only know the time to within a tick, and keep the gap well below
+        // 256 ms, when the time wraps around.
+        gap = (uint32)bitTimes * 187500 / uartBaudRate + 1;
+        if (gap > 250 * T4_TICKS_PER_MS)
+        {
+            gap = 250 * T4_TICKS_PER_MS;
+        }
+    }
+
+    // Empty the frame queue; the next byte received will start a new frame.
+    URXNIE = 0;
+    uartRxFrameGap = gap;
+    uartRxFrameMainLoopIndex = uartRxFrameInterruptIndex;
+    URXNIE = 1;
+}
+
+uint16 uartNRxFrameLength(void)
+{
+    UART_RX_INDEX end;
+    UART_RX_INDEX interruptIndex;
+    uint16 lastTime;
+    uint8 next;
+
+    if (!uartRxFrameGap)
+    {
+        return 0;
+    }
+
+    while (uartRxFrameMainLoopIndex != uartRxFrameInterruptIndex)
+    {
+        next = (uartRxFrameMainLoopIndex + 1) & (UART_RX_FRAME_COUNT - 1);
+        if (next != uartRxFrameInterruptIndex)
+        {
+            // The next frame has started, so this one is complete.
+            end = uartRxFrameStart[next];
+        }
+        else
+        {
+            // This is the newest frame, so it is only complete if the line
+            // has been idle for longer than the frame gap.  (The interrupt
+            // measures the gap with a tick of rounding in the other direction,
+            // so it will agree that the next byte starts a new frame.)
+            URXNIE = 0;
+            interruptIndex = uartRxBufferInterruptIndex;
+            lastTime = uartRxLastTime;
+            URXNIE = 1;
+
+            if (UART_TIME_DIFF(uartTime(), lastTime) <= uartRxFrameGap)
+            {
+                return 0;
+            }
+            end = interruptIndex;
+        }
+
+        if (end != uartRxBufferMainLoopIndex)
+        {
+            return (UART_RX_INDEX)(end - uartRxBufferMainLoopIndex) & (sizeof(uartRxBuffer) - 1);
+        }
+
+        // All the bytes of this frame have been read, so go to the next one.
+        uartRxFrameMainLoopIndex = next;
+    }
+
+    return 0;
+}
+
+uint32 uartNRxFrameTime(void)
+{
+    // Assumption: uartNRxFrameLength was recently called and it returned a non-zero value.
+    return uartRxFrameMs[uartRxFrameMainLoopIndex];
+}
+
+#ifdef UART0
+
+/* Auto-baud:
+ *
+ * Only UART0 supports automatic baud rate detection, because its RX pin (P0_2)
+ * is also the input of Timer 1's channel 0 in Alt. 1.  (UART1's RX pin, P1_7,
+ * is not connected to any timer that can capture.)
+ *
+ * Timer 1 runs freely at 3 MHz and captures its count on each falling edge of
+ * the RX line.  Each capture triggers a DMA channel, which copies the count
+ * into uartAutoBaudCapture, so the CPU does not do anything until all the
+ * falling edges of the sync character have been captured.  The main loop then
+ * checks that the edges are where they should be for the sync character (if
+ * not, the edges were from something else and we try again), and computes the
+ * baud rate from the time between the first and last edges.
+ *
+ * Timer 1 is also used by other libraries (e.g. servo.lib), so the
+ * measurement is only started if Timer 1 is stopped and its interrupt is
+ * disabled, and the Timer 1 settings that it changes are restored when it
+ * stops. */
+#define UART_AUTO_BAUD_MAX_EDGES    5       // A byte has at most 5 falling edges, counting the start bit.
+#define T1_TICKS_PER_SECOND         3000000 // Timer 1 with a 1:8 prescaler.
+
+static uint8 uartAutoBaudChannel = DMA_CHANNEL_NONE;
+static uint8 uartAutoBaudState = AUTO_BAUD_IDLE;
+static uint8 uartAutoBaudEdgeCount;       // Number of falling edges in the sync character.
+static uint8 XDATA uartAutoBaudEdgeBits[UART_AUTO_BAUD_MAX_EDGES];    // The position of each edge, in bit times.
+static volatile uint16 XDATA uartAutoBaudCapture[UART_AUTO_BAUD_MAX_EDGES];  // The Timer 1 count at each edge.
+static uint32 uartAutoBaudStartTime;
+static uint16 uartAutoBaudTimeout;
+static int32 uartAutoBaudPpm = 0;
+static uint8 uartAutoBaudSavedT1CTL;      // The Timer 1 settings to restore when the measurement stops.
+static uint8 uartAutoBaudSavedT1CCTL0;
+static uint8 uartAutoBaudSavedT1CFG;      // The PERCFG.T1CFG bit.
+
+// The baud rates that the detected rate snaps to if it is within 5% of them.
+static uint32 CODE uartStandardBaudRates[] = {
+    1200, 2400, 4800, 9600, 14400, 19200, 28800, 38400, 57600, 76800,
+    115200, 230400, 250000, 460800, 500000, 921600, 1000000, 1500000
+};
+
+// Configures and arms the DMA channel that copies the Timer 1 captures.
+static void uartAutoBaudArm(void)
+{
+    volatile DMA_CONFIG XDATA * config = dmaChannelConfig(uartAutoBaudChannel);
+
+    config->SRCADDRH = XDATA_SFR_ADDRESS(T1CC0L) >> 8;
+    config->SRCADDRL = XDATA_SFR_ADDRESS(T1CC0L);
+    config->DESTADDRH = (unsigned int)uartAutoBaudCapture >> 8;
+    config->DESTADDRL = (unsigned int)uartAutoBaudCapture;
+    config->VLEN_LENH = 0;
+    config->LENL = uartAutoBaudEdgeCount;
+    config->DC6 = 0b10000010; // WORDSIZE = 1, TMODE = 00 (single), TRIG = 2 (T1_CH0)
+    config->DC7 = 0x10;       // SRCINC = 0, DESTINC = 1, IRQMASK = 0, M8 = 0, PRIORITY = 0
+
+    DMAARM = (1<<uartAutoBaudChannel);
+}
+
+// Stops the measurement and gives the RX pin back to the UART.
+static void uartAutoBaudStop(void)
+{
+    DMAARM = 0x80 | (1<<uartAutoBaudChannel);  // Abort the transfer, if any.
+    T1CTL = uartAutoBaudSavedT1CTL;   // T1CTL.MODE = 00: Suspend Timer 1.
+    T1CCTL0 = uartAutoBaudSavedT1CCTL0;
+    T1IF = 0;             // Clear the flag set by our captures.
+    PERCFG = (PERCFG & ~(1<<6)) | uartAutoBaudSavedT1CFG;
+    P0SEL &= ~(1<<2);     // P0SEL.SELP0_2 = 0
+    UNCSR |= 0x40;        // UNCSR.RE = 1: Enable the receiver.
+}
+
+BIT uartNAutoBaudStart(uint8 syncChar, uint16 timeout)
+{
+    uint8 i;
+    BIT lastBit = 0;    // The start bit is low.
+
+    // Find the falling edges of the sync character: the start bit and every
+    // data bit that is 0 and follows a 1.
+    uartAutoBaudEdgeBits[0] = 0;
+    uartAutoBaudEdgeCount = 1;
+    for (i = 1; i <= 8; i++)
+    {
+        BIT bit = syncChar & 1;
+        syncChar >>= 1;
+        if (lastBit && !bit)
+        {
+            uartAutoBaudEdgeBits[uartAutoBaudEdgeCount++] = i;
+        }
+        lastBit = bit;
+    }
+
+    if (uartAutoBaudEdgeCount < 2)
+    {
+        // The character only has one falling edge, so we can not measure it.
+        return 0;
+    }
+
+    if (uartAutoBaudState == AUTO_BAUD_RUNNING)
+    {
+        // Start over, giving Timer 1 back first.
+        uartAutoBaudStop();
+        uartAutoBaudState = AUTO_BAUD_IDLE;
+    }
+
+    if ((T1CTL & 0x03) || T1IE)
+    {
+        // Timer 1 is running (T1CTL.MODE != 00) or its interrupt is enabled,
+        // so something else is using it.
+        return 0;
+    }
+
+    if (uartAutoBaudChannel == DMA_CHANNEL_NONE)
+    {
+        uartAutoBaudChannel = dmaAllocateChannel();
+        if (uartAutoBaudChannel == DMA_CHANNEL_NONE)
+        {
+            return 0;
+        }
+    }
+
+    // Disable the receiver so the sync character does not end up in the RX
+    // buffer (or cause framing errors) at the wrong baud rate.
+    UNCSR &= ~0x40;      // UNCSR.RE = 0
+
+    uartAutoBaudSavedT1CTL = T1CTL & 0x0C;  // T1CTL.DIV; the other bits are flags, and MODE is 00.
+    uartAutoBaudSavedT1CCTL0 = T1CCTL0;
+    uartAutoBaudSavedT1CFG = PERCFG & (1<<6);
+
+    PERCFG &= ~(1<<6);   // PERCFG.T1CFG = 0: Timer 1 uses alt. location 1 (channel 0 on P0_2).
+    P0SEL |= (1<<2);     // P0SEL.SELP0_2 = 1: The capture input must be a peripheral function pin.
+    T1CTL = 0b00000101;  // DIV = 01 (1:8 prescaler), MODE = 01 (free running)
+    T1CCTL0 = 0b01000010; // IM = 1, MODE = 0 (capture), CAP = 10 (falling edge)
+
+    uartAutoBaudArm();
+    uartAutoBaudStartTime = getMs();
+    uartAutoBaudTimeout = timeout;
+    uartAutoBaudState = AUTO_BAUD_RUNNING;
+    return 1;
+}
+
+uint8 uartNAutoBaudService(void)
+{
+    uint8 i;
+    uint8 bits;
+    uint16 span;
+    uint16 bitTicks;
+    uint32 rate;
+    uint32 standard;
+    uint32 bestDifference;
+    uint32 denominator;
+
+    if (uartAutoBaudState != AUTO_BAUD_RUNNING)
+    {
+        return uartAutoBaudState;
+    }
+
+    if (DMAARM & (1<<uartAutoBaudChannel))
+    {
+        // Still waiting for edges.
+        if (getMs() - uartAutoBaudStartTime > uartAutoBaudTimeout)
+        {
+            uartAutoBaudStop();
+            uartAutoBaudState = AUTO_BAUD_FAILED;
+        }
+        return uartAutoBaudState;
+    }
+
+    // All the edges have been captured.  Make sure each one is within a
+    // quarter of a bit of where it should be.
+    bits = uartAutoBaudEdgeBits[uartAutoBaudEdgeCount - 1];
+    span = uartAutoBaudCapture[uartAutoBaudEdgeCount - 1] - uartAutoBaudCapture[0];
+    bitTicks = span / bits;
+    for (i = 1; i < uartAutoBaudEdgeCount - 1; i++)
+    {
+        uint16 offset = uartAutoBaudCapture[i] - uartAutoBaudCapture[0];
+        uint16 expected = (uint32)span * uartAutoBaudEdgeBits[i] / bits;
+        uint16 difference = offset > expected ? offset - expected : expected - offset;
+        if (difference > bitTicks / 4 + 1)
+        {
+            break;
+        }
+    }
+
+    if (bitTicks < 2 || i < uartAutoBaudEdgeCount - 1)
+    {
+        // These edges did not come from the sync character (or the rate is
+        // too high to measure), so try again.
+        uartAutoBaudArm();
+        return uartAutoBaudState;
+    }
+
+    // Snap to the nearest standard baud rate if it is close enough.
+    rate = ((uint32)T1_TICKS_PER_SECOND * bits + span / 2) / span;
+    standard = rate;
+    bestDifference = 0xFFFFFFFF;
+    for (i = 0; i < sizeof(uartStandardBaudRates) / sizeof(uartStandardBaudRates[0]); i++)
+    {
+        uint32 r = uartStandardBaudRates[i];
+        uint32 difference = rate > r ? rate - r : r - rate;
+        if (difference <= r / 20 && difference < bestDifference)
+        {
+            standard = r;
+            bestDifference = difference;
+        }
+    }
+
+    // The error is (measured - standard) / standard, where the measured rate
+    // is T1_TICKS_PER_SECOND * bits / span.  Both products are about 24
+    // million, so scale them down to avoid overflowing.
+    denominator = standard * span;
+    uartAutoBaudPpm = ((int32)((uint32)T1_TICKS_PER_SECOND * bits - denominator)) * 1000 / (int32)(denominator / 1000);
+
+    uartAutoBaudStop();
+    uartNSetBaudRate(standard);
+    uartAutoBaudState = AUTO_BAUD_DONE;
+    return uartAutoBaudState;
+}
+
+int32 uartNAutoBaudErrorPpm(void)
+{
+    return uartAutoBaudPpm;
+}
+
+#endif
+
+void uartNService(void)
+{
+    uartTxService();
 }
 
 uint8 uartNTxAvailable(void)
 {
-    return UART_TX_BUFFER_FREE_BYTES();
+    UART_TX_INDEX free;
+
+    // In DMA mode, this starts a transfer if the DMA interrupt could not.
+    // It also releases the DE pin after a transmission.
+    uartTxService();
+
+    UART_TX_LOCK();
+    free = UART_TX_BUFFER_FREE_BYTES();
+    UART_TX_UNLOCK();
+
+#if UART_TX_BUFFER_SIZE > 256
+    if (free > 255)
+    {
+        return 255;
+    }
+#endif
+    return free;
+}
+
+BIT uartNTxIdle(void)
+{
+    // Releases the DE pin or starts a DMA transfer if needed.
+    uartTxService();
+
+    if (uartTxBusy())
+    {
+        return 0;
+    }
+
+    // When the TX interrupt disables itself, the last byte has just moved
+    // from UNDBUF to the shift register, so it ends one character time later.
+    // When a DMA transfer finishes, the last byte has just been written to
+    // UNDBUF, so it can take up to two character times to leave the UART.
+    return uartTicksSince(uartTxStopMs, uartTxStopTicks) >= uartCharTicks &&
+        uartTicksSince(uartTxDmaDoneMs, uartTxDmaDoneTicks) >= 2 * uartCharTicks;
 }
 
 void uartNTxSend(const uint8 XDATA * buffer, uint8 size)
@@ -215,16 +1579,28 @@ void uartNTxSend(const uint8 XDATA * buffer, uint8 size)
     // Assumption: uartNTxAvailable() was recently called and it returned a number at least as big as 'size'.
     // TODO: after DMA memcpy is implemented, use it to make this function faster
 
+    // The interrupt only reads uartTxBufferMainLoopIndex, so we can read it
+    // here without a lock, but we must update it in one step.
+    UART_TX_INDEX index = uartTxBufferMainLoopIndex;
+
     while (size)
     {
-        uartTxBuffer[uartTxBufferMainLoopIndex] = *buffer;
+        uartTxBuffer[index] = *buffer;
+        if (uartNineBit)
+        {
+            UART_CLEAR_NINTH_BIT(uartTxNinthBits, index);
+        }
 
         buffer++;
-        uartTxBufferMainLoopIndex = (uartTxBufferMainLoopIndex + 1) & (sizeof(uartTxBuffer) - 1);
+        index = (index + 1) & (sizeof(uartTxBuffer) - 1);
         size--;
-
-        IEN2 |= BV_UTXNIE; // Enable TX interrupt
     }
+
+    UART_TX_LOCK();
+    uartTxBufferMainLoopIndex = index;
+    UART_TX_UNLOCK();
+
+    uartTxService();
 }
 
 void uartNTxSendByte(uint8 byte)
@@ -232,25 +1608,136 @@ void uartNTxSendByte(uint8 byte)
     // Assumption: uartNTxAvailable() was recently called and it returned a non-zero number.
 
     uartTxBuffer[uartTxBufferMainLoopIndex] = byte;
+    if (uartNineBit)
+    {
+        UART_CLEAR_NINTH_BIT(uartTxNinthBits, uartTxBufferMainLoopIndex);
+    }
+
+    UART_TX_LOCK();
+    uartTxBufferMainLoopIndex = (uartTxBufferMainLoopIndex + 1) & (sizeof(uartTxBuffer) - 1);
+    UART_TX_UNLOCK();
+
+    uartTxService();
+}
+
+void uartNTxSendNineBits(uint16 word)
+{
+    // Assumption: uartNTxAvailable() was recently called and it returned a non-zero number.
+
+    if (word & 0x100)
+    {
+        UART_SET_NINTH_BIT(uartTxNinthBits, uartTxBufferMainLoopIndex);
+    }
+    else
+    {
+        UART_CLEAR_NINTH_BIT(uartTxNinthBits, uartTxBufferMainLoopIndex);
+    }
+    uartTxBuffer[uartTxBufferMainLoopIndex] = word;
+
+    UART_TX_LOCK();
     uartTxBufferMainLoopIndex = (uartTxBufferMainLoopIndex + 1) & (sizeof(uartTxBuffer) - 1);
+    UART_TX_UNLOCK();
 
-    IEN2 |= BV_UTXNIE; // Enable TX interrupt
+    uartTxService();
 }
 
 uint8 uartNRxAvailable(void)
 {
-    return UART_RX_BUFFER_USED_BYTES();
+    UART_RX_INDEX used;
+
+    if (uartRxDma)
+    {
+        uartRxDmaService();
+        used = (UART_RX_INDEX)(uartRxBufferInterruptIndex - uartRxBufferMainLoopIndex) & (UART_RX_DMA_SLOT_COUNT - 1);
+    }
+    else
+    {
+        UART_RX_LOCK();
+        used = UART_RX_BUFFER_USED_BYTES();
+        UART_RX_UNLOCK();
+    }
+
+#if UART_RX_BUFFER_SIZE > 256
+    if (used > 255)
+    {
+        return 255;
+    }
+#endif
+    return used;
 }
 
 uint8 uartNRxReceiveByte(void)
 {
     // Assumption: uartNRxAvailable was recently called and it returned a non-zero value.
 
-    uint8 byte = uartRxBuffer[uartRxBufferMainLoopIndex];
-    uartRxBufferMainLoopIndex = (uartRxBufferMainLoopIndex + 1) & (sizeof(uartRxBuffer) - 1);
+    uint8 byte;
+
+    if (uartRxDma)
+    {
+        byte = UART_RX_DMA_DATA(uartRxBufferMainLoopIndex);
+        UART_RX_DMA_MARK(uartRxBufferMainLoopIndex) = ~UNBAUD;
+        UART_RX_LOCK();
+        uartRxBufferMainLoopIndex = (uartRxBufferMainLoopIndex + 1) & (UART_RX_DMA_SLOT_COUNT - 1);
+        UART_RX_UNLOCK();
+    }
+    else
+    {
+        byte = uartRxBuffer[uartRxBufferMainLoopIndex];
+        UART_RX_LOCK();
+        uartRxBufferMainLoopIndex = (uartRxBufferMainLoopIndex + 1) & (sizeof(uartRxBuffer) - 1);
+        UART_RX_UNLOCK();
+    }
+
+    if (uartFlowControl && uartRxFreeBytes() >= UART_RX_RTS_ON_FREE)
+    {
+        UART_RTS = 0;  // Assert RTS.
+    }
     return byte;
 }
 
+uint16 uartNRxReceiveNineBits(void)
+{
+    // Assumption: uartNRxAvailable was recently called and it returned a non-zero value.
+
+    // 9-bit mode is never enabled in DMA mode, so uartRxBufferMainLoopIndex
+    // is a byte index here.
+    uint16 ninth = (uartNineBit && UART_NINTH_BIT(uartRxNinthBits, uartRxBufferMainLoopIndex)) ? 0x100 : 0;
+    return ninth | uartNRxReceiveByte();
+}
+
+uint8 uartNRxErrors(void)
+{
+    uint8 errors = 0;
+    UART_RX_INDEX mask = uartRxDma ? UART_RX_DMA_SLOT_COUNT - 1 : sizeof(uartRxBuffer) - 1;
+    UART_RX_INDEX used;
+
+    // In DMA mode, this function runs in the main loop, just like the code
+    // that adds errors; otherwise we must disable the RX interrupt.
+    URXNIE = 0;
+
+    used = (UART_RX_INDEX)(uartRxBufferInterruptIndex - uartRxBufferMainLoopIndex) & mask;
+    while (uartRxErrorMainLoopIndex != uartRxErrorInterruptIndex)
+    {
+        UART_RX_INDEX position = uartRxErrorPosition[uartRxErrorMainLoopIndex];
+        if (((UART_RX_INDEX)(position - uartRxBufferMainLoopIndex) & mask) <= used && position != uartRxBufferMainLoopIndex)
+        {
+            // This error is after the next byte, so it is not time to report it.
+            break;
+        }
+
+        // This error is at the current position, or it is behind us because
+        // the higher-level code read bytes without calling this function.
+        if (position == uartRxBufferMainLoopIndex)
+        {
+            errors |= uartRxErrorFlags[uartRxErrorMainLoopIndex];
+        }
+        uartRxErrorMainLoopIndex = (uartRxErrorMainLoopIndex + 1) & (UART_RX_ERROR_COUNT - 1);
+    }
+
+    URXNIE = !uartRxDma;
+    return errors;
+}
+
 ISR_UTX()
 {
     // A byte has just started transmitting on TX and there is room in
@@ -261,29 +1748,117 @@ ISR_UTX()
         // There more bytes available in our software buffer, so send
         // the next byte.
 
+        if (uartNineBit && !UART_NINTH_BIT(uartTxNinthBits, uartTxBufferInterruptIndex) != !(UNUCR & 0x20))
+        {
+            // The ninth bit of this byte is different from UNUCR.D9.  Stop
+            // until the main loop changes D9 (see the "9-bit mode" comment).
+            // UTXNIF stays set, so this interrupt will run again as soon as
+            // it is enabled.
+            IEN2 &= ~BV_UTXNIE;
+            uartTxStopTicks = T4CNT;
+            uartTxStopMs = getMsFromIsr(uartTxStopTicks);
+            uartTxD9Pending = 1;
+            return;
+        }
+
         UTXNIF = 0;
 
+        if (uartDePort != 0xFF && !uartDeAsserted)
+        {
+            // Enable the RS-485 driver before the start bit.
+            UART_DE_HIGH();
+            uartDeAsserted = 1;
+        }
+
         UNDBUF = uartTxBuffer[uartTxBufferInterruptIndex];
         uartTxBufferInterruptIndex = (uartTxBufferInterruptIndex + 1) & (sizeof(uartTxBuffer) - 1);
     }
     else
     {
-        // There are no more bytes to send in our buffer, so disable the TX interrupt.
+        // There are no more bytes to send in our buffer, so disable the TX
+        // interrupt.  The last byte just started; record the time so that
+        // uartNTxIdle can tell when it ends.
         IEN2 &= ~BV_UTXNIE;
+        uartTxStopTicks = T4CNT;
+        uartTxStopMs = getMsFromIsr(uartTxStopTicks);
+
+        if (uartDeAsserted)
+        {
+            // Release the RS-485 bus after the last byte ends (see the
+            // "RS-485" comment).
+            if (uartDeAlarm != TIME_ALARM_NONE)
+            {
+                uint16 ticks = (uint16)uartTxStopTicks + uartCharExtraTicks;
+                uartDeReleaseMs = uartTxStopMs + uartCharMs;
+                if (ticks >= T4_TICKS_PER_MS)
+                {
+                    ticks -= T4_TICKS_PER_MS;
+                    uartDeReleaseMs++;
+                }
+                uartDeReleaseTicks = ticks;
+                timeSetAlarm(uartDeAlarm, uartDeReleaseMs, uartDeReleaseTicks, uartDeRelease);
+            }
+        }
     }
 }
 
 ISR_URX()
 {
     uint8 csr;
+    uint8 ninth = 0;
 
     URXNIF = 0;
 
+    if (uartDeAsserted && uartRxSuppressEcho)
+    {
+        // This byte is the echo of a byte we are sending, so discard it.
+        // Reading UNCSR clears the error bits.
+        csr = UNCSR;
+        return;
+    }
+
+    if (uartRxFrameGap)
+    {
+        // Measure the time since the last byte.
+        uint8 ticks = T4CNT;
+        uint32 ms = getMsFromIsr(ticks);
+        uint16 now = (uint16)(uint8)ms * T4_TICKS_PER_MS + ticks;
+
+        if (UART_TIME_DIFF(now, uartRxLastTime) >= uartRxFrameGap)
+        {
+            uartRxNewFrame = 1;
+        }
+        uartRxLastTime = now;
+        uartRxLastMs = ms;
+    }
+
     // Read the Control and Status register for the UART.
     // Reading this register clears the FE and ERR bits,
     // which we need to check later.
     csr = UNCSR;
 
+    if (uartNineBit)
+    {
+        // UNCSR.ERR (3) is 1 iff the ninth bit was different from UNUCR.D9 (5).
+        ninth = ((csr >> 3) ^ (UNUCR >> 5)) & 1;
+        csr &= ~0x08;
+
+        if (uartRxAddressFilter && !(csr & 0x10))
+        {
+            if (ninth)
+            {
+                // This is an address byte, so it decides whether the bytes
+                // after it are for us.
+                uartRxAddressed = (UNDBUF == uartRxAddress);
+            }
+            if (!uartRxAddressed)
+            {
+                // This byte is for another device, so discard it.
+                return;
+            }
+        }
+    }
+
     // check for frame and parity errors
     if (!(csr & 0x18)) // UNCSR.FE (4) == 0; UNCSR.ERR (3) == 0
     {
@@ -291,14 +1866,45 @@ ISR_URX()
 
         if (UART_RX_BUFFER_FREE_BYTES())
         {
+            if (uartRxFrameGap && (uartRxNewFrame || uartRxFrameMainLoopIndex == uartRxFrameInterruptIndex))
+            {
+                // This byte starts a new frame.  If the frame queue is full,
+                // the byte becomes part of the previous frame instead.
+                uint8 next = (uartRxFrameInterruptIndex + 1) & (UART_RX_FRAME_COUNT - 1);
+                if (next != uartRxFrameMainLoopIndex)
+                {
+                    uartRxFrameStart[uartRxFrameInterruptIndex] = uartRxBufferInterruptIndex;
+                    uartRxFrameMs[uartRxFrameInterruptIndex] = uartRxLastMs;
+                    uartRxFrameInterruptIndex = next;
+                }
+                uartRxNewFrame = 0;
+            }
+
             // The software RX buffer has space, so add this new byte to the buffer.
+            if (uartNineBit)
+            {
+                if (ninth)
+                {
+                    UART_SET_NINTH_BIT(uartRxNinthBits, uartRxBufferInterruptIndex);
+                }
+                else
+                {
+                    UART_CLEAR_NINTH_BIT(uartRxNinthBits, uartRxBufferInterruptIndex);
+                }
+            }
             uartRxBuffer[uartRxBufferInterruptIndex] = UNDBUF;
             uartRxBufferInterruptIndex = (uartRxBufferInterruptIndex + 1) & (sizeof(uartRxBuffer) - 1);
+
+            if (uartFlowControl && UART_RX_BUFFER_FREE_BYTES() < UART_RX_RTS_OFF_FREE)
+            {
+                UART_RTS = 1;  // Deassert RTS.
+            }
         }
         else
         {
             // The buffer is full, so discard the received byte and report and overflow error.
             uartNRxBufferFullOccurred = 1;
+            UART_RX_ADD_ERROR(ACM_SERIAL_STATE_OVERRUN);
         }
     }
     else
@@ -306,10 +1912,12 @@ ISR_URX()
         if (csr & 0x10) // UNCSR.FE (4) == 1
         {
             uartNRxFramingErrorOccurred = 1;
+            UART_RX_ADD_ERROR(ACM_SERIAL_STATE_FRAMING);
         }
         if (csr & 0x08) // UNCSR.ERR (3) == 1
         {
             uartNRxParityErrorOccurred = 1;
+            UART_RX_ADD_ERROR(ACM_SERIAL_STATE_PARITY);
         }
     }
 }
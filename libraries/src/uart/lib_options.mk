@@ -1,10 +1,35 @@
 # This library will be made by linking uart0.rel and uart1.rel.
 LIB_RELS := libraries/src/uart/uart0.rel libraries/src/uart/uart1.rel
 
+# The sizes of the TX and RX buffers of each UART, in bytes.  Each size must be
+# a power of two between 2 (4 for RX) and 2048.  The buffers are in XDATA,
+# which is only 3840 bytes, so make a buffer smaller if you need the memory
+# for something else (e.g. radio buffers).  You can change
+# these sizes here or on the command line, for example:
+#   make clean libs UART1_RX_BUFFER_SIZE=1024
+# Run "make uart_memory" to see how much XDATA the buffers will use.
+UART0_TX_BUFFER_SIZE ?= 256
+UART0_RX_BUFFER_SIZE ?= 256
+UART1_TX_BUFFER_SIZE ?= 256
+UART1_RX_BUFFER_SIZE ?= 256
+
+# Set these to 1 to make 9-bit mode (uart0SetNineBit/uart1SetNineBit)
+# available.  9-bit mode stores the ninth bit of every byte in the buffers, so
+# it uses an extra (TX buffer size + RX buffer size) / 8 bytes of XDATA.
+UART0_NINE_BIT ?= 0
+UART1_NINE_BIT ?= 0
+
 # When those rel (object) files are compiled, there will be a
 # special preprocessor flag to specify which UART to use.
-libraries/src/uart/uart0.rel : C_FLAGS += -DUART0
-libraries/src/uart/uart1.rel : C_FLAGS += -DUART1
+libraries/src/uart/uart0.rel : C_FLAGS += -DUART0 \
+  -DUART_TX_BUFFER_SIZE=$(UART0_TX_BUFFER_SIZE) -DUART_RX_BUFFER_SIZE=$(UART0_RX_BUFFER_SIZE) \
+  -DUART_NINE_BIT=$(UART0_NINE_BIT)
+libraries/src/uart/uart1.rel : C_FLAGS += -DUART1 \
+  -DUART_TX_BUFFER_SIZE=$(UART1_TX_BUFFER_SIZE) -DUART_RX_BUFFER_SIZE=$(UART1_RX_BUFFER_SIZE) \
+  -DUART_NINE_BIT=$(UART1_NINE_BIT)
+
+# Recompile the library if the options above are edited.
+libraries/src/uart/uart0.rel libraries/src/uart/uart1.rel : libraries/src/uart/lib_options.mk
 
 # The rel files will be compiled from uart0.c and uart1.c,
 # which will both be copies of core/uart.c.
@@ -15,3 +40,18 @@ libraries/src/uart/uart1.c : libraries/src/uart/core/uart.c
 	$(CP) $< $@
 
 TARGETS += libraries/src/uart/uart0.c libraries/src/uart/uart1.c
+
+# Prints the amount of XDATA used by each UART.  The sizes are read from the
+# compiled uart0.rel and uart1.rel, so they include everything the library
+# allocates in XDATA for that UART with the options above: the TX and RX
+# buffers (in DMA mode, the RX buffer holds one received byte in every two
+# bytes, but its size is the same), the ninth-bit arrays if 9-bit mode is
+# enabled, the frame and error queues, and the auto-baud state of UART0.
+# An app only gets the memory of the UARTs it uses, because the linker leaves
+# out uart0.rel or uart1.rel if nothing refers to it.  The .mem file generated
+# for each app shows the total memory it uses.
+.PHONY : uart_memory
+uart_memory : libraries/src/uart/uart0.rel libraries/src/uart/uart1.rel
+	@$(ECHO) "XDATA used by each UART (the size is in hexadecimal bytes):"
+	@$(GREP) -H "^A XSEG" $^
+	@$(ECHO) "(XDATA available on the CC2511: 3840 bytes, 0xF00)"
@@ -3,7 +3,7 @@
 #include <usb.h>
 #include <usb_com.h>
 #include <board.h>           // just for boardStartBootloader() and serialNumberString
-#include <time.h>            // just for timing the start of the bootloader
+#include <time.h>            // for timing the start of the bootloader and the serial state
 
 // NOTE: We could easily remove the dependency on time.h if we added a
 // function called startBootloaderSoon() in board.h that started the bootloader
@@ -76,6 +76,17 @@ uint8 usbComSerialState = 0;
 // a state yet.
 static uint8 lastReportedSerialState = 0xFF;
 
+// The longest time (in ms) that usbComTxAvailable holds back data while there
+// are signal events that have not been reported.  The host normally polls the
+// notification endpoint every millisecond, but some host software never reads
+// it, and then we have to let the data through.
+#define SERIAL_STATE_MAX_HOLD_MS 20
+
+// True iff usbComTxAvailable is holding back data until the signal events are
+// reported, and the lower 8 bits of the time (in ms) when it started.
+static BIT holdingDataForSerialState = 0;
+static uint8 XDATA holdingDataStartTime;
+
 ACM_LINE_CODING XDATA usbComLineCoding =
 {
     9600,     // dwDTERate (baud rate)
@@ -456,6 +467,27 @@ uint8 usbComTxAvailable()
         return 0;
     }
 
+    if (usbComSerialState & ACM_IRREGULAR_SIGNAL_MASK)
+    {
+        // There are signal events that will be reported by usbComService as
+        // soon as the notification endpoint is free.  Hold back the data that
+        // came after the events until then, even if the endpoint is still busy
+        // with the last notification, but not forever.
+        if (!holdingDataForSerialState)
+        {
+            holdingDataForSerialState = 1;
+            holdingDataStartTime = (uint8)getMs();
+        }
+        if ((uint8)(getMs() - holdingDataStartTime) < SERIAL_STATE_MAX_HOLD_MS)
+        {
+            return 0;
+        }
+    }
+    else
+    {
+        holdingDataForSerialState = 0;
+    }
+
     USBINDEX = CDC_DATA_ENDPOINT;
     tmp = USBCSIL;
     if (tmp & USBCSIL_PKT_PRESENT)
@@ -524,5 +556,12 @@ void usbComTxControlSignals(uint8 signals)
 
 void usbComTxControlSignalEvents(uint8 signalEvents)
 {
+    if (usbDeviceState == USB_STATE_CONFIGURED && inFifoBytesLoaded)
+    {
+        // Send the data that came before these events so that the USB host
+        // can get it before the notification.
+        sendPacketNow();
+    }
+
     usbComSerialState |= signalEvents;
 }
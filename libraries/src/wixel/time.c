@@ -8,12 +8,86 @@
 #include <cc2511_types.h>
 #include <time.h>
 
-PDATA volatile uint32 timeMs;
+static PDATA volatile uint32 timeMs;
+
+// Bit N is 1 iff alarm N has been reserved by timeAllocateAlarm().
+static uint8 timeAlarmsUsed = 0;
+
+// The function to call when each alarm goes off, or 0, and the time when it
+// should go off.
+typedef void (*TIME_ALARM_CALLBACK)(void);
+static volatile TIME_ALARM_CALLBACK XDATA timeAlarmCallback[TIME_ALARM_COUNT];
+static volatile uint32 XDATA timeAlarmMs[TIME_ALARM_COUNT];
+static volatile uint8 XDATA timeAlarmTicks[TIME_ALARM_COUNT];
+
+// Calls the functions of the alarms whose time has come, and sets up channel 1
+// of Timer 4 to interrupt at the time of the next alarm in this millisecond,
+// if there is one.  The alarms in later milliseconds are checked again after
+// each overflow.
+static void timeServiceAlarms(void)
+{
+    uint8 i;
+    uint8 next;
+    TIME_ALARM_CALLBACK callback;
+
+    do
+    {
+        next = 0xFF;
+        for (i = 0; i < TIME_ALARM_COUNT; i++)
+        {
+            // timeSetAlarm can be called from a higher-priority ISR.
+            EA = 0;
+            callback = timeAlarmCallback[i];
+            if (callback && ((int32)(timeMs - timeAlarmMs[i]) > 0 ||
+                (timeMs == timeAlarmMs[i] && T4CNT >= timeAlarmTicks[i])))
+            {
+                timeAlarmCallback[i] = 0;
+            }
+            else
+            {
+                if (callback && timeMs == timeAlarmMs[i] && timeAlarmTicks[i] < next)
+                {
+                    next = timeAlarmTicks[i];
+                }
+                callback = 0;
+            }
+            EA = 1;
+
+            if (callback)
+            {
+                callback();
+            }
+        }
+
+        if (next == 0xFF)
+        {
+            T4CCTL1 = 0;        // No compare interrupt.
+            return;
+        }
+        T4CC1 = next;
+        T4CCTL1 = 0b01000100;   // IM = 1, CMP = 000, MODE = 1 (compare)
+
+        // If T4CNT passed T4CC1 before we set it, there will be no interrupt,
+        // so check again.
+    } while (T4CNT >= next);
+}
 
 ISR(T4, 0)
 {
-    timeMs++;
-    // T4CC0 ^= 1; // If we do this, then on average the interrupts will occur precisely 1.000 ms apart.
+    // This interrupt runs when Timer 4 overflows, when channel 1 matches an
+    // alarm time, and when timeSetAlarm is called.
+    if (T4OVFIF)
+    {
+        T4OVFIF = 0;
+        timeMs++;
+        // T4CC0 ^= 1; // If we do this, then on average the interrupts will occur precisely 1.000 ms apart.
+    }
+    T4CH1IF = 0;
+
+    if (timeAlarmsUsed)
+    {
+        timeServiceAlarms();
+    }
 }
 
 uint32 getMs()
@@ -26,6 +100,49 @@ uint32 getMs()
     return time;            // return timer count copy
 }
 
+uint32 getMsFromIsr(uint8 ticks)
+{
+    // The Timer 4 interrupt can not run now, so timeMs can not change while
+    // we read it.  If T4OVFIF is set, Timer 4 has overflowed but timeMs has not
+    // been incremented yet: a small tick count was read after the overflow.
+    if (T4OVFIF && ticks < 94)   // Timer 4 counts from 0 to 187 (T4CC0).
+    {
+        return timeMs + 1;
+    }
+    return timeMs;
+}
+
+uint8 timeAllocateAlarm()
+{
+    uint8 alarm;
+
+    for (alarm = 0; alarm < TIME_ALARM_COUNT; alarm++)
+    {
+        if (!(timeAlarmsUsed & (1<<alarm)))
+        {
+            timeAlarmCallback[alarm] = 0;
+            timeAlarmsUsed |= (1<<alarm);
+            return alarm;
+        }
+    }
+    return TIME_ALARM_NONE;
+}
+
+void timeSetAlarm(uint8 alarm, uint32 ms, uint8 ticks, void (*callback)(void)) __reentrant
+{
+    BIT savedEA = EA;
+
+    EA = 0;
+    timeAlarmMs[alarm] = ms;
+    timeAlarmTicks[alarm] = ticks;
+    timeAlarmCallback[alarm] = callback;
+    EA = savedEA;
+
+    // Make the Timer 4 interrupt run so it can call the function or set up
+    // the compare for it.
+    T4IF = 1;
+}
+
 void timeInit()
 {
     T4CC0 = 187;
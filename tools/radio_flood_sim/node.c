@@ -0,0 +1,45 @@
+/* node.c:
+ *  A copy of radio_flood.c for one simulated Wixel.  The Makefile compiles this
+ *  file once for each Wixel, with SIM_NODE defined to the Wixel's index, and
+ *  the macros below give every copy of the library's global functions and
+ *  variables a different name (e.g. radioFloodInit_2) so they can all be
+ *  linked into one program.  The static variables of radio_flood.c are
+ *  already private to each copy.
+ */
+
+#define SIM_PASTE(name, node) name##_##node
+#define SIM_EXPAND(name, node) SIM_PASTE(name, node)
+#define SIM_NAME(name) SIM_EXPAND(name, SIM_NODE)
+
+#define radioFloodId                SIM_NAME(radioFloodId)
+#define radioFloodTtl               SIM_NAME(radioFloodTtl)
+#define radioFloodRelayEnabled      SIM_NAME(radioFloodRelayEnabled)
+#define radioFloodRelayDelayMask    SIM_NAME(radioFloodRelayDelayMask)
+#define radioFloodRelayedCount      SIM_NAME(radioFloodRelayedCount)
+#define radioFloodDuplicateCount    SIM_NAME(radioFloodDuplicateCount)
+#define radioFloodRelayDropCount    SIM_NAME(radioFloodRelayDropCount)
+#define radioFloodInit              SIM_NAME(radioFloodInit)
+#define radioFloodService           SIM_NAME(radioFloodService)
+#define radioFloodTxCurrentPacket   SIM_NAME(radioFloodTxCurrentPacket)
+#define radioFloodTxSendPacket      SIM_NAME(radioFloodTxSendPacket)
+#define radioFloodRxCurrentPacket   SIM_NAME(radioFloodRxCurrentPacket)
+#define radioFloodRxCurrentSource   SIM_NAME(radioFloodRxCurrentSource)
+#define radioFloodRxDoneWithPacket  SIM_NAME(radioFloodRxDoneWithPacket)
+
+#include "../../libraries/src/radio_flood/radio_flood.c"
+
+const SIM_NODE_API SIM_NAME(simNode) =
+{
+    radioFloodInit,
+    radioFloodService,
+    radioFloodTxCurrentPacket,
+    radioFloodTxSendPacket,
+    radioFloodRxCurrentPacket,
+    radioFloodRxCurrentSource,
+    radioFloodRxDoneWithPacket,
+    &radioFloodId,
+    &radioFloodTtl,
+    &radioFloodRelayedCount,
+    &radioFloodDuplicateCount,
+    &radioFloodRelayDropCount,
+};
@@ -0,0 +1,358 @@
+/* radio_flood_sim.c:
+ *  Simulates a network of Wixels running radio_flood.lib, and checks that the
+ *  packets are delivered to every Wixel within range of their TTL exactly once.
+ *
+ *  Each simulated Wixel runs its own copy of radio_flood.c (see node.c) on top
+ *  of a simulated radio_queue.  Time advances in steps of 1 ms.  In each step,
+ *  every Wixel runs radioFloodService() and reads the packets it has received,
+ *  and then one Wixel that has a packet queued (taking turns) sends it to all
+ *  of the Wixels that can hear it, since a packet takes about 1 ms on the air.
+ *  Collisions are not simulated, but a Wixel whose RX buffers are full drops
+ *  the packets it hears, like radio_queue does.
+ *
+ *  The program prints the result of each scenario and returns 0 if they all
+ *  passed.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "sim.h"
+
+#define TX_PACKET_COUNT 16
+#define RX_PACKET_COUNT 2   // radio_queue has 3 RX buffers, but one always belongs to the ISR.
+
+#define MAX_MESSAGES 32
+
+extern const SIM_NODE_API simNode_0, simNode_1, simNode_2, simNode_3, simNode_4, simNode_5;
+static const SIM_NODE_API * nodes[SIM_NODE_COUNT] =
+{
+    &simNode_0, &simNode_1, &simNode_2, &simNode_3, &simNode_4, &simNode_5
+};
+
+uint8 simSerialNumber[SIM_NODE_COUNT][4];
+
+/* SIMULATED RADIO_QUEUE ******************************************************/
+
+typedef struct SIM_QUEUE
+{
+    uint8 tx[TX_PACKET_COUNT][1 + RADIO_QUEUE_PAYLOAD_SIZE];
+    uint8 txAdded, txRemoved;
+    uint8 rx[RX_PACKET_COUNT][1 + RADIO_QUEUE_PAYLOAD_SIZE + 2];
+    uint8 rxAdded, rxRemoved;
+} SIM_QUEUE;
+
+static SIM_QUEUE queues[SIM_NODE_COUNT];
+
+// hears[a][b] is 1 iff Wixel b receives the packets sent by Wixel a.
+static uint8 hears[SIM_NODE_COUNT][SIM_NODE_COUNT];
+static uint8 nodeCount;
+
+static uint32 simTime;
+static uint8 nextSender;
+static uint32 randomState = 1;
+
+static uint32 airPackets;       // Packets sent on the air.
+static uint32 rxOverflows;      // Packets lost because the receiver's buffers were full.
+
+void simQueueInit(uint8 node)
+{
+    memset(&queues[node], 0, sizeof(SIM_QUEUE));
+}
+
+uint8 * simTxCurrentPacket(uint8 node)
+{
+    SIM_QUEUE * q = &queues[node];
+    if ((uint8)(q->txAdded - q->txRemoved) >= TX_PACKET_COUNT)
+    {
+        return 0;
+    }
+    return q->tx[q->txAdded % TX_PACKET_COUNT];
+}
+
+void simTxSendPacket(uint8 node)
+{
+    queues[node].txAdded++;
+}
+
+uint8 * simRxCurrentPacket(uint8 node)
+{
+    SIM_QUEUE * q = &queues[node];
+    if (q->rxAdded == q->rxRemoved)
+    {
+        return 0;
+    }
+    return q->rx[q->rxRemoved % RX_PACKET_COUNT];
+}
+
+void simRxDoneWithPacket(uint8 node)
+{
+    queues[node].rxRemoved++;
+}
+
+uint8 simRandomNumber(void)
+{
+    randomState = randomState * 1103515245 + 12345;
+    return randomState >> 16;
+}
+
+uint32 simGetMs(void)
+{
+    return simTime;
+}
+
+// Sends the first packet in the TX queue of the next Wixel that has one to the
+// Wixels that hear it.
+static void airTransmit(void)
+{
+    SIM_QUEUE * q;
+    uint8 * packet;
+    uint8 sender, i;
+
+    for (i = 0; i < nodeCount; i++)
+    {
+        sender = (nextSender + i) % nodeCount;
+        if (queues[sender].txAdded != queues[sender].txRemoved)
+        {
+            break;
+        }
+    }
+    if (i == nodeCount)
+    {
+        return;
+    }
+    nextSender = sender + 1;
+
+    q = &queues[sender];
+    packet = q->tx[q->txRemoved % TX_PACKET_COUNT];
+    airPackets++;
+
+    for (i = 0; i < nodeCount; i++)
+    {
+        SIM_QUEUE * r = &queues[i];
+        if (i == sender || !hears[sender][i])
+        {
+            continue;
+        }
+        if ((uint8)(r->rxAdded - r->rxRemoved) >= RX_PACKET_COUNT)
+        {
+            rxOverflows++;
+            continue;
+        }
+        memcpy(r->rx[r->rxAdded % RX_PACKET_COUNT], packet, 1 + packet[0]);
+        r->rxAdded++;
+    }
+
+    q->txRemoved++;
+}
+
+/* SCENARIOS ******************************************************************/
+
+// deliveries[receiver][origin][message] counts how many times each message
+// was delivered to the higher-level code.
+static uint8 deliveries[SIM_NODE_COUNT][SIM_NODE_COUNT][MAX_MESSAGES];
+static uint8 badSource;
+
+static void setUp(uint8 count, uint8 ttl)
+{
+    uint8 i;
+
+    nodeCount = count;
+    memset(hears, 0, sizeof(hears));
+    memset(deliveries, 0, sizeof(deliveries));
+    badSource = 0;
+    airPackets = 0;
+    rxOverflows = 0;
+
+    for (i = 0; i < nodeCount; i++)
+    {
+        // The first byte of every serial number is the same, so the IDs are
+        // only unique if the library uses more than one byte.
+        simSerialNumber[i][0] = 0x42;
+        simSerialNumber[i][1] = i;
+        simSerialNumber[i][2] = 0x10;
+        simSerialNumber[i][3] = 0x20;
+
+        *nodes[i]->id = 0;
+        nodes[i]->init();
+        *nodes[i]->ttl = ttl;
+        *nodes[i]->relayedCount = 0;
+        *nodes[i]->duplicateCount = 0;
+        *nodes[i]->relayDropCount = 0;
+    }
+}
+
+// Each Wixel only hears its neighbors: 0 - 1 - 2 - ... - (count-1).
+static void makeLine(void)
+{
+    uint8 i;
+    for (i = 0; i + 1 < nodeCount; i++)
+    {
+        hears[i][i + 1] = 1;
+        hears[i + 1][i] = 1;
+    }
+}
+
+// Every Wixel hears every other Wixel.
+static void makeMesh(void)
+{
+    uint8 i, j;
+    for (i = 0; i < nodeCount; i++)
+    {
+        for (j = 0; j < nodeCount; j++)
+        {
+            hears[i][j] = (i != j);
+        }
+    }
+}
+
+// Runs the network for the given number of milliseconds.  Every Wixel in the
+// senders bitmap sends messageCount messages, one every interval milliseconds.
+static void run(uint32 duration, uint8 senders, uint8 messageCount, uint8 interval)
+{
+    uint32 end = simTime + duration;
+    uint32 start = simTime;
+    uint8 * packet;
+    uint8 i;
+
+    while (simTime < end)
+    {
+        for (i = 0; i < nodeCount; i++)
+        {
+            uint32 elapsed = simTime - start;
+            if ((senders & (1 << i)) && elapsed % interval == 0 && elapsed / interval < messageCount)
+            {
+                packet = nodes[i]->txCurrentPacket();
+                if (packet)
+                {
+                    packet[0] = 2;
+                    packet[1] = i;
+                    packet[2] = elapsed / interval;
+                    nodes[i]->txSendPacket();
+                }
+            }
+
+            nodes[i]->service();
+
+            while ((packet = nodes[i]->rxCurrentPacket()))
+            {
+                uint8 origin = packet[1];
+                if (packet[0] != 2 || origin >= nodeCount || packet[2] >= MAX_MESSAGES ||
+                    nodes[i]->rxCurrentSource() != *nodes[origin]->id)
+                {
+                    badSource = 1;
+                }
+                else
+                {
+                    deliveries[i][origin][packet[2]]++;
+                }
+                nodes[i]->rxDoneWithPacket();
+            }
+        }
+
+        airTransmit();
+        simTime++;
+    }
+}
+
+static uint8 failures = 0;
+
+static void check(const char * name, uint8 passed)
+{
+    printf("%s: %s\n", passed ? "PASS" : "FAIL", name);
+    if (!passed)
+    {
+        failures++;
+    }
+}
+
+// Checks that every message from origin was delivered exactly once to the
+// Wixels within maxHops hops in a line, and never to the others.
+static uint8 deliveredInLine(uint8 origin, uint8 messageCount, uint8 maxHops)
+{
+    uint8 i, m;
+    for (i = 0; i < nodeCount; i++)
+    {
+        uint8 hops = i > origin ? i - origin : origin - i;
+        uint8 expected = (i != origin && hops <= maxHops) ? 1 : 0;
+        for (m = 0; m < messageCount; m++)
+        {
+            if (deliveries[i][origin][m] != expected)
+            {
+                printf("  Wixel %u got message %u from Wixel %u %u times (expected %u).\n",
+                    i, m, origin, deliveries[i][origin][m], expected);
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+static uint16 totalDuplicates(void)
+{
+    uint16 total = 0;
+    uint8 i;
+    for (i = 0; i < nodeCount; i++)
+    {
+        total += *nodes[i]->duplicateCount;
+    }
+    return total;
+}
+
+int main(void)
+{
+    uint8 i, j, m, ok;
+
+    setUp(6, 3);
+    ok = 1;
+    for (i = 0; i < nodeCount; i++)
+    {
+        for (j = 0; j < i; j++)
+        {
+            if (*nodes[i]->id == *nodes[j]->id)
+            {
+                ok = 0;
+            }
+        }
+    }
+    check("IDs are unique when the serial numbers share their first byte", ok);
+
+    setUp(6, 5);
+    makeLine();
+    run(1000, 1 << 0, 20, 10);
+    check("line of 6, TTL 5: every Wixel gets every message once", deliveredInLine(0, 20, 5) && !badSource);
+
+    setUp(6, 2);
+    makeLine();
+    run(1000, 1 << 0, 20, 10);
+    check("line of 6, TTL 2: messages go two hops and no further", deliveredInLine(0, 20, 2) && !badSource);
+
+    setUp(6, 5);
+    makeLine();
+    run(1500, (1 << 0) | (1 << 5), 20, 15);
+    check("line of 6, both ends sending: every message arrives once",
+        deliveredInLine(0, 20, 5) && deliveredInLine(5, 20, 5) && !badSource);
+
+    setUp(6, 3);
+    makeMesh();
+    run(2000, 0x3F, 10, 40);
+    ok = !badSource;
+    for (i = 0; i < nodeCount; i++)
+    {
+        for (j = 0; j < nodeCount; j++)
+        {
+            for (m = 0; m < 10; m++)
+            {
+                if (deliveries[i][j][m] != (i != j))
+                {
+                    ok = 0;
+                }
+            }
+        }
+    }
+    check("mesh of 6, all sending: every message arrives once", ok);
+    check("mesh of 6, all sending: relayed copies are recognized as duplicates", totalDuplicates() > 0);
+
+    printf("%u air packets, %u lost to full RX buffers\n", (unsigned)airPackets, (unsigned)rxOverflows);
+
+    return failures ? 1 : 0;
+}
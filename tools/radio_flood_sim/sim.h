@@ -0,0 +1,45 @@
+/* sim.h:
+ *  Declarations shared by the simulated radio_queue (radio_flood_sim.c) and
+ *  the copies of radio_flood.c that run on the simulated Wixels (node.c).
+ */
+
+#ifndef _SIM_H
+#define _SIM_H
+
+#include <cc2511_types.h>
+
+#define SIM_NODE_COUNT 6
+
+// The size of a radio_queue payload, the same as on the Wixel.
+#define RADIO_QUEUE_PAYLOAD_SIZE 19
+
+// The functions and variables of one copy of radio_flood.lib.
+typedef struct SIM_NODE_API
+{
+    void (*init)(void);
+    void (*service)(void);
+    uint8 * (*txCurrentPacket)(void);
+    void (*txSendPacket)(void);
+    uint8 * (*rxCurrentPacket)(void);
+    uint16 (*rxCurrentSource)(void);
+    void (*rxDoneWithPacket)(void);
+    uint16 * id;
+    uint8 * ttl;
+    uint16 * relayedCount;
+    uint16 * duplicateCount;
+    uint16 * relayDropCount;
+} SIM_NODE_API;
+
+// The simulated radio_queue.  The node parameter says which Wixel is calling.
+void simQueueInit(uint8 node);
+uint8 * simTxCurrentPacket(uint8 node);
+void simTxSendPacket(uint8 node);
+uint8 * simRxCurrentPacket(uint8 node);
+void simRxDoneWithPacket(uint8 node);
+
+uint8 simRandomNumber(void);
+uint32 simGetMs(void);
+
+extern uint8 simSerialNumber[SIM_NODE_COUNT][4];
+
+#endif
@@ -0,0 +1,10 @@
+/* board.h (simulation): each simulated Wixel has its own serial number. */
+
+#ifndef _BOARD_H
+#define _BOARD_H
+
+#include "sim.h"
+
+#define serialNumber (simSerialNumber[SIM_NODE])
+
+#endif
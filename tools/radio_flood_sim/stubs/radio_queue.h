@@ -0,0 +1,17 @@
+/* radio_queue.h (simulation):
+ *  Sends the radio_queue calls made by radio_flood.c to the simulated radio of
+ *  the Wixel that node.c is being compiled for.
+ */
+
+#ifndef _RADIO_QUEUE
+#define _RADIO_QUEUE
+
+#include "sim.h"
+
+#define radioQueueInit()              simQueueInit(SIM_NODE)
+#define radioQueueTxCurrentPacket()   simTxCurrentPacket(SIM_NODE)
+#define radioQueueTxSendPacket()      simTxSendPacket(SIM_NODE)
+#define radioQueueRxCurrentPacket()   simRxCurrentPacket(SIM_NODE)
+#define radioQueueRxDoneWithPacket()  simRxDoneWithPacket(SIM_NODE)
+
+#endif
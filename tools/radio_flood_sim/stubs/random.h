@@ -0,0 +1,10 @@
+/* random.h (simulation): all the simulated Wixels share one generator. */
+
+#ifndef _RANDOM_H
+#define _RANDOM_H
+
+#include "sim.h"
+
+#define randomNumber() simRandomNumber()
+
+#endif
@@ -0,0 +1,10 @@
+/* time.h (simulation): all the simulated Wixels share one clock. */
+
+#ifndef _WIXEL_TIME_H
+#define _WIXEL_TIME_H
+
+#include "sim.h"
+
+#define getMs() simGetMs()
+
+#endif